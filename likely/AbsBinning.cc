@@ -23,6 +23,20 @@ double local::AbsBinning::getBinWidth(int index) const {
     return getBinHighEdge(index) - getBinLowEdge(index);
 }
 
+int local::AbsBinning::getBinIndices(double const *values, int *indices, int n) const {
+    int nOutside(0);
+    for(int k = 0; k < n; ++k) {
+        try {
+            indices[k] = getBinIndex(values[k]);
+        }
+        catch(BinningError const &e) {
+            indices[k] = -1;
+            nOutside++;
+        }
+    }
+    return nOutside;
+}
+
 bool local::AbsBinning::isValidBinIndex(int index, std::string const &errorFormat) const {
     if(index >= 0 && index < getNBins()) return true;
     if(0 < errorFormat.length()) {
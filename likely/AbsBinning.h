@@ -20,6 +20,12 @@ namespace likely {
         // Returns the bin index [0,nBins-1] corresponding to the specified value, or throws a
         // BinningError if value does not fall in any bin.
         virtual int getBinIndex(double value) const = 0;
+        // Fills the array indices with the bin index [0,nBins-1] corresponding to each of the n
+        // values provided, or with -1 for any value that does not fall in any bin, and returns
+        // the number of such values. No BinningError is thrown for these values. The default
+        // implementation calls getBinIndex for each value, but subclasses override this with
+        // a loop that the compiler can inline and vectorize.
+        virtual int getBinIndices(double const *values, int *indices, int n) const;
         // Returns the total number of bins.
         virtual int getNBins() const = 0;
         // Returns the lower bound of the specified bin. Throws a BinningError if index is out of range.
@@ -4,6 +4,22 @@
 #include "likely/RuntimeError.h"
 #include "likely/FunctionMinimum.h"
 #include "likely/EngineRegistry.h"
+#include "likely/NumericalGradient.h"
+#include "likely/BinnedGrid.h"
+#include "likely/BinnedData.h"
+#include "likely/MarkovChainEngine.h"
+#include "likely/Random.h"
+
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/bind.hpp"
+#include "boost/ref.hpp"
+
+#include <utility>
+#include <deque>
 
 namespace local = likely;
 
@@ -13,24 +29,34 @@ local::AbsEngine::AbsEngine()
 
 local::AbsEngine::~AbsEngine() { }
 
-local::FunctionMinimumPtr local::findMinimum(FunctionPtr f, GradientCalculatorPtr gc,
-FitParameters const &parameters, std::string const &methodName,
-double precision, long maxIterations) {
-    // Create a new engine for this function.
-    AbsEnginePtr engine = getEngine(methodName,f,gc,parameters);
+local::FunctionMinimumPtr local::AbsEngine::runMinimumFinder(FunctionPtr f,
+GradientCalculatorPtr gc, FitParameters const &parameters, double precision,
+long maxIterations) {
     // Initialize a result object (without any covariance) for the algorithm to update.
     Parameters values;
     getFitParameterValues(parameters,values);
     double fval = (*f)(values);
-    engine->incrementEvalCount();
+    incrementEvalCount();
     FunctionMinimumPtr fmin(new FunctionMinimum(fval,parameters));
+    // Is the gradient estimated numerically? If so, its function evaluations count as ours.
+    NumericalGradient const *numerical = gc ? gc->target<NumericalGradient>() : 0;
+    long numericalEvals = numerical ? numerical->getEvalCount() : 0;
     // Run the algorithm.
-    engine->minimumFinder(fmin,precision,maxIterations);
+    minimumFinder(fmin,precision,maxIterations);
+    if(numerical) incrementEvalCount(numerical->getEvalCount() - numericalEvals);
     // Save the evaluation counts.
-    fmin->setCounts(engine->getEvalCount(),engine->getGradCount());
+    fmin->setCounts(getEvalCount(),getGradCount());
     return fmin;
 }
 
+local::FunctionMinimumPtr local::findMinimum(FunctionPtr f, GradientCalculatorPtr gc,
+FitParameters const &parameters, std::string const &methodName,
+double precision, long maxIterations) {
+    // Create a new engine for this function.
+    AbsEnginePtr engine = getEngine(methodName,f,gc,parameters);
+    return engine->runMinimumFinder(f,gc,parameters,precision,maxIterations);
+}
+
 local::FunctionMinimumPtr local::findMinimum(FunctionPtr f,
 FitParameters const &parameters, std::string const &methodName,
 double precision, long maxIterations) {
@@ -38,3 +64,321 @@ double precision, long maxIterations) {
     GradientCalculatorPtr gc;
     return findMinimum(f,gc,parameters,methodName,precision,maxIterations);
 }
+
+namespace {
+    // Runs one fit of a batch. Markov chain engines normally share the default generator,
+    // which must not be used concurrently, so each of their fits instead uses its own
+    // substream of the default generator's seed, indexed by the fit.
+    local::FunctionMinimumPtr findBatchMinimum(local::FunctionPtr f,
+    local::GradientCalculatorPtr gc, local::FitParameters const &parameters,
+    std::string const &methodName, double precision, long maxIterations, int index) {
+        std::string::size_type split(methodName.find("::"));
+        if(split == std::string::npos || methodName.substr(0,split) != "mc") {
+            return local::findMinimum(f,gc,parameters,methodName,precision,maxIterations);
+        }
+        local::AbsEnginePtr engine(new local::MarkovChainEngine(f,gc,parameters,
+            methodName.substr(split+2),local::Random::instance()->createStream(index)));
+        return engine->runMinimumFinder(f,gc,parameters,precision,maxIterations);
+    }
+
+    // Shares the state of a findMinima batch between its worker threads.
+    struct FitBatch {
+        std::vector<local::FunctionPtr> const *functions;
+        std::vector<local::GradientCalculatorPtr> const *gradients;
+        local::FitParameters const *parameters;
+        std::string methodName;
+        double precision;
+        long maxIterations;
+        // The remaining [first,last) block of fits owned by each worker, protected by mutex.
+        boost::mutex mutex;
+        std::vector<std::pair<int,int> > blocks;
+        bool stop;
+        std::string error;
+        // Each worker only writes to the elements of the fits it runs.
+        std::vector<local::FunctionMinimumPtr> results;
+        std::vector<double> fitTime;
+    }; // FitBatch
+
+    // Returns the index of the next fit for the specified worker, stealing half of the
+    // largest remaining block when its own block is empty, or -1 when no fits remain.
+    int nextFit(FitBatch &batch, int worker) {
+        boost::mutex::scoped_lock lock(batch.mutex);
+        if(batch.stop) return -1;
+        std::pair<int,int> &own(batch.blocks[worker]);
+        if(own.first < own.second) return own.first++;
+        int victim(-1), largest(0);
+        for(int other = 0; other < batch.blocks.size(); ++other) {
+            int remaining(batch.blocks[other].second - batch.blocks[other].first);
+            if(remaining > largest) {
+                victim = other;
+                largest = remaining;
+            }
+        }
+        if(victim < 0) return -1;
+        // Take the back half of the victim's block, rounded up.
+        std::pair<int,int> &stolen(batch.blocks[victim]);
+        int middle(stolen.first + largest/2);
+        own = std::make_pair(middle,stolen.second);
+        stolen.second = middle;
+        return own.first++;
+    }
+    // Runs fits until none remain or a fit fails.
+    void runFits(FitBatch &batch, int worker) {
+        namespace pt = boost::posix_time;
+        int index;
+        while((index = nextFit(batch,worker)) >= 0) {
+            pt::ptime start(pt::microsec_clock::universal_time());
+            try {
+                local::GradientCalculatorPtr gc;
+                if(batch.gradients) gc = (*batch.gradients)[index];
+                batch.results[index] = findBatchMinimum((*batch.functions)[index],gc,
+                    *batch.parameters,batch.methodName,batch.precision,batch.maxIterations,index);
+            }
+            catch(std::exception const &e) {
+                boost::mutex::scoped_lock lock(batch.mutex);
+                if(0 == batch.error.length()) {
+                    batch.error = "fit " + boost::lexical_cast<std::string>(index) +
+                        " failed: " + e.what();
+                }
+                batch.stop = true;
+            }
+            batch.fitTime[index] =
+                (pt::microsec_clock::universal_time() - start).total_microseconds()*1e-6;
+        }
+    }
+}
+
+std::vector<local::FunctionMinimumPtr> local::findMinima(
+std::vector<FunctionPtr> const &functions, std::vector<GradientCalculatorPtr> const &gradients,
+FitParameters const &parameters, std::string const &methodName, double precision,
+long maxIterations, int nThreads, FitBatchStatistics *stats) {
+    namespace pt = boost::posix_time;
+    pt::ptime start(pt::microsec_clock::universal_time());
+    int nFits(functions.size());
+    if(gradients.size() > 0 && gradients.size() != nFits) {
+        throw RuntimeError("findMinima: expected one gradient calculator per function.");
+    }
+    if(nThreads < 0) {
+        throw RuntimeError("findMinima: expected nThreads >= 0.");
+    }
+    if(0 == nThreads) nThreads = boost::thread::hardware_concurrency();
+    if(nThreads > nFits) nThreads = nFits;
+    if(nThreads < 1) nThreads = 1;
+    // Divide the fits into contiguous blocks, one per worker.
+    FitBatch batch;
+    batch.functions = &functions;
+    batch.gradients = gradients.size() > 0 ? &gradients : 0;
+    batch.parameters = &parameters;
+    batch.methodName = methodName;
+    batch.precision = precision;
+    batch.maxIterations = maxIterations;
+    batch.stop = false;
+    batch.results.resize(nFits);
+    batch.fitTime.resize(nFits,0);
+    for(int worker = 0; worker < nThreads; ++worker) {
+        batch.blocks.push_back(std::make_pair((worker*nFits)/nThreads,((worker+1)*nFits)/nThreads));
+    }
+    // Run the fits, using the calling thread as the first worker.
+    boost::thread_group workers;
+    for(int worker = 1; worker < nThreads; ++worker) {
+        workers.create_thread(boost::bind(runFits,boost::ref(batch),worker));
+    }
+    runFits(batch,0);
+    workers.join_all();
+    if(batch.error.length() > 0) {
+        throw RuntimeError("findMinima: " + batch.error);
+    }
+    if(stats) {
+        stats->evalCount = stats->gradCount = 0;
+        for(int index = 0; index < nFits; ++index) {
+            stats->evalCount += batch.results[index]->getNEvalCount();
+            stats->gradCount += batch.results[index]->getNGradCount();
+        }
+        stats->fitTime = batch.fitTime;
+        stats->batchTime = (pt::microsec_clock::universal_time() - start).total_microseconds()*1e-6;
+    }
+    return batch.results;
+}
+
+std::vector<local::FunctionMinimumPtr> local::findMinima(
+std::vector<FunctionPtr> const &functions, FitParameters const &parameters,
+std::string const &methodName, double precision, long maxIterations, int nThreads,
+FitBatchStatistics *stats) {
+    // Use null gradient calculators.
+    std::vector<GradientCalculatorPtr> gradients;
+    return findMinima(functions,gradients,parameters,methodName,precision,maxIterations,
+        nThreads,stats);
+}
+
+namespace {
+    // Shares the state of a scanFitParametersGrid scan between its worker threads.
+    struct GridScan {
+        local::FunctionPtr f;
+        local::GradientCalculatorPtr gc;
+        local::FitParameters const *parameters;
+        local::BinnedGrid const *grid;
+        // The index of each binned parameter, in grid axis order.
+        std::vector<int> binnedIndex;
+        std::string methodName;
+        double precision;
+        long maxIterations;
+        // The grid points that are ready to fit and the number of fits not yet finished,
+        // protected by mutex.
+        boost::mutex mutex;
+        boost::condition_variable ready;
+        std::deque<int> queue;
+        std::vector<bool> queued;
+        int nPending;
+        bool stop;
+        std::string error;
+        // Results are written under the mutex since they are read to warm start neighbors.
+        std::vector<local::FunctionMinimumPtr> results;
+        std::vector<double> fitTime;
+    }; // GridScan
+
+    // Fits grid points until none remain or a fit fails.
+    void scanGrid(GridScan &scan) {
+        namespace pt = boost::posix_time;
+        std::vector<int> neighbors;
+        std::vector<double> centers;
+        boost::mutex::scoped_lock lock(scan.mutex);
+        while(true) {
+            while(!scan.stop && scan.queue.empty() && scan.nPending > 0) scan.ready.wait(lock);
+            if(scan.stop || scan.queue.empty()) return;
+            int index(scan.queue.front());
+            scan.queue.pop_front();
+            // Warm start from the converged neighbor with the smallest minimum, if any.
+            scan.grid->getBinNeighbors(index,neighbors);
+            local::FunctionMinimumPtr best;
+            for(int k = 0; k < neighbors.size(); ++k) {
+                local::FunctionMinimumPtr other(scan.results[neighbors[k]]);
+                if(other && (!best || other->getMinValue() < best->getMinValue())) best = other;
+            }
+            local::FitParameters parameters(*scan.parameters);
+            if(best) local::setFitParameterValues(parameters,best->getParameters());
+            lock.unlock();
+            // Fix the binned parameters at the center of this grid point.
+            scan.grid->getBinCenters(index,centers);
+            for(int axis = 0; axis < centers.size(); ++axis) {
+                local::FitParameter &binned(parameters[scan.binnedIndex[axis]]);
+                binned.setValue(centers[axis]);
+                binned.fix();
+            }
+            pt::ptime start(pt::microsec_clock::universal_time());
+            local::FunctionMinimumPtr fmin;
+            std::string message;
+            try {
+                fmin = findBatchMinimum(scan.f,scan.gc,parameters,scan.methodName,
+                    scan.precision,scan.maxIterations,index);
+            }
+            catch(std::exception const &e) {
+                message = e.what();
+            }
+            double elapsed((pt::microsec_clock::universal_time() - start).total_microseconds()*1e-6);
+            lock.lock();
+            scan.fitTime[index] = elapsed;
+            scan.nPending--;
+            if(message.length() > 0) {
+                if(0 == scan.error.length()) {
+                    scan.error = "fit at grid index " + boost::lexical_cast<std::string>(index) +
+                        " failed: " + message;
+                }
+                scan.stop = true;
+                scan.ready.notify_all();
+                return;
+            }
+            scan.results[index] = fmin;
+            // Queue any neighbors that have not been queued yet.
+            for(int k = 0; k < neighbors.size(); ++k) {
+                int neighbor(neighbors[k]);
+                if(scan.queued[neighbor]) continue;
+                scan.queued[neighbor] = true;
+                scan.queue.push_back(neighbor);
+                scan.nPending++;
+            }
+            scan.ready.notify_all();
+        }
+    }
+}
+
+local::BinnedDataPtr local::scanFitParametersGrid(FunctionPtr f, GradientCalculatorPtr gc,
+FitParameters const &parameters, std::string const &methodName, double precision,
+long maxIterations, int nThreads, std::vector<FunctionMinimumPtr> *minima,
+FitBatchStatistics *stats) {
+    namespace pt = boost::posix_time;
+    pt::ptime start(pt::microsec_clock::universal_time());
+    GridScan scan;
+    std::vector<double> initial;
+    for(int index = 0; index < parameters.size(); ++index) {
+        if(!parameters[index].getBinning()) continue;
+        scan.binnedIndex.push_back(index);
+        initial.push_back(parameters[index].getValue());
+    }
+    if(0 == scan.binnedIndex.size()) {
+        throw RuntimeError("scanFitParametersGrid: no parameters have a binning.");
+    }
+    if(nThreads < 0) {
+        throw RuntimeError("scanFitParametersGrid: expected nThreads >= 0.");
+    }
+    BinnedGrid grid(getFitParametersGrid(parameters));
+    int nPoints(grid.getNBinsTotal());
+    if(0 == nThreads) nThreads = boost::thread::hardware_concurrency();
+    if(nThreads > nPoints) nThreads = nPoints;
+    if(nThreads < 1) nThreads = 1;
+    // Seed the scan with the grid point containing the initial parameter values, if possible.
+    int seed(0);
+    try {
+        seed = grid.getIndex(initial);
+    }
+    catch(RuntimeError const &e) { }
+    scan.f = f;
+    scan.gc = gc;
+    scan.parameters = &parameters;
+    scan.grid = &grid;
+    scan.methodName = methodName;
+    scan.precision = precision;
+    scan.maxIterations = maxIterations;
+    scan.queued.resize(nPoints,false);
+    scan.queued[seed] = true;
+    scan.queue.push_back(seed);
+    scan.nPending = 1;
+    scan.stop = false;
+    scan.results.resize(nPoints);
+    scan.fitTime.resize(nPoints,0);
+    // Run the scan, using the calling thread as one of the workers.
+    boost::thread_group workers;
+    for(int worker = 1; worker < nThreads; ++worker) {
+        workers.create_thread(boost::bind(scanGrid,boost::ref(scan)));
+    }
+    scanGrid(scan);
+    workers.join_all();
+    if(scan.error.length() > 0) {
+        throw RuntimeError("scanFitParametersGrid: " + scan.error);
+    }
+    // Save the profile.
+    BinnedDataPtr profile(new BinnedData(grid));
+    for(int index = 0; index < nPoints; ++index) {
+        profile->setData(index,scan.results[index]->getMinValue());
+    }
+    if(minima) *minima = scan.results;
+    if(stats) {
+        stats->evalCount = stats->gradCount = 0;
+        for(int index = 0; index < nPoints; ++index) {
+            stats->evalCount += scan.results[index]->getNEvalCount();
+            stats->gradCount += scan.results[index]->getNGradCount();
+        }
+        stats->fitTime = scan.fitTime;
+        stats->batchTime = (pt::microsec_clock::universal_time() - start).total_microseconds()*1e-6;
+    }
+    return profile;
+}
+
+local::BinnedDataPtr local::scanFitParametersGrid(FunctionPtr f,
+FitParameters const &parameters, std::string const &methodName, double precision,
+long maxIterations, int nThreads, std::vector<FunctionMinimumPtr> *minima,
+FitBatchStatistics *stats) {
+    // Use a null gradient calculator.
+    GradientCalculatorPtr gc;
+    return scanFitParametersGrid(f,gc,parameters,methodName,precision,maxIterations,
+        nThreads,minima,stats);
+}
@@ -10,6 +10,7 @@
 #include "boost/function.hpp"
 
 #include <string>
+#include <vector>
 
 namespace likely {
     class FunctionMinimum;
@@ -22,16 +23,18 @@ namespace likely {
         // Returns the number of gradient evaluations by this engine.
         long getGradCount() const;
         
-        // The findMinimum functions can access our internals.
-        friend FunctionMinimumPtr findMinimum(FunctionPtr,
-    	    FitParameters const &, std::string const &, double, long);
-        friend FunctionMinimumPtr findMinimum(FunctionPtr, GradientCalculatorPtr,
-    	    FitParameters const &, std::string const &, double, long);
+        // Runs our minimum finder starting from the initial parameters provided and returns
+        // the result. The function, gradient calculator and parameters must be the ones this
+        // engine was created with. This is the entry point used by the findMinimum functions.
+        FunctionMinimumPtr runMinimumFinder(FunctionPtr f, GradientCalculatorPtr gc,
+            FitParameters const &parameters, double precision, long maxIterations);
 
     protected:
-        // Subclass API for managing evaluation counts.
-        void incrementEvalCount() const;
-        void incrementGradCount() const;
+        // Subclass API for managing evaluation counts. These methods are not thread safe, so
+        // subclasses that evaluate in parallel should count evaluations separately in each
+        // thread and record the totals here after the threads have finished.
+        void incrementEvalCount(long count = 1) const;
+        void incrementGradCount(long count = 1) const;
 
 		// Declares our dynamic entry point for findMinimum.
 		typedef boost::function<void (FunctionMinimumPtr, double, long)> MinimumFinder;
@@ -44,8 +47,8 @@ namespace likely {
 	
     inline long AbsEngine::getEvalCount() const { return _evalCount; }
     inline long AbsEngine::getGradCount() const { return _gradCount; }
-    inline void AbsEngine::incrementEvalCount() const { _evalCount++; }
-    inline void AbsEngine::incrementGradCount() const { _gradCount++; }
+    inline void AbsEngine::incrementEvalCount(long count) const { _evalCount += count; }
+    inline void AbsEngine::incrementGradCount(long count) const { _gradCount += count; }
 	
     // Finds a minimum of the specified function starting from the initial parameters
     // provided, with steps sizes scaled to the error estimates provided. Returns
@@ -62,7 +65,61 @@ namespace likely {
 	FunctionMinimumPtr findMinimum(FunctionPtr f, GradientCalculatorPtr gc,
 	    FitParameters const &parameters, std::string const &methodName,
         double precision = 1e-3, long maxIterations = 0);
-        
+
+    // Summarizes a batch of fits performed by findMinima.
+    struct FitBatchStatistics {
+        // Total number of function and gradient evaluations used by all fits.
+        long evalCount, gradCount;
+        // Elapsed wall-clock time in seconds of each fit, in input order, and of the whole batch.
+        std::vector<double> fitTime;
+        double batchTime;
+    };
+
+    // Finds the minimum of each function in a batch, starting from the same initial parameters,
+    // and returns the results in input order. Fits are scheduled on nThreads worker threads
+    // (or the number of available cores if nThreads is zero) using work stealing, so that fits
+    // of uneven duration are load balanced: each thread starts with a contiguous block of fits
+    // and, when its block is finished, steals half of the largest remaining block. The functions
+    // (and gradient calculators, if any) must be safe to call concurrently with each other, and
+    // the selected engine must be re-entrant. Markov chain (mc::) fits do not share the default
+    // Random generator: fit i uses the substream Random::instance()->createStream(i) instead.
+    // Throws a RuntimeError (after any running fits have finished) if any fit fails. Use the
+    // optional stats pointer to obtain aggregate statistics.
+	std::vector<FunctionMinimumPtr> findMinima(std::vector<FunctionPtr> const &functions,
+	    FitParameters const &parameters, std::string const &methodName,
+        double precision = 1e-3, long maxIterations = 0, int nThreads = 0,
+        FitBatchStatistics *stats = 0);
+    // Same as above, but using a gradient calculator for each function.
+	std::vector<FunctionMinimumPtr> findMinima(std::vector<FunctionPtr> const &functions,
+	    std::vector<GradientCalculatorPtr> const &gradients,
+	    FitParameters const &parameters, std::string const &methodName,
+        double precision = 1e-3, long maxIterations = 0, int nThreads = 0,
+        FitBatchStatistics *stats = 0);
+
+    // Calculates the profile of the specified function's minimum over the grid defined by
+    // the parameter binning specifications (see getFitParametersGrid). At each grid point,
+    // the binned parameters are fixed at their bin centers and all other floating parameters
+    // are minimized using the specified method. Returns a BinnedData on this grid whose data
+    // values are the minimum function values. Grid points are fitted concurrently on nThreads
+    // worker threads (or the number of available cores if nThreads is zero), starting from the
+    // grid point that contains the initial parameter values (or else the first grid point) and
+    // spreading out to neighboring grid points as fits converge. Each fit is warm started from
+    // the best converged fit of its neighbors, so the results can depend slightly on the order
+    // in which fits finish. The same requirements as for findMinima apply to the function,
+    // gradient calculator and engine, and mc:: fits use the substream of their global grid
+    // index. Throws a RuntimeError if no parameter has a binning or if any fit fails. Use the
+    // optional minima pointer to obtain the FunctionMinimum found at each point (in global grid
+    // index order), and the optional stats pointer to obtain aggregate statistics.
+    BinnedDataPtr scanFitParametersGrid(FunctionPtr f, FitParameters const &parameters,
+        std::string const &methodName, double precision = 1e-3, long maxIterations = 0,
+        int nThreads = 0, std::vector<FunctionMinimumPtr> *minima = 0,
+        FitBatchStatistics *stats = 0);
+    // Same as above, but using a gradient calculator.
+    BinnedDataPtr scanFitParametersGrid(FunctionPtr f, GradientCalculatorPtr gc,
+        FitParameters const &parameters, std::string const &methodName,
+        double precision = 1e-3, long maxIterations = 0, int nThreads = 0,
+        std::vector<FunctionMinimumPtr> *minima = 0, FitBatchStatistics *stats = 0);
+
 } // likely
 
 #endif // LIKELY_ABS_ENGINE
@@ -0,0 +1,66 @@
+// Helpers for the native-endian binary formats of BinnedData and CovarianceMatrix.
+// This header is private to the library and is not installed.
+
+#ifndef LIKELY_BINARY_IO
+#define LIKELY_BINARY_IO
+
+#include "likely/RuntimeError.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace likely {
+namespace binary {
+    // Every array is padded to a multiple of 8 bytes, so that 8-byte values stay aligned.
+    // Writes zero bytes to pad an array of nbytes to a multiple of 8 bytes.
+    inline void writePadding(std::ostream &os, std::size_t nbytes) {
+        static const char zeros[8] = { 0,0,0,0,0,0,0,0 };
+        if(nbytes % 8) os.write(zeros,8 - nbytes % 8);
+    }
+    // Writes an array of n elements of type T followed by any padding.
+    template <class T> void writeArray(std::ostream &os, T const *array, long n) {
+        std::size_t nbytes(n*sizeof(T));
+        if(n > 0) os.write(reinterpret_cast<char const*>(array),nbytes);
+        writePadding(os,nbytes);
+    }
+    // Throws a RuntimeError, prefixed by context, unless a seekable input has at least
+    // nbytes remaining. This lets readers reject a corrupt array size before allocating.
+    inline void checkAvailable(std::istream &is, long nbytes, std::string const &context) {
+        if(nbytes < 0) throw RuntimeError(context + ": input is invalid.");
+        std::streampos here(is.tellg());
+        if(here < 0) return;
+        is.seekg(0,std::ios::end);
+        std::streamoff remaining(is.tellg() - here);
+        is.seekg(here);
+        if(remaining < nbytes) throw RuntimeError(context + ": input is truncated.");
+    }
+    // Skips over the padding that follows an array of nbytes.
+    inline void skipPadding(std::istream &is, std::size_t nbytes, std::string const &context) {
+        if(nbytes % 8) is.ignore(8 - nbytes % 8);
+        if(!is) throw RuntimeError(context + ": input is truncated.");
+    }
+    // Reads an array of n elements of type T, and the padding that follows it, directly into
+    // the memory at array. Throws a RuntimeError, prefixed by context, if the input ends early.
+    template <class T> void readArray(std::istream &is, T *array, long n,
+    std::string const &context) {
+        std::size_t nbytes(n*sizeof(T));
+        if(n > 0 && !is.read(reinterpret_cast<char*>(array),nbytes)) {
+            throw RuntimeError(context + ": input is truncated.");
+        }
+        skipPadding(is,nbytes,context);
+    }
+    // Same as above, but resizes the vector provided to n elements and reads into it, after
+    // checking that the input is long enough.
+    template <class T> void readArray(std::istream &is, std::vector<T> &array, long n,
+    std::string const &context) {
+        checkAvailable(is,n*(long)sizeof(T),context);
+        array.resize(n);
+        if(n > 0) readArray(is,&array[0],n,context);
+    }
+} // binary
+} // likely
+
+#endif // LIKELY_BINARY_IO
@@ -4,20 +4,42 @@
 #include "likely/RuntimeError.h"
 #include "likely/AbsBinning.h"
 #include "likely/CovarianceMatrix.h"
+#include "likely/BinaryIO.h"
 
 #include "boost/foreach.hpp"
 #include "boost/format.hpp"
 #include "boost/lexical_cast.hpp"
+#include "boost/cstdint.hpp"
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
 
 namespace local = likely;
 
+namespace {
+    // Returns a modifiable reference to the object managed by ptr, after first replacing it
+    // with a private copy if it is shared with any other dataset.
+    template <class T> T &unshare(boost::shared_ptr<T> &ptr) {
+        if(!ptr.unique()) ptr.reset(new T(*ptr));
+        return *ptr;
+    }
+}
+
+local::BinnedData::IndexTable::IndexTable(int size)
+: offset(size)
+{ }
+
+local::BinnedData::CustomTable::CustomTable(int size)
+: IndexTable(size)
+{ }
+
 local::BinnedData::BinnedData(BinnedGrid const &grid)
-: _grid(grid)
+: _grid(grid), _bins(new IndexTable(grid.getNBinsTotal())),
+_custom(new CustomTable(grid.getNBinsTotal())), _data(new std::vector<double>()),
+_dataCache(new std::vector<double>())
 {
-    _offset.resize(_grid.getNBinsTotal(),EMPTY_BIN);
-    _customOffset.resize(_grid.getNBinsTotal(),EMPTY_BIN);
     _weight = 1;
     _weighted = false;
     _customGrid = false;
@@ -54,30 +76,7 @@ local::BinnedData& local::BinnedData::add(BinnedData const& other, double weight
         if(!isCongruent(other,true)) {
             throw RuntimeError("BinnedData::add: datasets have different binning.");
         }
-        // Initialize each occupied bin of the other dataset to zero contents in our dataset.
-        for(IndexIterator iter = other.begin(); iter != other.end(); ++iter) {
-            setData(*iter,0);
-        }
-        // If the other dataset has a covariance matrix, initialize ours now.
-        if(other.hasCovariance()) {
-            _covariance.reset(new CovarianceMatrix(getNBinsWithData()));
-        }
-        else {
-            // The scalar _weight plays the role of Cinv in the absence of any _covariance.
-            // Set it to zero here since we will be adding the other data's weight below.
-            _weight = 0;
-        }
-        // Our zero data vector should be interpreted as Cinv.data for the
-        // purposes of adding to the other dataset, below. We don't call _setWeighted here
-        // because we don't actually want to transform the existing _data.
-        _weighted = true;
-        // If a custom grid is used, set the custom bin centers based on the other dataset.
-        if(other.useCustomGrid()) {
-            for(IndexIterator iter = other.beginCustom(); iter != other.endCustom(); ++iter) {
-                setCustomBinCenters(*iter,other._customBin1[other._customOffset[*iter]],
-                    other._customBin2[other._customOffset[*iter]],other._customBin3[other._customOffset[*iter]],true);
-            }
-        }
+        _initializeFrom(other);
     }
     else {
         // We already have data, so we will try to add the other data to ours.
@@ -92,8 +91,10 @@ local::BinnedData& local::BinnedData::add(BinnedData const& other, double weight
     // Add the weighted _data vectors, element by element, and save the result in our _data.
     _setWeighted(true,true); // flushes any cached data
     other._setWeighted(true);
-    for(int offset = 0; offset < _data.size(); ++offset) {
-        _data[offset] += weight*other._data[offset];
+    std::vector<double> &data(unshare(_data));
+    std::vector<double> const &otherData(*other._data);
+    for(int offset = 0; offset < data.size(); ++offset) {
+        data[offset] += weight*otherData[offset];
     }
     if(hasCovariance()) {
         // Add Cinv matrices and save the result as our new Cinv matrix.
@@ -105,6 +106,102 @@ local::BinnedData& local::BinnedData::add(BinnedData const& other, double weight
     return *this;
 }
 
+local::BinnedData& local::BinnedData::combine(std::vector<BinnedDataCPtr> const &datasets,
+std::vector<double> const &weights, int nThreads) {
+    if(weights.size() > 0 && weights.size() != datasets.size()) {
+        throw RuntimeError("BinnedData::combine: wrong number of weights.");
+    }
+    // Collect the datasets with non-zero weights.
+    std::vector<BinnedData const*> others;
+    std::vector<double> otherWeights;
+    for(int k = 0; k < datasets.size(); ++k) {
+        double weight(weights.size() > 0 ? weights[k] : 1);
+        if(0 == weight) continue;
+        if(!datasets[k]) {
+            throw RuntimeError("BinnedData::combine: missing dataset.");
+        }
+        others.push_back(datasets[k].get());
+        otherWeights.push_back(weight);
+    }
+    if(0 == others.size()) return *this;
+    // Do we have any data yet?
+    bool empty(0 == getNBinsWithData());
+    if(empty) {
+        // If we are empty, then we only require that the first dataset have the same binning.
+        if(!isCongruent(*others[0],true)) {
+            throw RuntimeError("BinnedData::combine: datasets have different binning.");
+        }
+    }
+    else if(hasCovariance() && !isCovarianceModifiable()) {
+        throw RuntimeError("BinnedData::combine: cannot modify shared covariance.");
+    }
+    // Check the congruence of all datasets before we change anything. If we are empty, we
+    // will be initialized from the first dataset, so the others must be congruent with it.
+    BinnedData const &reference(empty ? *others[0] : *this);
+    for(int k = 0; k < others.size(); ++k) {
+        if(!reference.isCongruent(*others[k])) {
+            throw RuntimeError("BinnedData::combine: datasets are not congruent.");
+        }
+    }
+    if(empty) _initializeFrom(*others[0]);
+    // Add the weighted _data vectors, element by element, and save the result in our _data.
+    _setWeighted(true,true); // flushes any cached data
+    std::vector<double> &data(unshare(_data));
+    int nbins(data.size());
+    for(int k = 0; k < others.size(); ++k) {
+        others[k]->_setWeighted(true);
+        double weight(otherWeights[k]);
+        double const *otherData(&(*others[k]->_data)[0]);
+        for(int offset = 0; offset < nbins; ++offset) data[offset] += weight*otherData[offset];
+    }
+    if(hasCovariance()) {
+        // Add all Cinv matrices in a single pass and save the result as our new Cinv matrix.
+        std::vector<CovarianceMatrixCPtr> matrices;
+        matrices.reserve(others.size());
+        for(int k = 0; k < others.size(); ++k) matrices.push_back(others[k]->_covariance);
+        _covariance->addInverse(matrices,otherWeights,nThreads);
+    }
+    else {
+        for(int k = 0; k < others.size(); ++k) _weight += others[k]->_weight*otherWeights[k];
+    }
+    return *this;
+}
+
+void local::BinnedData::_initializeFrom(BinnedData const &other) {
+    // Initialize each occupied bin of the other dataset to zero contents in our dataset,
+    // sharing the other dataset's index table since we are empty.
+    _bins = other._bins;
+    _data.reset(new std::vector<double>(other.getNBinsWithData(),0));
+    _dataCache.reset(new std::vector<double>());
+    // If the other dataset has a covariance matrix, initialize ours now.
+    if(other.hasCovariance()) {
+        _covariance.reset(new CovarianceMatrix(getNBinsWithData()));
+    }
+    else {
+        // The scalar _weight plays the role of Cinv in the absence of any _covariance.
+        // Set it to zero here since we will be adding the other data's weight below.
+        _weight = 0;
+    }
+    // Our zero data vector should be interpreted as Cinv.data for the
+    // purposes of adding to the other dataset, below. We don't call _setWeighted here
+    // because we don't actually want to transform the existing _data.
+    _weighted = true;
+    // If a custom grid is used, set the custom bin centers based on the other dataset.
+    if(other.useCustomGrid()) {
+        if(0 == getNCustomBins()) {
+            _custom = other._custom;
+            _customGrid = true;
+        }
+        else {
+            CustomTable const &custom(*other._custom);
+            for(IndexIterator iter = other.beginCustom(); iter != other.endCustom(); ++iter) {
+                int offset(custom.offset.get(*iter));
+                setCustomBinCenters(*iter,custom.bin1[offset],custom.bin2[offset],custom.bin3[offset],true);
+            }
+        }
+    }
+}
+
 void local::BinnedData::unweightData() {
     // Note that both the methods below are const but we still declare this public method
     // as non-const since there is never any need to call it unless it will be followed
@@ -116,7 +213,7 @@ void local::BinnedData::_setWeighted(bool weighted, bool flushCache) const {
     // Are we already in the desired state?
     if(weighted != _weighted) {
         // Do we have a cached result we can use?
-        if(_dataCache.size() > 0) {
+        if(_dataCache->size() > 0) {
             // Enable argument-dependent lookup (ADL)
             using std::swap;
             swap(_data,_dataCache);
@@ -124,41 +221,44 @@ void local::BinnedData::_setWeighted(bool weighted, bool flushCache) const {
         else {
 #ifdef PARANOID_DATA_CACHE
             // Save the original state of our cache.
-            std::vector<double> saveCache = _dataCache;
+            std::vector<double> saveCache = *_dataCache;
 #endif
-            // Copy the original data to our cache (unless we are going to flush it below)
+            // Share the original data with our cache (unless we are going to flush it below)
+            // so that it is copied, rather than overwritten, by the transformation below.
             if(!flushCache) _dataCache = _data;
         
             // Do the appropriate transformation of our data vector.
             if(weighted) {
                 if(hasCovariance() && getNBinsWithData() > 0) {
                     // Change data to Cinv.data
-                    _covariance->multiplyByInverseCovariance(_data);
+                    _covariance->multiplyByInverseCovariance(unshare(_data));
                 }
                 else if(_weight != 1) {
                     // Scale data by _weight, which plays the role of Cinv.
-                    for(int offset = 0; offset < _data.size(); ++offset) _data[offset] *= _weight;
+                    std::vector<double> &data(unshare(_data));
+                    for(int offset = 0; offset < data.size(); ++offset) data[offset] *= _weight;
                 }
             }
             else {
                 if(hasCovariance() && getNBinsWithData() > 0) {
                     // Change Cinv.data to data = C.Cinv.data
-                    _covariance->multiplyByCovariance(_data);
+                    _covariance->multiplyByCovariance(unshare(_data));
                 }
                 else if(_weight != 1) {
                     // Scale data by 1/_weight, which plays the role of C.
-                    for(int offset = 0; offset < _data.size(); ++offset) _data[offset] /= _weight;
+                    std::vector<double> &data(unshare(_data));
+                    for(int offset = 0; offset < data.size(); ++offset) data[offset] /= _weight;
                 }
             }
 #ifdef PARANOID_DATA_CACHE
             // If we have a saved cache, was it actually valid?
             if(saveCache.size() > 0) {
-                assert(saveCache.size() == _data.size());
-                for(int offset = 0; offset < _data.size(); ++offset) {
-                    double eps = std::fabs(_data[offset] - saveCache[offset]);
+                assert(saveCache.size() == _data->size());
+                for(int offset = 0; offset < _data->size(); ++offset) {
+                    double eps = std::fabs((*_data)[offset] - saveCache[offset]);
                     if(eps > 1e-8) {
                         std::cerr << "Invalid BinnedData cache: " << offset << ' '
-                            << _data[offset] << " != " << saveCache[offset] << " (eps = "
+                            << (*_data)[offset] << " != " << saveCache[offset] << " (eps = "
                             << eps << ")" << std::endl;
                         assert(false);
                         break;
@@ -172,8 +272,12 @@ void local::BinnedData::_setWeighted(bool weighted, bool flushCache) const {
     }
     // Flush the cache now, if requested. We use resize instead of swapping with an empty vector
     // since we are likely to need at least as much capacity in future, and the overhead of
-    // this cache is small compared with a covariance matrix.
-    if(flushCache) _dataCache.resize(0);
+    // this cache is small compared with a covariance matrix. A cache that is shared with
+    // another dataset is released instead.
+    if(flushCache) {
+        if(_dataCache.unique()) _dataCache->resize(0);
+        else _dataCache.reset(new std::vector<double>());
+    }
 }
 
 bool local::BinnedData::isCongruent(BinnedData const& other, bool onlyBinning, bool ignoreCovariance) const {
@@ -181,8 +285,12 @@ bool local::BinnedData::isCongruent(BinnedData const& other, bool onlyBinning, b
     if(!onlyBinning) {
         // [2] List (not set, i.e., order matters) of bins with data must be the same.
         if(other.getNBinsWithData() != getNBinsWithData()) return false;
-        for(int offset = 0; offset < _index.size(); ++offset) {
-            if(other._index[offset] != _index[offset]) return false;
+        // Datasets that share an index table are always congruent.
+        if(other._bins != _bins) {
+            std::vector<int> const &index(_bins->index), &otherIndex(other._bins->index);
+            for(int offset = 0; offset < index.size(); ++offset) {
+                if(otherIndex[offset] != index[offset]) return false;
+            }
         }
         if(!ignoreCovariance) {
             // [3] Both must have or not have an associated covariance matrix.
@@ -194,22 +302,22 @@ bool local::BinnedData::isCongruent(BinnedData const& other, bool onlyBinning, b
 }
 
 int local::BinnedData::getIndexAtOffset(int offset) const {
-    if(offset < 0 || offset >= _index.size()) {
+    if(offset < 0 || offset >= getNBinsWithData()) {
         throw RuntimeError("BinnedData::getIndexAtOffset: invalid offset.");
     }
-    return _index[offset];
+    return _bins->index[offset];
 }
 
 int local::BinnedData::getOffsetForIndex(int index) const {
     if(!hasData(index)) {
         throw RuntimeError("BinnedData::getOffsetForIndex: no data at index.");
     }
-    return _offset[index];
+    return _bins->offset.get(index);
 }
 
 bool local::BinnedData::hasData(int index) const {
     _grid.checkIndex(index);
-    return !(_offset[index] == EMPTY_BIN);
+    return !(_bins->offset.get(index) == EMPTY_BIN);
 }
 
 double local::BinnedData::getData(int index, bool weighted) const {
@@ -217,13 +325,13 @@ double local::BinnedData::getData(int index, bool weighted) const {
         throw RuntimeError("BinnedData::getData: bin is empty.");
     }
     _setWeighted(weighted);
-    return _data[_offset[index]];
+    return (*_data)[_bins->offset.get(index)];
 }
 
 void local::BinnedData::setData(int index, double value, bool weighted) {
     _setWeighted(weighted,true); // flushes any cached data
     if(hasData(index)) {
-        _data[_offset[index]] = value;
+        unshare(_data)[_bins->offset.get(index)] = value;
     }
     else {
         if(hasCovariance()) {
@@ -232,9 +340,10 @@ void local::BinnedData::setData(int index, double value, bool weighted) {
         if(isFinalized()) {
             throw RuntimeError("BinnedData::setData: object is finalized.");
         }
-        _offset[index] = _index.size();
-        _index.push_back(index);
-        _data.push_back(value);
+        IndexTable &bins(unshare(_bins));
+        bins.offset.set(index,bins.index.size());
+        bins.index.push_back(index);
+        unshare(_data).push_back(value);
     }
 }
 
@@ -243,27 +352,30 @@ void local::BinnedData::addData(int index, double offset, bool weighted) {
         throw RuntimeError("BinnedData::addData: bin is empty.");        
     }
     _setWeighted(weighted,true); // flushes any cached data
-    _data[_offset[index]] += offset;
+    unshare(_data)[_bins->offset.get(index)] += offset;
 }
 
 bool local::BinnedData::hasCustomBinCenters(int index) const {
     _grid.checkIndex(index);
-    return !(_customOffset[index] == EMPTY_BIN);
+    return !(_custom->offset.get(index) == EMPTY_BIN);
 }
 
 void local::BinnedData::setCustomBinCenters(int index, double bin1, double bin2, double bin3, bool customGrid) {
     _customGrid = customGrid;
-    if(hasCustomBinCenters(index)) {
-        _customBin1[_customOffset[index]] = bin1;
-        _customBin2[_customOffset[index]] = bin2;
-        _customBin3[_customOffset[index]] = bin3;
+    bool exists(hasCustomBinCenters(index));
+    CustomTable &custom(unshare(_custom));
+    if(exists) {
+        int offset(custom.offset.get(index));
+        custom.bin1[offset] = bin1;
+        custom.bin2[offset] = bin2;
+        custom.bin3[offset] = bin3;
     }
     else {
-        _customOffset[index] = _customIndex.size();
-        _customIndex.push_back(index);
-        _customBin1.push_back(bin1);
-        _customBin2.push_back(bin2);
-        _customBin3.push_back(bin3);
+        custom.offset.set(index,custom.index.size());
+        custom.index.push_back(index);
+        custom.bin1.push_back(bin1);
+        custom.bin2.push_back(bin2);
+        custom.bin3.push_back(bin3);
     }
 }
 
@@ -273,9 +385,10 @@ void local::BinnedData::getCustomBinCenters(int index, std::vector<double> &binC
     }
     binCenters.resize(0);
     binCenters.reserve(3);
-    binCenters.push_back(_customBin1[_customOffset[index]]);
-    binCenters.push_back(_customBin2[_customOffset[index]]);
-    binCenters.push_back(_customBin3[_customOffset[index]]);
+    int offset(_custom->offset.get(index));
+    binCenters.push_back(_custom->bin1[offset]);
+    binCenters.push_back(_custom->bin2[offset]);
+    binCenters.push_back(_custom->bin3[offset]);
 }
 
 void local::BinnedData::getCustomBinWidths(int index, std::vector<double> &binWidths) const {
@@ -296,7 +409,7 @@ double local::BinnedData::getCovariance(int index1, int index2) const {
     if(!hasData(index1) || !hasData(index2)) {
         throw RuntimeError("BinnedData::getCovariance: bin is empty.");
     }
-    return _covariance->getCovariance(_offset[index1],_offset[index2]);
+    return _covariance->getCovariance(_bins->offset.get(index1),_bins->offset.get(index2));
 }
 
 double local::BinnedData::getInverseCovariance(int index1, int index2) const {
@@ -306,7 +419,7 @@ double local::BinnedData::getInverseCovariance(int index1, int index2) const {
     if(!hasData(index1) || !hasData(index2)) {
         throw RuntimeError("BinnedData::getInverseCovariance: bin is empty.");
     }
-    return _covariance->getInverseCovariance(_offset[index1],_offset[index2]);
+    return _covariance->getInverseCovariance(_bins->offset.get(index1),_bins->offset.get(index2));
 }
 
 void local::BinnedData::setCovariance(int index1, int index2, double value) {
@@ -325,7 +438,7 @@ void local::BinnedData::setCovariance(int index1, int index2, double value) {
     }
     // Note that we do not call _setWeighted here, so we are changing the meaning
     // of _data in a way that depends on the current value of _weighted.
-    _covariance->setCovariance(_offset[index1],_offset[index2],value);
+    _covariance->setCovariance(_bins->offset.get(index1),_bins->offset.get(index2),value);
 }
 
 void local::BinnedData::setInverseCovariance(int index1, int index2, double value) {
@@ -344,7 +457,7 @@ void local::BinnedData::setInverseCovariance(int index1, int index2, double valu
     }
     // Note that we do not call _setWeighted here, so we are changing the meaning
     // of _data in a way that depends on the current value of _weighted.
-    _covariance->setInverseCovariance(_offset[index1],_offset[index2],value);
+    _covariance->setInverseCovariance(_bins->offset.get(index1),_bins->offset.get(index2),value);
 }
 
 void local::BinnedData::transformCovariance(CovarianceMatrixPtr D) {
@@ -384,34 +497,35 @@ int local::BinnedData::projectOntoModes(int nkeep) {
     if(0 == nkeep || nkeep >= size || nkeep <= -size) {
         throw RuntimeError("BinnedData::projectOntoModes: invalid value of nkeep.");
     }
-    // Do the eigenmode analysis.
-    std::vector<double> eigenvalues,eigenvectors;
-    _covariance->getEigenModes(eigenvalues,eigenvectors);
     // What range of modes are we projecting onto?
-    int index1,index2,ndrop;
+    int first,nmodes,ndrop;
     if(nkeep > 0) {
-        index1 = 0;
-        index2 = nkeep;
+        first = 0;
+        nmodes = nkeep;
         ndrop = size - nkeep;
     }
     else {
-        index1 = size + nkeep;
-        index2 = size;
+        first = size + nkeep;
+        nmodes = -nkeep;
         ndrop = size + nkeep;
     }
+    // Do the eigenmode analysis for only the modes we keep.
+    std::vector<double> eigenvalues,eigenvectors;
+    _covariance->getEigenModes(first,nmodes,eigenvalues,eigenvectors);
     // Prepare to change our data vector.
     unweightData();
-    std::vector<double> projected(size,0);
+    std::vector<double> const &data(*_data);
+    DataVectorPtr projected(new std::vector<double>(size,0));
     // Loop over modes
-    for(int index = index1; index < index2; ++index) {
+    for(int index = 0; index < nmodes; ++index) {
         // Calculate the dot product of this mode with our data vector.
         double dotprod(0);
         for(int bin = 0; bin < size; ++bin) {
-            dotprod += _data[bin]*eigenvectors[index*size+bin];
+            dotprod += data[bin]*eigenvectors[index*size+bin];
         }
         // Update our projected vector.
         for(int bin = 0; bin < size; ++bin) {
-            projected[bin] += dotprod*eigenvectors[index*size+bin];
+            (*projected)[bin] += dotprod*eigenvectors[index*size+bin];
         }
     }
     _data = projected;
@@ -442,13 +556,13 @@ void local::BinnedData::shareCovarianceMatrix(BinnedData const &other) {
     _covariance = other._covariance;
 }
 
-bool local::BinnedData::compress(bool weighted) const {
+bool local::BinnedData::compress(bool weighted, double threshold, bool singlePrecision) const {
     // Get our data vector into the requested format (weighted/unweighted)
     _setWeighted(weighted);
     // Drop any storage used by our cache of the alternate format.
-    std::vector<double>().swap(_dataCache);
+    _dataCache.reset(new std::vector<double>());
     // Compress our covariance matrix, if any.
-    return _covariance.get() ? _covariance->compress() : false;
+    return _covariance.get() ? _covariance->compress(threshold,singlePrecision) : false;
 }
 
 void local::BinnedData::finalize() {
@@ -461,8 +575,9 @@ bool local::BinnedData::isCompressed() const {
 
 std::size_t local::BinnedData::getMemoryUsage(bool includeCovariance) const {
     std::size_t size = sizeof(*this) +
-        sizeof(int)*(_offset.capacity() + _index.capacity()) +
-        sizeof(double)*(_data.capacity() + _dataCache.capacity());
+        _bins->offset.getMemoryUsage() + _custom->offset.getMemoryUsage() +
+        sizeof(int)*(_bins->index.capacity() + _custom->index.capacity()) +
+        sizeof(double)*(_data->capacity() + _dataCache->capacity() + 3*_custom->bin1.capacity());
     if(hasCovariance() && includeCovariance) size += _covariance->getMemoryUsage();
     return size;
 }
@@ -476,29 +591,31 @@ void local::BinnedData::prune(std::set<int> const &keep) {
     std::set<int> offsets;
     BOOST_FOREACH(int index, keep) {
         _grid.checkIndex(index);
-        offsets.insert(_offset[index]);
+        offsets.insert(_bins->offset.get(index));
     }
     // Are we actually removing anything?
     int newSize(offsets.size());
     if(newSize == getNBinsWithData()) return;
-    // Reset our vector of offset for each index with data.
-    _offset.assign(_grid.getNBinsTotal(),EMPTY_BIN);
+    // Build a new index table, leaving the original intact for any datasets that share it.
+    boost::shared_ptr<IndexTable> bins(new IndexTable(_grid.getNBinsTotal()));
+    bins->index.reserve(newSize);
     // Shift our (unweighted) data vector elements down to compress out any elements
     // we are not keeping. We are using the fact that std::set guarantees that iteration
     // follows sort order, from smallest to largest key value.
     unweightData();
+    std::vector<double> &data(unshare(_data));
     int newOffset(0);
     BOOST_FOREACH(int oldOffset, offsets) {
         // oldOffset >= newOffset so we will never clobber an element that we still need
         assert(oldOffset >= newOffset);
-        int index = _index[oldOffset];
-        _offset[index] = newOffset;
-        _index[newOffset] = index;
-        _data[newOffset] = _data[oldOffset];
+        int index = _bins->index[oldOffset];
+        bins->offset.set(index,newOffset);
+        bins->index.push_back(index);
+        data[newOffset] = data[oldOffset];
         newOffset++;
     }
-    _index.resize(newSize);
-    _data.resize(newSize);
+    _bins = bins;
+    data.resize(newSize);
     // Prune our covariance matrix, if any.
     if(hasCovariance()) {
         if(!isCovarianceModifiable()) cloneCovariance();
@@ -510,18 +627,64 @@ double local::BinnedData::chiSquare(std::vector<double> pred) const {
     if(pred.size() != getNBinsWithData()) {
         throw RuntimeError("BinnedData::chiSquare: prediction vector has wrong size.");
     }
-    // Subtract our data vector from the prediction.
-    IndexIterator nextIndex(begin());
-    std::vector<double>::iterator nextPred(pred.begin());
+    return _chiSquare(pred);
+}
+
+double local::BinnedData::chiSquare(std::vector<double> const &pred,
+std::vector<double> &workspace) const {
+    if(pred.size() != getNBinsWithData()) {
+        throw RuntimeError("BinnedData::chiSquare: prediction vector has wrong size.");
+    }
+    // This does not allocate any memory if the workspace capacity is already sufficient.
+    workspace.assign(pred.begin(),pred.end());
+    return _chiSquare(workspace);
+}
+
+double local::BinnedData::_chiSquare(std::vector<double> &pred) const {
+    // Subtract our (unweighted) data vector from the prediction. Our _data vector uses
+    // the same index sequence as our index iterator, so we can read it directly by offset.
+    _setWeighted(false);
+    std::vector<double> const &data(*_data);
+    int nbins(pred.size());
     double residual, unweighted(0);
-    while(nextIndex != end()) {
-        residual = (*nextPred++ -= getData(*nextIndex++));
+    for(int offset = 0; offset < nbins; ++offset) {
+        residual = (pred[offset] -= data[offset]);
         unweighted += residual*residual;
     }
     // Our input vector now holds deltas. Our covariance does the rest of the work.
     return hasCovariance() ? _covariance->chiSquare(pred) : unweighted*_weight;
 }
 
+void local::BinnedData::chiSquareBatch(std::vector<double> &preds,
+std::vector<double> &chi2) const {
+    int nbins(getNBinsWithData());
+    if(0 == nbins || preds.size() % nbins != 0) {
+        throw RuntimeError("BinnedData::chiSquareBatch: predictions vector has wrong size.");
+    }
+    int npred(preds.size()/nbins);
+    // Subtract our (unweighted) data vector from each prediction. Our _data vector uses
+    // the same index sequence as our index iterator.
+    _setWeighted(false);
+    double const *data(&(*_data)[0]);
+    for(int k = 0; k < npred; ++k) {
+        double *pred(&preds[k*nbins]);
+        for(int offset = 0; offset < nbins; ++offset) pred[offset] -= data[offset];
+    }
+    // Our input vector now holds deltas. Our covariance does the rest of the work.
+    if(hasCovariance()) {
+        _covariance->chiSquareBatch(preds,chi2);
+    }
+    else {
+        chi2.assign(npred,0);
+        for(int k = 0; k < npred; ++k) {
+            double const *delta(&preds[k*nbins]);
+            double unweighted(0);
+            for(int offset = 0; offset < nbins; ++offset) unweighted += delta[offset]*delta[offset];
+            chi2[k] = unweighted*_weight;
+        }
+    }
+}
+
 void local::BinnedData::getDecorrelatedWeights(std::vector<double> const &pred,
 std::vector<double> &dweights) const {
     int nbins(getNBinsWithData());
@@ -596,22 +759,184 @@ void local::BinnedData::saveInverseCovariance(std::ostream &os, double scale) co
     }
 }
 
+namespace {
+    // Returns the binning specification of the specified axis, using full double precision.
+    std::string getBinningSpec(local::AbsBinningCPtr binning) {
+        std::ostringstream spec;
+        spec.precision(17);
+        binning->printToStream(spec);
+        return spec.str();
+    }
+    // Flag bits used in our binary file header.
+    enum { HAS_COVARIANCE = 1, IS_WEIGHTED = 2, HAS_CUSTOM_BINS = 4, USE_CUSTOM_GRID = 8 };
+}
+
+char const *local::BinnedData::getBinarySignature() { return "LIKELYBD"; }
+
+int local::BinnedData::getBinaryVersion() { return 2; }
+
+void local::BinnedData::saveBinary(std::string const &filename) const {
+    std::ofstream out(filename.c_str(),std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out.good()) {
+        throw RuntimeError("BinnedData::saveBinary: unable to open " + filename);
+    }
+    // Write our fixed-size header.
+    boost::int32_t nAxes(_grid.getNAxes()), nBins(getNBinsWithData()), nCustom(getNCustomBins());
+    boost::int32_t flags(0);
+    if(hasCovariance()) flags |= HAS_COVARIANCE;
+    if(_weighted) flags |= IS_WEIGHTED;
+    if(nCustom > 0) flags |= HAS_CUSTOM_BINS;
+    if(_customGrid) flags |= USE_CUSTOM_GRID;
+    boost::int32_t header[4] = { getBinaryVersion(), nAxes, nBins, flags };
+    out.write(getBinarySignature(),8);
+    binary::writeArray(out,header,4);
+    binary::writeArray(out,&_weight,1);
+    // Write the binning specification of each axis, padding its length and characters
+    // together to a multiple of 8 bytes.
+    for(int axis = 0; axis < nAxes; ++axis) {
+        std::string binning(getBinningSpec(_grid.getAxisBinning(axis)));
+        boost::int32_t length(binning.size());
+        out.write(reinterpret_cast<char const*>(&length),4);
+        out.write(binning.c_str(),length);
+        binary::writePadding(out,4+length);
+    }
+    // Write our index and data vectors.
+    if(nBins > 0) {
+        binary::writeArray(out,&_bins->index[0],nBins);
+        binary::writeArray(out,&(*_data)[0],nBins);
+    }
+    // Write any custom bin centers.
+    if(nCustom > 0) {
+        binary::writeArray(out,&nCustom,1);
+        binary::writeArray(out,&_custom->index[0],nCustom);
+        binary::writeArray(out,&_custom->bin1[0],nCustom);
+        binary::writeArray(out,&_custom->bin2[0],nCustom);
+        binary::writeArray(out,&_custom->bin3[0],nCustom);
+    }
+    // Write any covariance matrix.
+    if(hasCovariance()) _covariance->writeBinary(out);
+    out.close();
+    if(out.fail()) {
+        throw RuntimeError("BinnedData::saveBinary: error writing " + filename);
+    }
+}
+
+local::BinnedDataCPtr local::BinnedData::loadBinary(std::string const &filename,
+BinnedGrid const *grid) {
+    std::ifstream in(filename.c_str(),std::ios::in | std::ios::binary);
+    if(!in.good()) {
+        throw RuntimeError("BinnedData::loadBinary: unable to open " + filename);
+    }
+    std::string const context("BinnedData::loadBinary: " + filename);
+    // Parse and validate our header.
+    char signature[8];
+    if(!in.read(signature,8) || 0 != std::memcmp(signature,getBinarySignature(),8)) {
+        throw RuntimeError("BinnedData::loadBinary: not a binary dataset: " + filename);
+    }
+    boost::int32_t header[4];
+    double weight;
+    binary::readArray(in,header,4,context);
+    binary::readArray(in,&weight,1,context);
+    if(header[0] != getBinaryVersion()) {
+        throw RuntimeError("BinnedData::loadBinary: unsupported version in " + filename);
+    }
+    int nAxes(header[1]), nBins(header[2]), flags(header[3]);
+    // Rebuild our grid from its binning specifications, or check that they match the grid provided.
+    if(grid && grid->getNAxes() != nAxes) {
+        throw RuntimeError("BinnedData::loadBinary: grid does not match " + filename);
+    }
+    std::vector<AbsBinningCPtr> axes;
+    for(int axis = 0; axis < nAxes; ++axis) {
+        boost::int32_t length(-1);
+        in.read(reinterpret_cast<char*>(&length),4);
+        if(!in || length < 0) {
+            throw RuntimeError("BinnedData::loadBinary: invalid binning in " + filename);
+        }
+        std::vector<char> spec;
+        binary::checkAvailable(in,length,context);
+        spec.resize(length);
+        if(length > 0) in.read(&spec[0],length);
+        binary::skipPadding(in,4+length,context);
+        std::string binning(spec.begin(),spec.end());
+        if(grid) {
+            if(getBinningSpec(grid->getAxisBinning(axis)) != binning) {
+                throw RuntimeError("BinnedData::loadBinary: grid does not match " + filename);
+            }
+        }
+        else {
+            axes.push_back(createBinning(binning));
+        }
+    }
+    BinnedDataPtr data(new BinnedData(grid ? *grid : BinnedGrid(axes)));
+    // Read our index and data vectors directly into place.
+    int nBinsTotal(data->_grid.getNBinsTotal());
+    if(nBins < 0 || nBins > nBinsTotal) {
+        throw RuntimeError("BinnedData::loadBinary: invalid number of bins in " + filename);
+    }
+    if(nBins > 0) {
+        IndexTable &bins(*data->_bins);
+        binary::readArray(in,bins.index,nBins,context);
+        binary::readArray(in,*data->_data,nBins,context);
+        for(int offset = 0; offset < nBins; ++offset) {
+            int globalIndex(bins.index[offset]);
+            if(globalIndex < 0 || globalIndex >= nBinsTotal || bins.offset.get(globalIndex) != EMPTY_BIN) {
+                throw RuntimeError("BinnedData::loadBinary: invalid index table in " + filename);
+            }
+            bins.offset.set(globalIndex,offset);
+        }
+    }
+    // Read any custom bin centers.
+    if(flags & HAS_CUSTOM_BINS) {
+        boost::int32_t nCustom;
+        binary::readArray(in,&nCustom,1,context);
+        if(nCustom < 0 || nCustom > nBinsTotal) {
+            throw RuntimeError("BinnedData::loadBinary: invalid number of custom bins in " + filename);
+        }
+        CustomTable &custom(*data->_custom);
+        binary::readArray(in,custom.index,nCustom,context);
+        binary::readArray(in,custom.bin1,nCustom,context);
+        binary::readArray(in,custom.bin2,nCustom,context);
+        binary::readArray(in,custom.bin3,nCustom,context);
+        for(int offset = 0; offset < nCustom; ++offset) {
+            int globalIndex(custom.index[offset]);
+            if(globalIndex < 0 || globalIndex >= nBinsTotal ||
+            custom.offset.get(globalIndex) != EMPTY_BIN) {
+                throw RuntimeError("BinnedData::loadBinary: invalid custom index table in " + filename);
+            }
+            custom.offset.set(globalIndex,offset);
+        }
+    }
+    data->_customGrid = (flags & USE_CUSTOM_GRID);
+    // Read any covariance matrix.
+    if(flags & HAS_COVARIANCE) {
+        data->_covariance = CovarianceMatrix::readBinary(in);
+        if(data->_covariance->getSize() != nBins) {
+            throw RuntimeError("BinnedData::loadBinary: covariance has wrong size in " + filename);
+        }
+    }
+    data->_weight = weight;
+    data->_weighted = (flags & IS_WEIGHTED);
+    data->finalize();
+    return data;
+}
+
 local::BinnedDataPtr local::BinnedData::sample(RandomPtr random) const {
     // Create a new dataset with the same binning.
     bool binningOnly(true);
     BinnedDataPtr sampled(this->clone(binningOnly));
     // Fill the new dataset with noise sampled from our covariance.
-    _covariance->sample(sampled->_data,random);
-    // Copy our data vector book-keeping arrays to the sampled dataset.
-    sampled->_offset = _offset;
-    sampled->_index = _index;
+    std::vector<double> &sampledData(unshare(sampled->_data));
+    _covariance->sample(sampledData,random);
+    // Share our index table with the sampled dataset.
+    sampled->_bins = _bins;
     // Add our (unweighted) data vector to the sampled noise.
     _setWeighted(false);
     // sampled was constructed with _weighted = false and empty _dataCache so
     // the next line shouldn't actually do anything
     sampled->unweightData();
-    for(int offset = 0; offset < _data.size(); ++offset) {
-        sampled->_data[offset] += _data[offset];
+    std::vector<double> const &data(*_data);
+    for(int offset = 0; offset < data.size(); ++offset) {
+        sampledData[offset] += data[offset];
     }
     // Copy our covariance matrix to the sampled data.
     sampled->setCovarianceMatrix(_covariance);
@@ -625,7 +950,7 @@ double local::BinnedData::getScalarWeight() const {
 std::string local::BinnedData::getMemoryState() const {
     std::string state = boost::str(boost::format("%6d %s%c ")
         % getMemoryUsage(false) % (_weighted ? "CinvD" : "    D")
-        % (_dataCache.size() > 0 ? '+':'-')); // +/- indicates if complement to data is cached
+        % (_dataCache->size() > 0 ? '+':'-')); // +/- indicates if complement to data is cached
     if(hasCovariance()) {
         state += boost::str(boost::format("refcount %2d ") % _covariance.use_count());
         state += _covariance->getMemoryState();
@@ -5,6 +5,7 @@
 
 #include "likely/types.h"
 #include "likely/BinnedGrid.h"
+#include "likely/OffsetMap.h"
 
 #include "boost/smart_ptr.hpp"
 
@@ -31,11 +32,13 @@ namespace likely {
         // Returns a copy of our underlying grid specification.
         BinnedGrid getGrid() const;
 
-		// Shallow copying is supported via the default copy constructor, which makes copies of
-		// our data, but just adds smart pointer references to the original object's binning
-		// objects and covariance matrix (if any). Any covariance matrix with more than one
-		// reference count is being shared and cannot be modified via the newly created object
-		// or the original. Use the isCovarianceModifiable() method to test for this condition.
+		// Shallow copying is supported via the default copy constructor, which just adds smart
+		// pointer references to the original object's binning objects, index tables, data
+		// vectors and covariance matrix (if any). Index tables and data vectors are copied
+		// on write, so changing the data of a copy does not change the original. Any
+		// covariance matrix with more than one reference count is being shared and cannot
+		// be modified via the newly created object or the original. Use the
+		// isCovarianceModifiable() method to test for this condition.
 		// See the cloneCovariance() method if you actually want each object to have separate
 		// and modifiable covariance matrices.
 		
@@ -67,6 +70,16 @@ namespace likely {
         // covariance matrix. For some common cases of correctly weighted combinations,
         // use a BinnedDataResampler.
         virtual BinnedData& add(BinnedData const &other, double weight = 1);
+        // Adds a weighted combination of congruent binned datasets to our dataset. This is
+        // equivalent to calling add(*datasets[k],weights[k]) for each dataset in turn, with
+        // all weights 1 if none are provided, but all inverse covariances are accumulated in a
+        // single cache-blocked pass (see CovarianceMatrix::addInverse) that is divided among
+        // nThreads threads. Datasets with zero weight are ignored. Note that this method
+        // does not call add(), so any subclass specializations of add() are bypassed.
+        // Throws a RuntimeError if any dataset is incongruent or the number of weights does
+        // not match the number of datasets.
+        BinnedData& combine(std::vector<BinnedDataCPtr> const &datasets,
+            std::vector<double> const &weights = std::vector<double>(), int nThreads = 1);
         // Tests if another binned dataset is "congruent" with ours. Congruence requires:
         // [1] identical binning specifications along each axis
         // [2] that the same bins be occupied in the same order
@@ -196,6 +209,19 @@ namespace likely {
         // used here is an optimization, not a mistake.) If no covariance is available,
         // then Cinv=identity is assumed.
         double chiSquare(std::vector<double> pred) const;
+        // Same as above, but uses the caller-owned workspace vector for the residuals, so that
+        // no memory is allocated once the workspace has grown to getNBinsWithData() elements.
+        // A fitter should keep one workspace per thread and reuse it for every evaluation.
+        double chiSquare(std::vector<double> const &pred, std::vector<double> &workspace) const;
+        // Calculates the chi-squares for a batch of K predicted data vectors stored
+        // consecutively in preds, so that element j of prediction k is preds[k*n+j] with
+        // n = getNBinsWithData(), and saves the results in chi2, which is resized to K.
+        // Each prediction must use the same index sequence as our index iterator. The preds
+        // vector is used as workspace and its contents are undefined on return. This is
+        // equivalent to, but much faster than, K calls to chiSquare (see
+        // CovarianceMatrix::chiSquareBatch for details). Throws a RuntimeError unless the size
+        // of preds is a multiple of n.
+        void chiSquareBatch(std::vector<double> &preds, std::vector<double> &chi2) const;
         // Returns this dataset's scalar weight. If we have a covariance matrix, this is defined
         // as det(C)^(-1/n) where n = getNBinsWithData(). Otherwise, it will be a scalar value
         // playing the role of Cinv that is maintained internally and which defaults to one.
@@ -249,7 +275,9 @@ namespace likely {
         // form, Cinv.data, (if a covariance is available) before compressing the covariance.
         // This allows this dataset to be added to other datasets while compressed but means
         // that calling getData() will trigger an automatic decompression of the covariance.
-        bool compress(bool weighted = true) const;
+        // The threshold and singlePrecision options select a lossy covariance compression,
+        // as described in CovarianceMatrix::compress().
+        bool compress(bool weighted = true, double threshold = 0, bool singlePrecision = false) const;
         // Returns true if this covariance matrix is currently compressed. Note that uncompression
         // happens automatically, on demand, so there is no guarantee that a compressed object
         // will remain compressed.
@@ -279,6 +307,25 @@ namespace likely {
         // or index2 < index1 are not written to the file. Throws a RuntimeError if the
         // covariance is not positive-definite.
         void saveInverseCovariance(std::ostream &os, double scale = 1) const;
+        // Saves this dataset to the specified file in a versioned, native-endian binary format
+        // that includes our grid specification, index tables, data vector (in its current
+        // weighted or unweighted form), any custom bin centers and any covariance matrix (in its
+        // current compressed or uncompressed form, see CovarianceMatrix::writeBinary). Throws a
+        // RuntimeError if the file cannot be written.
+        void saveBinary(std::string const &filename) const;
+        // Loads a dataset previously saved with saveBinary. Each saved array is read from the
+        // file directly into the storage of the new dataset in a single bulk read, so loading
+        // requires no parsing and no matrix inversions, and a compressed covariance stays
+        // compressed. The loaded dataset owns its storage and does not keep the file open. The returned
+        // dataset is finalized. If a grid is provided, its binning objects are used, so that
+        // the result is congruent with other datasets using the same grid (which is required
+        // to add them), after checking that they match the saved binning specifications.
+        // Throws a RuntimeError if the file cannot be read or is invalid.
+        static BinnedDataCPtr loadBinary(std::string const &filename,
+            BinnedGrid const *grid = 0);
+        // Returns the 8-byte signature and the version number of our binary file format.
+        static char const *getBinarySignature();
+        static int getBinaryVersion();
 
         // Returns a string that displays the memory state of this object.
         std::string getMemoryState() const;
@@ -309,14 +356,30 @@ namespace likely {
         // The grid that our data represents.
         BinnedGrid _grid;
         enum { EMPTY_BIN = -1 };
-        std::vector<int> _offset, _index, _customOffset, _customIndex;
-        // Custom grid vectors.
-        std::vector<double> _customBin1, _customBin2, _customBin3;
+        // The offset of each global index with data (or custom bin centers) in our storage
+        // vectors, and the global index at each offset.
+        struct IndexTable {
+            explicit IndexTable(int size);
+            OffsetMap offset;
+            std::vector<int> index;
+        };
+        // Custom bin centers use an index table with parallel vectors of bin centers.
+        struct CustomTable : public IndexTable {
+            explicit CustomTable(int size);
+            std::vector<double> bin1, bin2, bin3;
+        };
+        // Our index tables and data vectors are shared by our copies (and index tables with any
+        // dataset initialized from us by add or combine) and are only copied when a dataset
+        // that shares them needs to modify them. Index tables cannot be modified once we are
+        // finalized, so the tables of congruent finalized datasets are never copied.
+        typedef boost::shared_ptr<std::vector<double> > DataVectorPtr;
+        boost::shared_ptr<IndexTable> _bins;
+        boost::shared_ptr<CustomTable> _custom;
         // Our data vector which might be weighted.
-        mutable std::vector<double> _data;
+        mutable DataVectorPtr _data;
         // A data vector cache which is either empty or else contains the weighted/unweighted
         // complement corresponding to _data.
-        mutable std::vector<double> _dataCache;
+        mutable DataVectorPtr _dataCache;
         // A shared pointer to our covariance matrix, if any.
         CovarianceMatrixPtr _covariance;
         // In case we have no covariance, we need a scalar that plays the role of Cinv, to
@@ -334,24 +397,30 @@ namespace likely {
         // weighted data Cinv.d. The special case of weighted = false and flushCache = true
         // is implemented in the public non-const (!) method unweightData().
         void _setWeighted(bool weighted, bool flushCache = false) const;
+        // Initializes an empty dataset with the occupied bins of a dataset with the same binning,
+        // ready to accumulate weighted data Cinv.d and inverse covariances (or scalar weights).
+        void _initializeFrom(BinnedData const &other);
+        // Replaces the predicted data vector provided with the residuals pred-data and returns
+        // the corresponding chi-square. The input vector size must already have been checked.
+        double _chiSquare(std::vector<double> &pred) const;
 	}; // BinnedData
 	
     inline BinnedGrid BinnedData::getGrid() const { return _grid; }
-    inline int BinnedData::getNBinsWithData() const { return _index.size(); }
+    inline int BinnedData::getNBinsWithData() const { return _bins->index.size(); }
     inline bool BinnedData::hasCovariance() const { return _covariance.get() != 0; }
     inline bool BinnedData::isDataWeighted() const { return _weighted; }
     inline CovarianceMatrixCPtr BinnedData::getCovarianceMatrix() const { return _covariance; }
     inline bool BinnedData::isCovarianceModifiable() const {
         return 0 == _covariance.get() || _covariance.unique();
     }
-    inline BinnedData::IndexIterator BinnedData::begin() const { return _index.begin(); }
-    inline BinnedData::IndexIterator BinnedData::end() const { return _index.end(); }
+    inline BinnedData::IndexIterator BinnedData::begin() const { return _bins->index.begin(); }
+    inline BinnedData::IndexIterator BinnedData::end() const { return _bins->index.end(); }
     inline bool BinnedData::isFinalized() const { return _finalized; }
     inline BinnedData& BinnedData::operator+=(BinnedData const& other) { return add(other); }
-    inline int BinnedData::getNCustomBins() const { return _customIndex.size(); }
+    inline int BinnedData::getNCustomBins() const { return _custom->index.size(); }
     inline bool BinnedData::useCustomGrid() const { return _customGrid; }
-    inline BinnedData::IndexIterator BinnedData::beginCustom() const { return _customIndex.begin(); }
-    inline BinnedData::IndexIterator BinnedData::endCustom() const { return _customIndex.end(); }
+    inline BinnedData::IndexIterator BinnedData::beginCustom() const { return _custom->index.begin(); }
+    inline BinnedData::IndexIterator BinnedData::endCustom() const { return _custom->index.end(); }
 
 } // likely
 
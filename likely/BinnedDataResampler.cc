@@ -8,19 +8,35 @@
 #include "likely/CovarianceAccumulator.h"
 
 #include "boost/math/special_functions/binomial.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/bind.hpp"
 
 #include <algorithm>
+#include <limits>
+#include <map>
+#include <string>
 
 namespace local = likely;
 
 local::BinnedDataResampler::BinnedDataResampler(bool useScalarWeights, RandomPtr random)
-: _useScalarWeights(useScalarWeights), _random(random), _combinedScalarWeight(0)
+: _useScalarWeights(useScalarWeights), _singlePrecision(false), _compressionThreshold(0),
+_random(random), _combinedScalarWeight(0)
 {
     if(!_random) _random = Random::instance();
 }
 
 local::BinnedDataResampler::~BinnedDataResampler() { }
 
+void local::BinnedDataResampler::setCompression(double threshold, bool singlePrecision) {
+    if(threshold < 0) {
+        throw RuntimeError("BinnedDataResampler::setCompression: expected threshold >= 0.");
+    }
+    _compressionThreshold = threshold;
+    _singlePrecision = singlePrecision;
+}
+
 int local::BinnedDataResampler::addObservation(BinnedDataCPtr observation, int reuseCovIndex) {
     //!!std::cout << "  add-in: " << observation->getMemoryState() << std::endl;
     // Check that this new observation is congruent with what we have so far. Ignore covariance
@@ -33,6 +49,7 @@ int local::BinnedDataResampler::addObservation(BinnedDataCPtr observation, int r
     else {
         bool binningOnly(true);
         _combined.reset(observation->clone(binningOnly));
+        if(_useScalarWeights) _scalarCombined.reset(observation->clone(binningOnly));
     }
     int newIndex = _observations.size();
     // Make a copy of this observation that we will keep.
@@ -69,6 +86,11 @@ int local::BinnedDataResampler::addObservation(BinnedDataCPtr observation, int r
         copy->cloneCovariance();
     }
     //!!std::cout << "add-tmp1: " << copy->getMemoryState() << std::endl;
+    if(!_useScalarWeights) {
+        // Compress the copy before we combine or save it, so that our combined dataset is built
+        // from exactly the same (possibly lossy) values that our resampling methods use.
+        copy->compress(true,_compressionThreshold,_singlePrecision);
+    }
     // Add this copy to our combined dataset.
     *_combined += *copy;
     //!!std::cout << "add-tmp2: " << copy->getMemoryState() << std::endl;
@@ -79,9 +101,12 @@ int local::BinnedDataResampler::addObservation(BinnedDataCPtr observation, int r
         //!!std::cout << "add-tmp3: " << copy->getMemoryState() << std::endl;
         copy->dropCovariance(weight);
         _combinedScalarWeight += weight;
+        // Keep a combination of the scalar-weighted copies for incremental jackknifing.
+        *_scalarCombined += *copy;
+        // Compress the copy before we save it. It no longer has a covariance to compress, but
+        // this drops the unweighted data cached by the additions above.
+        copy->compress(true,_compressionThreshold,_singlePrecision);
     }
-    // Compress the copy before we save it (none of our resampling methods should uncompress it)
-    copy->compress();
     // Remember this (copied) observation
     //!!std::cout << " add-out: " << observation->getMemoryState() << std::endl;
     //!!std::cout << "add-copy: " << copy->getMemoryState() << std::endl;
@@ -143,38 +168,68 @@ local::BinnedDataPtr local::BinnedDataResampler::getObservationCopy(int index, b
 }
 
 local::BinnedDataPtr local::BinnedDataResampler::jackknife(int ndrop, unsigned long seqno,
-bool addCovariance) const {
+bool addCovariance, bool incremental) const {
     int nobs(_observations.size());
     if(ndrop < 0 || ndrop >= nobs) {
         throw RuntimeError("BinnedDataResampler::jackknife: invalid ndrop.");
     }
+    if(incremental) {
+        unsigned long nSamples(boost::math::binomial_coefficient<double>(nobs,ndrop));
+        if(seqno >= nSamples) return BinnedDataPtr();
+        // Start from a copy of our combined observations, with a modifiable covariance.
+        BinnedDataPtr resample((_useScalarWeights ? _scalarCombined : _combined)->clone());
+        resample->cloneCovariance();
+        if(ndrop > 0) {
+            // Kept subsets are enumerated in colex order by getSubset and complementing
+            // each subset reverses this order, so the dropped subset for seqno is the
+            // ndrop-subset with sequence number nSamples-1-seqno.
+            _subset.resize(ndrop);
+            getSubset(nobs,nSamples-1-seqno,_subset);
+            // Subtract the dropped observations.
+            std::vector<BinnedDataCPtr> dropped;
+            for(int dropIndex = 0; dropIndex < ndrop; ++dropIndex) {
+                dropped.push_back(_observations[_subset[dropIndex]]);
+            }
+            resample->combine(dropped,std::vector<double>(ndrop,-1));
+        }
+        if(addCovariance) _addCovariance(resample);
+        return resample;
+    }
     // Fill our _subset vector with the subset indices corresponding to seqno.
     int nkeep = nobs - ndrop;
     _subset.resize(nkeep);
     if(!getSubset(nobs,seqno,_subset)) return BinnedDataPtr();
     // Create an empty dataset with the right axis binning.
     BinnedDataPtr resample(_observations[0]->clone(true));
-    // Add each observation from the generated sample.
+    // Combine the observations from the generated sample.
+    std::vector<BinnedDataCPtr> kept;
+    kept.reserve(nkeep);
     for(int obsIndex = 0; obsIndex < nkeep; ++obsIndex) {
-        *resample += *_observations[_subset[obsIndex]];
+        kept.push_back(_observations[_subset[obsIndex]]);
     }
+    resample->combine(kept);
     if(addCovariance) _addCovariance(resample);
     return resample;
 }
 
 local::BinnedDataPtr local::BinnedDataResampler::bootstrap(int size, bool fixCovariance,
 bool addCovariance) const {
+    return _bootstrap(size,fixCovariance,addCovariance,*_random,_counts);
+}
+
+local::BinnedDataPtr local::BinnedDataResampler::_bootstrap(int size, bool fixCovariance,
+bool addCovariance, Random &random, std::vector<int> &counts) const {
     if(size < 0) {
         throw RuntimeError("BinnedDataResampler::bootstrap: invalid size.");
     }
     if(0 == size) size = getNObservations();
     if(0 == getNObservations()) return BinnedDataPtr();
     // Do we need to (re)initialize our counts vector?
-    if(_counts.size() != _observations.size()) {
-        _counts.resize(_observations.size(),0);
+    if(counts.size() != _observations.size()) {
+        counts.resize(_observations.size(),0);
     }
     // Generate a random sample with replacement.
-    _random->sampleWithReplacement(_counts,size);
+    random.sampleWithReplacement(counts,size);
     // Create an empty dataset with the right axis binning.
     BinnedDataPtr resample(_observations[0]->clone(true));
     // We cannot fix a non-existent covariance.
@@ -183,37 +238,151 @@ bool addCovariance) const {
     likely::CovarianceMatrixPtr D;
     int nbins = _observations[0]->getNBinsWithData();
     if(fixCovariance) D.reset(new likely::CovarianceMatrix(nbins));
-    // Loop over observations, adding each one the appropriate number of times.
+    // Combine the observations, weighting each one by the number of times it was sampled.
     bool duplicatesFound(false);
+    std::vector<BinnedDataCPtr> sampled;
+    std::vector<CovarianceMatrixCPtr> matrices;
+    std::vector<double> weights, squaredWeights;
     for(int obsIndex = 0; obsIndex < _observations.size(); ++obsIndex) {
-        int count(_counts[obsIndex]);
+        int count(counts[obsIndex]);
         if(0 == count) continue;
         if(count > 1) duplicatesFound = true;
-        BinnedDataCPtr observation = _observations[obsIndex];
-        resample->add(*observation,count);
-        if(fixCovariance) D->addInverse(*(observation->getCovarianceMatrix()),count*count);
+        sampled.push_back(_observations[obsIndex]);
+        weights.push_back(count);
+        if(fixCovariance) {
+            matrices.push_back(_observations[obsIndex]->getCovarianceMatrix());
+            squaredWeights.push_back(count*count);
+        }
     }
+    resample->combine(sampled,weights);
+    if(fixCovariance && duplicatesFound) D->addInverse(matrices,squaredWeights);
     // We can skip this relatively expensive operation if all counts are 0,1.
     if(duplicatesFound && fixCovariance) resample->transformCovariance(D);
     if(addCovariance) _addCovariance(resample);
     return resample;
 }
 
+// Shares the state of an estimateCombinedCovariance calculation between the calling
+// thread, which accumulates samples in order, and the worker threads that generate them.
+class local::BinnedDataResampler::BootstrapQueue {
+public:
+    BootstrapQueue(int nSamples_, int window_, RandomPtr master_)
+    : nSamples(nSamples_), window(window_), next(0), consumed(0), stop(false), master(master_) { }
+    boost::mutex mutex;
+    // Signals that a new sample is available, or that a worker has failed.
+    boost::condition_variable ready;
+    // Signals that a sample has been consumed, or that workers should stop.
+    boost::condition_variable space;
+    // Workers never run more than window samples ahead of the consumer, to bound memory use.
+    int nSamples, window, next, consumed;
+    bool stop;
+    RandomPtr master;
+    std::map<int,BinnedDataPtr> samples;
+    std::string error;
+};
+
+void local::BinnedDataResampler::_bootstrapWorker(BootstrapQueue &queue) const {
+    bool fixCovariance(false),addCovariance(false);
+    std::vector<int> counts;
+    boost::mutex::scoped_lock lock(queue.mutex);
+    while(true) {
+        // Wait until there is a sample we are allowed to work on.
+        while(!queue.stop && queue.next < queue.nSamples &&
+            queue.next >= queue.consumed + queue.window) queue.space.wait(lock);
+        if(queue.stop || queue.next >= queue.nSamples) return;
+        int sample = queue.next++;
+        lock.unlock();
+        BinnedDataPtr data;
+        std::string error;
+        try {
+            // Each sample uses its own substream so the result does not depend on which
+            // thread generates it.
+            RandomPtr random = queue.master->createStream(sample);
+            data = _bootstrap(0,fixCovariance,addCovariance,*random,counts);
+            // Unweight the sample here, since this requires inverting its combined Cinv,
+            // so that the consumer only needs to accumulate its data vector.
+            data->unweightData();
+        }
+        catch(std::exception const &e) {
+            error = e.what();
+        }
+        lock.lock();
+        if(error.length() > 0) {
+            if(queue.error.length() == 0) queue.error = error;
+            queue.stop = true;
+            queue.space.notify_all();
+        }
+        else {
+            queue.samples[sample] = data;
+        }
+        queue.ready.notify_all();
+    }
+}
+
 local::CovarianceAccumulatorPtr
 local::BinnedDataResampler::estimateCombinedCovariance(int nSamples,
-AccumulationCallback callback, int interval) const {
+AccumulationCallback callback, int interval, int nThreads) const {
     if(nSamples <= 0) {
         throw RuntimeError("BinnedDataResampler::estimateCombinedCovariance: expected nSamples > 0.");
     }
+    if(nThreads <= 0) {
+        throw RuntimeError("BinnedDataResampler::estimateCombinedCovariance: expected nThreads > 0.");
+    }
     if(0 == getNObservations()) return CovarianceAccumulatorPtr();
     CovarianceAccumulatorPtr accumulator(new CovarianceAccumulator(_observations[0]->getNBinsWithData()));
     bool fixCovariance(false),addCovariance(false);
+    if(1 == nThreads) {
+        for(int sample = 0; sample < nSamples; ++sample) {
+            BinnedDataPtr data = bootstrap(0,fixCovariance,addCovariance);
+            accumulator->accumulate(data);
+            if(interval > 0 && (sample+1) % interval == 0) {
+                if(!callback(accumulator)) break;
+            }
+        }
+        return accumulator;
+    }
+    // Draw the seed for this calculation's substreams from our generator.
+    RandomPtr master(new Random());
+    master->setSeed(_random->getInteger(0,std::numeric_limits<int>::max()));
+    // Start our worker threads.
+    BootstrapQueue queue(nSamples,2*nThreads,master);
+    boost::thread_group workers;
+    for(int thread = 0; thread < nThreads; ++thread) {
+        workers.create_thread(boost::bind(&BinnedDataResampler::_bootstrapWorker,this,boost::ref(queue)));
+    }
+    // Accumulate samples in order as they become available. We deliberately use a single
+    // accumulator here rather than per-worker accumulators combined with
+    // CovarianceAccumulator::merge: merging changes the rounding of the result according to
+    // which worker generated which samples, and the callback could no longer see exactly the
+    // first (sample+1) samples. Since the workers have already unweighted each sample, the
+    // only work left here is an O(n^2) update of the accumulator.
     for(int sample = 0; sample < nSamples; ++sample) {
-        BinnedDataPtr data = bootstrap(0,fixCovariance,addCovariance);
+        BinnedDataPtr data;
+        {
+            boost::mutex::scoped_lock lock(queue.mutex);
+            std::map<int,BinnedDataPtr>::iterator found;
+            while((found = queue.samples.find(sample)) == queue.samples.end() &&
+                queue.error.length() == 0) queue.ready.wait(lock);
+            if(queue.error.length() > 0) break;
+            data = found->second;
+            queue.samples.erase(found);
+            queue.consumed = sample+1;
+            queue.space.notify_all();
+        }
         accumulator->accumulate(data);
         if(interval > 0 && (sample+1) % interval == 0) {
             if(!callback(accumulator)) break;
         }
     }
+    // Stop and clean up our worker threads.
+    {
+        boost::mutex::scoped_lock lock(queue.mutex);
+        queue.stop = true;
+        queue.space.notify_all();
+    }
+    workers.join_all();
+    if(queue.error.length() > 0) {
+        throw RuntimeError("BinnedDataResampler::estimateCombinedCovariance: " + queue.error);
+    }
     return accumulator;
 }
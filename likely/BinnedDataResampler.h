@@ -30,6 +30,15 @@ namespace likely {
 		BinnedDataResampler(bool useScalarWeights = false, RandomPtr random = RandomPtr());
 		virtual ~BinnedDataResampler();
         bool usesScalarWeights() const;
+        // Sets the options used to compress the covariance of each subsequently added observation
+        // (see CovarianceMatrix::compress). The default is lossless compression. A lossy
+        // compression reduces the memory needed to keep many observations. Each observation is
+        // compressed before it is added to the combination of all observations, so that
+        // combined() and all resampling methods use the same compressed values. With scalar
+        // weights, each observation's covariance is dropped after it has been combined, so
+        // the compression options do not change its values. Throws a RuntimeError if
+        // threshold < 0.
+        void setCompression(double threshold, bool singlePrecision = false);
 		// Adds a copy of the specified observation. Throws a RuntimeError if this observation
 		// is not congruent with existing observations. You are allowed to add the same
 		// observation several times, but you normally don't want to do this. Calls to
@@ -70,8 +79,14 @@ namespace likely {
         //  }
         // Note that the number of jackknife samples generated this way gets large quickly
         // as ndrop increases. There is no requirement that seqno increase by one for successive
-        // calls, so jackknifing can easily be parallelized in various ways.
-        BinnedDataPtr jackknife(int ndrop, unsigned long seqno, bool addCovariance = true) const;
+        // calls, so jackknifing can easily be parallelized in various ways. With incremental
+        // = true, each sample is instead calculated by subtracting the ndrop dropped observations
+        // from our combined observations in weighted (Cinv.d, Cinv) space, which only requires
+        // O(ndrop) matrix additions instead of O(nobs-ndrop), so that the full set of delete-one
+        // jackknife samples has a cost that is linear in nobs. The same seqno selects the same
+        // sample in both modes, and the results are equivalent up to rounding errors.
+        BinnedDataPtr jackknife(int ndrop, unsigned long seqno, bool addCovariance = true,
+            bool incremental = false) const;
         // Returns a shared pointer to a new BinnedData that represents a bootstrap resampling
         // of our observations of the specified size, which defaults to the number of observations
         // when zero. The fixCovariance option requests that the final covariance matrix be corrected
@@ -84,20 +99,38 @@ namespace likely {
         // Returns a CovarianceAccumulator estimate of the covariance of our combined
         // observations using the specified number of bootstrap samples. Calls the callback function,
         // if one is provided, at the specified interval or never if the interval is <= 0. The bootstrap
-        // loop returns early if the callback returns false.
+        // loop returns early if the callback returns false. With nThreads > 1, bootstrap samples
+        // are generated concurrently by a pool of worker threads, each sample using its own
+        // random substream (see Random::createStream) derived from a single seed drawn from our
+        // generator, and samples are accumulated (and the callback is called) in sample order on
+        // the calling thread. The results are then bit-for-bit reproducible for a given seed and
+        // do not depend on nThreads > 1 or on how work is scheduled among the threads (which is
+        // why samples are not accumulated per thread and merged). With nThreads = 1, all
+        // samples are generated serially using our generator directly.
         typedef boost::function<bool (CovarianceAccumulatorCPtr)> AccumulationCallback;
         CovarianceAccumulatorPtr estimateCombinedCovariance(int nSamples,
-            AccumulationCallback callback = AccumulationCallback(), int interval = 0) const;
+            AccumulationCallback callback = AccumulationCallback(), int interval = 0,
+            int nThreads = 1) const;
 	private:
+	    // Implements bootstrap() using the specified generator and counts workspace, so
+	    // that concurrent calls with different generators and workspaces are safe.
+        BinnedDataPtr _bootstrap(int size, bool fixCovariance, bool addCovariance,
+            Random &random, std::vector<int> &counts) const;
+        // Generates bootstrap samples for estimateCombinedCovariance in a worker thread.
+        class BootstrapQueue;
+        void _bootstrapWorker(BootstrapQueue &queue) const;
 	    // Adds a covariance matrix to a resampling built with scalar weights. The matrix will be
 	    // a copy of our combined covariance scaled by the ratio of our _combinedScalarWeight to
 	    // the sample's scalar weight.
         void _addCovariance(BinnedDataPtr sample) const;
-        bool _useScalarWeights;
+        bool _useScalarWeights, _singlePrecision;
+        double _compressionThreshold;
         mutable RandomPtr _random;
         std::vector<BinnedDataCPtr> _observations;
         double _combinedScalarWeight;
-        BinnedDataPtr _combined;
+        // The combination of all observations with their covariances, and of all observations
+        // as stored (with scalar weights) when _useScalarWeights is true.
+        BinnedDataPtr _combined, _scalarCombined;
         mutable std::vector<int> _subset, _counts;
 	}; // BinnedDataResampler
 	
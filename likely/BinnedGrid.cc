@@ -78,11 +78,36 @@ int local::BinnedGrid::getIndex(std::vector<double> const &values) const {
     if(values.size() != nAxes) {
         throw RuntimeError("BinnedGrid::getIndex: invalid input vector size.");
     }
-    std::vector<int> binIndices;
     for(int axis = 0; axis < nAxes; ++axis) {
-        binIndices.push_back(_axisBinning[axis]->getBinIndex(values[axis]));
+        AbsBinningCPtr binning = _axisBinning[axis];
+        index = binning->getBinIndex(values[axis]) + index*binning->getNBins();
+    }
+    return index;
+}
+
+int local::BinnedGrid::getIndices(int n, double const *coordinates, int *indices) const {
+    if(n < 0) {
+        throw RuntimeError("BinnedGrid::getIndices: expected n >= 0.");
+    }
+    // Bin each axis in chunks that fit on the stack.
+    static const int chunkSize(1024);
+    int binIndices[chunkSize];
+    int nAxes(getNAxes()), nOutside(0);
+    for(int first = 0; first < n; first += chunkSize) {
+        int size(std::min(chunkSize,n-first));
+        int *index(indices + first);
+        _axisBinning[0]->getBinIndices(coordinates + first,index,size);
+        for(int axis = 1; axis < nAxes; ++axis) {
+            AbsBinningCPtr binning = _axisBinning[axis];
+            binning->getBinIndices(coordinates + (long)axis*n + first,binIndices,size);
+            int nBins(binning->getNBins());
+            for(int k = 0; k < size; ++k) {
+                index[k] = (index[k] < 0 || binIndices[k] < 0) ? -1 : binIndices[k] + index[k]*nBins;
+            }
+        }
+        for(int k = 0; k < size; ++k) nOutside += (index[k] < 0);
     }
-    return getIndex(binIndices);
+    return nOutside;
 }
 
 void local::BinnedGrid::getBinIndices(int index, std::vector<int> &binIndices) const {
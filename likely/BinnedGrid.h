@@ -40,6 +40,12 @@ namespace likely {
         // Returns the global index corresponding to the specified coordinate values along
         // each axis.
         int getIndex(std::vector<double> const &values) const;
+        // Fills the array indices with the global index corresponding to each of n points, whose
+        // coordinate values are stored by axis in the array coordinates, so that the value of
+        // point k along axis j is coordinates[j*n+k]. Uses AbsBinning::getBinIndices to bin each
+        // axis in batches, and sets the index of any point that is outside our grid to -1
+        // instead of throwing an exception. Returns the number of such points.
+        int getIndices(int n, double const *coordinates, int *indices) const;
         // Fills the vector provided with the global index values neighboring the specified
         // global index. Optional argument n specifies how far to search for neighbors in each
         // dimension (default n = 1). The set of neighbors includes the specified global index.
@@ -4,37 +4,75 @@
 #include "likely/RuntimeError.h"
 #include "likely/CovarianceMatrix.h"
 #include "likely/BinnedData.h"
+#include "likely/Random.h"
 
-#include "boost/accumulators/accumulators.hpp"
-#include "boost/accumulators/statistics/weighted_covariance.hpp"
-#include "boost/accumulators/statistics/stats.hpp"
-#include "boost/accumulators/statistics/count.hpp"
-#include "boost/accumulators/statistics/variates/covariate.hpp"
 #include "boost/lexical_cast.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
-using namespace boost::accumulators;
-
-typedef accumulator_set<double, stats<
-    tag::weighted_covariance<double, tag::covariate1> >, double > Accumulator;
-typedef std::vector<Accumulator> Accumulators;
+// Declare the BLAS routine we use here.
+// http://www.netlib.org/blas/dspr.f
+extern "C" {
+    void dspr_(char const* uplo, int const* n, double const* alpha, double const* x,
+        int const* incx, double* ap);
+    // http://www.netlib.org/blas/dsyrk.f
+    void dsyrk_(char const *uplo, char const *trans, int const *n, int const *k,
+        double const *alpha, double const *a, int const *lda, double const *beta,
+        double *c, int const *ldc);
+}
 
 namespace local = likely;
 
 namespace likely {
     struct CovarianceAccumulator::Implementation {
-        std::vector<Accumulator> accumulators;
+        // Running weighted means, and the packed ('U' format) matrix of weighted co-moments
+        // sum w.(x-mean)(x-mean)^T about these means.
+        boost::shared_array<double> mean, comoment;
+        // Workspace for the residuals of the vector being accumulated.
+        boost::shared_array<double> delta;
+        double sumWeights;
+        int count;
+        // Merges statistics with the specified means, sum of weights and count into ours,
+        // after the corresponding co-moments have already been added to ours.
+        void combine(int size, double const *otherMean, double otherWeights, int otherCount);
     }; // CovarianceAccumulator::Implementation
 } // likely::
 
+void local::CovarianceAccumulator::Implementation::combine(int size, double const *otherMean,
+double otherWeights, int otherCount) {
+    double wa(sumWeights), w(wa+otherWeights), frac(otherWeights/w);
+    // Shift the means and add the correction wa*wb/w.(meanb-meana)(meanb-meana)^T
+    for(int i = 0; i < size; ++i) {
+        double residual(otherMean[i] - mean[i]);
+        delta[i] = residual;
+        mean[i] += frac*residual;
+    }
+    if(wa > 0) {
+        static char uplo('U');
+        static int incr(1);
+        double alpha(wa*frac);
+        dspr_(&uplo,&size,&alpha,delta.get(),&incr,comoment.get());
+    }
+    sumWeights = w;
+    count += otherCount;
+}
+
 local::CovarianceAccumulator::CovarianceAccumulator(int size)
 : _size(size), _pimpl(new Implementation())
 {
     if(size <= 0) {
         throw RuntimeError("CovarianceAccumulator: expected size > 0.");
     }
-    _pimpl->accumulators.resize((size*(size+1))/2);
+    int ncov = (size*(size+1))/2;
+    _pimpl->mean = allocateAlignedDoubleArray(size);
+    _pimpl->comoment = allocateAlignedDoubleArray(ncov);
+    _pimpl->delta = allocateAlignedDoubleArray(size);
+    std::fill(_pimpl->mean.get(),_pimpl->mean.get()+size,0.);
+    std::fill(_pimpl->comoment.get(),_pimpl->comoment.get()+ncov,0.);
+    _pimpl->sumWeights = 0;
+    _pimpl->count = 0;
 }
 
 local::CovarianceAccumulator::~CovarianceAccumulator() { }
@@ -47,40 +85,129 @@ void local::CovarianceAccumulator::accumulate(std::vector<double> const &vector,
 }
 
 void local::CovarianceAccumulator::accumulate(double const *vector, double wgt) {
-    int index(0);
+    if(wgt <= 0) {
+        throw RuntimeError("CovarianceAccumulator::accumulate: expected wgt > 0.");
+    }
+    double *mean(_pimpl->mean.get()), *delta(_pimpl->delta.get());
+    double oldWeights(_pimpl->sumWeights), newWeights(oldWeights + wgt), frac(wgt/newWeights);
+    // Update the means and save the residuals relative to the old means.
     for(int i = 0; i < _size; ++i) {
-        double xi(vector[i]);
-        for(int j = 0; j <= i; ++j) {
-            _pimpl->accumulators[index++](xi, weight = wgt, covariate1 = vector[j]);
-        }
+        double residual(vector[i] - mean[i]);
+        delta[i] = residual;
+        mean[i] += frac*residual;
+    }
+    // Update the co-moments with the rank-1 update wgt.(x-oldmean)(x-newmean)^T which is
+    // symmetric and equal to (wgt*oldWeights/newWeights).delta.delta^T.
+    if(oldWeights > 0) {
+        static char uplo('U');
+        static int incr(1);
+        double alpha(oldWeights*frac);
+        dspr_(&uplo,&_size,&alpha,delta,&incr,_pimpl->comoment.get());
     }
+    _pimpl->sumWeights = newWeights;
+    _pimpl->count++;
 }
 
 void local::CovarianceAccumulator::accumulate(BinnedDataCPtr data, double wgt) {
     if(data->getNBinsWithData() != _size) {
         throw RuntimeError("CovarianceAccumulator::accumulate: invalid data size.");
     }
-    int index(0);
+    // Copy the data vector into a contiguous array, with a single lookup per element.
+    std::vector<double> vector;
+    vector.reserve(_size);
     bool weighted(false);
-    for(BinnedData::IndexIterator row = data->begin(); row != data->end(); ++row) {
-        double xi(data->getData(*row,weighted));
-        for(BinnedData::IndexIterator col = data->begin(); col <= row; ++col) {
-            _pimpl->accumulators[index++](xi, weight = 1, covariate1 = data->getData(*col,weighted));
+    for(BinnedData::IndexIterator iter = data->begin(); iter != data->end(); ++iter) {
+        vector.push_back(data->getData(*iter,weighted));
+    }
+    accumulate(&vector[0],wgt);
+}
+
+void local::CovarianceAccumulator::merge(CovarianceAccumulator const &other) {
+    if(other._size != _size) {
+        throw RuntimeError("CovarianceAccumulator::merge: incompatible sizes.");
+    }
+    if(&other == this) {
+        throw RuntimeError("CovarianceAccumulator::merge: cannot merge with self.");
+    }
+    if(0 == other._pimpl->count) return;
+    // Add the co-moments about each mean.
+    double *comoment(_pimpl->comoment.get());
+    double const *otherComoment(other._pimpl->comoment.get());
+    int ncov = (_size*(_size+1))/2;
+    for(int index = 0; index < ncov; ++index) comoment[index] += otherComoment[index];
+    // Combine the means.
+    _pimpl->combine(_size,other._pimpl->mean.get(),other._pimpl->sumWeights,other._pimpl->count);
+}
+
+void local::CovarianceAccumulator::accumulateBatch(double const *samples, int nsamples,
+double const *weights) {
+    if(nsamples <= 0) {
+        throw RuntimeError("CovarianceAccumulator::accumulateBatch: expected nsamples > 0.");
+    }
+    // Check all weights before we change any of our statistics.
+    if(weights) {
+        for(int k = 0; k < nsamples; ++k) {
+            if(weights[k] <= 0) {
+                throw RuntimeError("CovarianceAccumulator::accumulateBatch: expected weights > 0.");
+            }
         }
     }
+    // Process the block in chunks to limit our workspace size.
+    static const int maxChunkSize(512);
+    int chunkSize = std::min(nsamples,maxChunkSize);
+    std::vector<double> chunkMean(_size), scaled(_size*chunkSize), product(_size*_size);
+    double *comoment(_pimpl->comoment.get());
+    for(int first = 0; first < nsamples; first += chunkSize) {
+        int nchunk = std::min(chunkSize,nsamples-first);
+        double const *chunk(samples + first*_size);
+        // Calculate the weighted mean of this chunk.
+        double chunkWeights(0);
+        std::fill(chunkMean.begin(),chunkMean.end(),0.);
+        for(int k = 0; k < nchunk; ++k) {
+            double wgt(weights ? weights[first+k] : 1);
+            chunkWeights += wgt;
+            double const *vector(chunk + k*_size);
+            for(int i = 0; i < _size; ++i) chunkMean[i] += wgt*vector[i];
+        }
+        for(int i = 0; i < _size; ++i) chunkMean[i] /= chunkWeights;
+        // Center and scale each vector by sqrt(wgt) so that the chunk's co-moments are
+        // given by the rank-k product scaled.scaled^T
+        for(int k = 0; k < nchunk; ++k) {
+            double rootw(weights ? std::sqrt(weights[first+k]) : 1);
+            double const *vector(chunk + k*_size);
+            double *column(&scaled[k*_size]);
+            for(int i = 0; i < _size; ++i) column[i] = rootw*(vector[i] - chunkMean[i]);
+        }
+        static char uplo('U'), trans('N');
+        static double alpha(1),beta(0);
+        dsyrk_(&uplo,&trans,&_size,&nchunk,&alpha,&scaled[0],&_size,&beta,&product[0],&_size);
+        // Add the upper triangle of the product to our packed co-moments.
+        int index(0);
+        for(int col = 0; col < _size; ++col) {
+            double const *column(&product[col*_size]);
+            for(int row = 0; row <= col; ++row) comoment[index++] += column[row];
+        }
+        // Combine the means.
+        _pimpl->combine(_size,&chunkMean[0],chunkWeights,nchunk);
+    }
 }
 
 int local::CovarianceAccumulator::count() const {
-    return boost::accumulators::count(_pimpl->accumulators[0]);
+    return _pimpl->count;
+}
+
+double local::CovarianceAccumulator::sumOfWeights() const {
+    return _pimpl->sumWeights;
 }
 
 local::CovarianceMatrixPtr local::CovarianceAccumulator::getCovariance() const {
     CovarianceMatrixPtr cov(new CovarianceMatrix(_size));
+    double norm(1/_pimpl->sumWeights);
+    double const *comoment(_pimpl->comoment.get());
     int index(0);
     for(int col = 0; col < _size; ++col) {
         for(int row = 0; row <= col; ++row) {
-            double value(weighted_covariance(_pimpl->accumulators[index++]));
-            cov->setCovariance(row,col,value);
+            cov->setCovariance(row,col,norm*comoment[index++]);
         }
     }
     return cov;
@@ -92,20 +219,18 @@ void local::CovarianceAccumulator::dump(std::ostream &out) const {
     // number of samples accumulated
     out << count() << std::endl;
     // total weight of accumulated samples (use lexical_cast to get full precision)
-    out << boost::lexical_cast<std::string>(
-        sum_of_weights(_pimpl->accumulators[0])) << std::endl;
+    out << boost::lexical_cast<std::string>(_pimpl->sumWeights) << std::endl;
     // weighted means
     for(int col = 0; col < _size; ++col) {
-        int index = symmetricMatrixIndex(col,col,_size);
-        out << col << ' ' << boost::lexical_cast<std::string>(
-            weighted_mean(_pimpl->accumulators[index])) << std::endl;
+        out << col << ' ' << boost::lexical_cast<std::string>(_pimpl->mean[col]) << std::endl;
     }
     // weighted second moments
+    double norm(1/_pimpl->sumWeights);
     int index(0);
     for(int col = 0; col < _size; ++col) {
         for(int row = 0; row <= col; ++row) {
             out << row << ' ' << col << ' ' << boost::lexical_cast<std::string>(
-                weighted_covariance(_pimpl->accumulators[index++])) << std::endl;
+                norm*_pimpl->comoment[index++]) << std::endl;
         }
     }
 }
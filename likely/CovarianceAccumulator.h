@@ -11,7 +11,10 @@
 #include <iosfwd>
 
 namespace likely {
-    // Accumulates statistics to estimate the covariance of a dataset.
+    // Accumulates statistics to estimate the covariance of a dataset. The running weighted
+    // means and co-moments are stored in flat aligned arrays and updated using the
+    // numerically stable incremental algorithm of West (1979), with a single packed BLAS
+    // rank-1 update per accumulated vector.
 	class CovarianceAccumulator {
 	public:
 	    // Create a new accumulator for vectors of the specified size.
@@ -20,10 +23,23 @@ namespace likely {
 		// Accumulate a single vector using the specified weight.
         void accumulate(std::vector<double> const &vector, double wgt = 1);
         void accumulate(double const *vector, double wgt = 1);
-        // Accumulate the data vector of a BinnedData object.
+        // Accumulates a block of nsamples vectors stored in column-major order, so that
+        // vector k occupies samples[k*size] to samples[k*size+size-1], using the
+        // specified per-vector weights or else unit weights if weights is null. The block
+        // is processed in chunks, each of which updates our second moments with a single
+        // BLAS rank-k update, which is much faster than accumulating each vector separately.
+        void accumulateBatch(double const *samples, int nsamples, double const *weights = 0);
+        // Accumulate the (unweighted) data vector of a BinnedData object.
         void accumulate(BinnedDataCPtr data, double wgt = 1);
+        // Merges the statistics accumulated by another accumulator of the same size into
+        // our statistics, using the pairwise formulas of Chan, Golub & LeVeque (1979). The
+        // result is equivalent (up to rounding) to having accumulated all of the other's
+        // vectors directly, so partial results from independent threads can be combined.
+        void merge(CovarianceAccumulator const &other);
         // Returns the number of vectors accumulated so far.
         int count() const;
+        // Returns the sum of weights of the vectors accumulated so far.
+        double sumOfWeights() const;
         // Return the estimated covariance matrix of all vectors accumulated so far.
         // The result may not be positive definite (and this is not checked here)
         // but this can usually be fixed by accumulating more samples.
@@ -3,14 +3,22 @@
 #include "likely/CovarianceMatrix.h"
 #include "likely/RuntimeError.h"
 #include "likely/Random.h"
+#include "likely/BinaryIO.h"
 
 #include "boost/format.hpp"
 #include "boost/lexical_cast.hpp"
 #include "boost/smart_ptr.hpp"
+#include "boost/cstdint.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/bind.hpp"
+#include "boost/ref.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
 // Declare bindings to BLAS,LAPACK routines we need
 extern "C" {
@@ -18,6 +26,9 @@ extern "C" {
     void dpptrf_(char const *uplo, int const *n, double *ap, int *info);
     // http://www.netlib.org/lapack/double/dpptri.f
     void dpptri_(char const *uplo, int const *n, double *ap, int *info);
+    // http://netlib.org/blas/dspr.f
+    void dspr_(char const *uplo, int const *n, double const *alpha, double const *x,
+        int const *incx, double *ap);
     // http://netlib.org/blas/dspmv.f
     void dspmv_(char const *uplo, int const *n, double const *alpha, double const *ap,
         double const *x, int const *incx, double const *beta, double *y, int const *incy);
@@ -29,16 +40,34 @@ extern "C" {
     void dsyrk_(char const *uplo, char const *trans, int const *n, int const *k,
         double const *alpha, double const *a, int const *lda, double const *beta,
         double *c, int const *ldc);
+    // http://www.netlib.org/lapack/double/dpotrf.f
+    void dpotrf_(char const *uplo, int const *n, double *a, int const *lda, int *info);
+    // http://www.netlib.org/lapack/double/dpotri.f
+    void dpotri_(char const *uplo, int const *n, double *a, int const *lda, int *info);
+    // http://www.netlib.org/lapack/double/dsyevd.f
+    void dsyevd_(char const *jobz, char const *uplo, int const *n, double *a, int const *lda,
+        double *w, double *work, int const *lwork, int *iwork, int const *liwork, int *info);
     // http://www.netlib.org/lapack/double/dspevd.f
     void dspevd_(char const *jobz, char const *uplo, int const *n, double *ap, double *w,
         double *z, int const *ldz, double *work, int const *lwork, int *iwork,
         int const *liwork, int *info);
+    // http://www.netlib.org/lapack/double/dsyevr.f
+    void dsyevr_(char const *jobz, char const *range, char const *uplo, int const *n, double *a,
+        int const *lda, double const *vl, double const *vu, int const *il, int const *iu,
+        double const *abstol, int *m, double *w, double *z, int const *ldz, int *isuppz,
+        double *work, int const *lwork, int *iwork, int const *liwork, int *info);
+    // http://www.netlib.org/lapack/double/dspevx.f
+    void dspevx_(char const *jobz, char const *range, char const *uplo, int const *n, double *ap,
+        double const *vl, double const *vu, int const *il, int const *iu, double const *abstol,
+        int *m, double *w, double *z, int const *ldz, double *work, int *iwork, int *ifail,
+        int *info);
 }
 
 namespace local = likely;
 
 local::CovarianceMatrix::CovarianceMatrix(int size)
-: _size(size), _compressed(false), _logDeterminant(0)
+: _size(size), _compressed(false), _logDeterminant(0), _compressionThreshold(0),
+_compressionError(0), _singlePrecision(false), _eigenFirst(0)
 {
     if(size <= 0) {
         throw RuntimeError("CovarianceMatrix: expected size > 0.");
@@ -49,7 +78,8 @@ local::CovarianceMatrix::CovarianceMatrix(int size)
 }
 
 local::CovarianceMatrix::CovarianceMatrix(std::vector<double> packed)
-: _ncov(packed.size()), _compressed(false), _logDeterminant(0)
+: _ncov(packed.size()), _compressed(false), _logDeterminant(0), _compressionThreshold(0),
+_compressionError(0), _singlePrecision(false), _eigenFirst(0)
 {
     if(_ncov == 0) {
         throw RuntimeError("CovarianceMatrix: expected packed size > 0.");
@@ -83,60 +113,238 @@ void local::swap(CovarianceMatrix& a, CovarianceMatrix& b) {
     swap(a._icov,b._icov);
     swap(a._cholesky,b._cholesky);
     swap(a._diag,b._diag);
-    swap(a._offdiagIndex,b._offdiagIndex);
     swap(a._offdiagValue,b._offdiagValue);
+    swap(a._offdiagRuns,b._offdiagRuns);
+    swap(a._offdiagFloat,b._offdiagFloat);
+    swap(a._compressionThreshold,b._compressionThreshold);
+    swap(a._compressionError,b._compressionError);
+    swap(a._singlePrecision,b._singlePrecision);
+    swap(a._eigenFirst,b._eigenFirst);
+    swap(a._eigenvalues,b._eigenvalues);
+    swap(a._eigenvectors,b._eigenvectors);
 }
 
 size_t local::CovarianceMatrix::getMemoryUsage() const {
     return sizeof(*this) + sizeof(double)*(
         _cov.capacity() + _icov.capacity() + _cholesky.capacity() +
-        _diag.capacity() + _offdiagIndex.capacity() + _offdiagValue.capacity());
+        _diag.capacity() + _offdiagValue.capacity() +
+        _eigenvalues.capacity() + _eigenvectors.capacity()) +
+        sizeof(int)*_offdiagRuns.capacity() + sizeof(float)*_offdiagFloat.capacity();
 }
 
 std::string local::CovarianceMatrix::getMemoryState() const {
-    return boost::str(boost::format("[%c%c%c%c%c%c%c] %d") %
+    return boost::str(boost::format("[%c%c%c%c%c%c%c%c] %d") %
         _tag('M',_cov) % _tag('I',_icov) % _tag('C',_cholesky) % (_logDeterminant == 0 ? '-':'L') %
-        _tag('D',_diag) % _tag('Z',_offdiagIndex) % _tag('V',_offdiagValue) % getMemoryUsage());
+        _tag('D',_diag) % _tag('Z',_offdiagRuns) %
+        (_singlePrecision ? _tag('V',_offdiagFloat) : _tag('V',_offdiagValue)) %
+        _tag('E',_eigenvalues) % getMemoryUsage());
 }
 
-char local::CovarianceMatrix::_tag(char symbol, std::vector<double> const &vector) const {
+template <class T>
+char local::CovarianceMatrix::_tag(char symbol, std::vector<T> const &vector) const {
     if(0 == vector.capacity()) return '-';
     if(0 == vector.size()) return std::tolower(symbol);
     return symbol;
 }
 
-bool local::CovarianceMatrix::compress() const {
+bool local::CovarianceMatrix::compress(double threshold, bool singlePrecision) const {
+    if(threshold < 0) {
+        throw RuntimeError("CovarianceMatrix::compress: expected threshold >= 0.");
+    }
     // Are we already compressed?
     if(_compressed) return false;
+    // Is our cached compressed data (if any) built with different options?
+    if(!_diag.empty() && (threshold != _compressionThreshold || singlePrecision != _singlePrecision)) {
+        _dropCompressed();
+    }
     // Do we still have valid compressed data?
     if(_diag.empty()) {
-        // Reserve space for the diagonal elements, which cannot be compressed.
-        _diag.reserve(_size);
         // Prepare to read the inverse covariance and check if anything been allocated yet.
         if(!_readsICov()) return false;
-        // Loop over the upper-diagonal (row <= col) inverse matrix elements.
-        int index(0);
-        double value;
+        // Reserve space for the diagonal elements, which cannot be compressed.
+        _diag.reserve(_size);
+        for(int k = 0; k < _size; ++k) _diag.push_back(_icov[(k*(k+3))/2]);
+        // Loop over the upper-diagonal (row < col) inverse matrix elements, building runs
+        // of consecutive elements that we keep.
+        int index(0), runStart(-1);
+        double error(0);
         for(int col = 0; col < _size; ++col) {
             for(int row = 0; row < col; ++row) {
-                // double parentheses here to tell clang that the '=' below isn't a typo.
-                if((value = _icov[index])) {
-                    _offdiagIndex.push_back(index);
-                    _offdiagValue.push_back(value);
+                double value(_icov[index]);
+                double norm(std::sqrt(std::fabs(_diag[row]*_diag[col])));
+                if(std::fabs(value) <= threshold*norm) {
+                    // Drop this element.
+                    if(value != 0) error = std::max(error,std::fabs(value)/norm);
+                    runStart = -1;
+                }
+                else {
+                    // Keep this element, starting a new run if necessary.
+                    if(runStart < 0) {
+                        runStart = index;
+                        _offdiagRuns.push_back(index);
+                        _offdiagRuns.push_back(0);
+                    }
+                    _offdiagRuns.back()++;
+                    if(singlePrecision) {
+                        float rounded(value);
+                        _offdiagFloat.push_back(rounded);
+                        if(norm > 0) error = std::max(error,std::fabs(value - rounded)/norm);
+                    }
+                    else {
+                        _offdiagValue.push_back(value);
+                    }
                 }
                 index++;
             }
-            _diag.push_back(_icov[index++]);
+            // Skip over the diagonal element, which ends any run.
+            index++;
+            runStart = -1;
         }
+        // Release any unused capacity left over from building our vectors.
+        std::vector<int>(_offdiagRuns).swap(_offdiagRuns);
+        std::vector<double>(_offdiagValue).swap(_offdiagValue);
+        std::vector<float>(_offdiagFloat).swap(_offdiagFloat);
+        _compressionThreshold = threshold;
+        _compressionError = error;
+        _singlePrecision = singlePrecision;
+        // Our cached log(determinant) is no longer valid if we dropped any information.
+        if(error > 0) _logDeterminant = 0;
     }
     // Delete anything we don't need now.
     if(!_cov.empty()) std::vector<double>().swap(_cov);
     if(!_icov.empty()) std::vector<double>().swap(_icov);
     if(!_cholesky.empty()) std::vector<double>().swap(_cholesky);
+    _dropEigenModes();
     _compressed = true;
     return true;
 }
 
+void local::CovarianceMatrix::_dropCompressed() const {
+    if(_diag.empty()) return;
+    std::vector<double>().swap(_diag);
+    std::vector<double>().swap(_offdiagValue);
+    std::vector<int>().swap(_offdiagRuns);
+    std::vector<float>().swap(_offdiagFloat);
+}
+
+void local::CovarianceMatrix::_readsEigenModes(int first, int count) const {
+    // Do our cached modes already cover the requested range?
+    if(first >= _eigenFirst && first + count <= _eigenFirst + (int)_eigenvalues.size()) return;
+    if(!_readsICov()) {
+        throw RuntimeError("CovarianceMatrix: no eigenmodes (no elements set yet).");
+    }
+    // Solve into temporary vectors so that our cache is unchanged if the solver fails.
+    std::vector<double> eigenvalues,eigenvectors;
+    if(0 == first && count == _size) {
+        symmetricMatrixEigenSolve(_icov,eigenvalues,eigenvectors,_size);
+    }
+    else {
+        symmetricMatrixPartialEigenSolve(_icov,first,count,eigenvalues,eigenvectors,_size);
+    }
+    _eigenvalues.swap(eigenvalues);
+    _eigenvectors.swap(eigenvectors);
+    _eigenFirst = first;
+}
+
+void local::CovarianceMatrix::_dropEigenModes() const {
+    if(_eigenvalues.empty()) return;
+    std::vector<double>().swap(_eigenvalues);
+    std::vector<double>().swap(_eigenvectors);
+}
+
+namespace {
+    // Returns the column of the specified index into a packed upper-diagonal matrix.
+    int packedColumn(int index) {
+        int col((int)((std::sqrt(8.*index+1)-1)/2));
+        // Correct for any rounding errors.
+        while((col*(col+1))/2 > index) col--;
+        while(((col+1)*(col+2))/2 <= index) col++;
+        return col;
+    }
+}
+
+void local::CovarianceMatrix::writeBinary(std::ostream &os) const {
+    // Prepare to read our inverse, unless we are compressed.
+    if(!_compressed && !_readsICov()) {
+        throw RuntimeError("CovarianceMatrix::writeBinary: no elements have been set.");
+    }
+    // The header records our size, the number of compressed off-diagonal runs (or -1 if
+    // we are not compressed), the number of compressed off-diagonal values and whether
+    // they are stored as floats, followed by our cached log(determinant) and compression
+    // options.
+    boost::int32_t nRuns(_compressed ? _offdiagRuns.size()/2 : -1);
+    boost::int32_t nValues(_singlePrecision ? _offdiagFloat.size() : _offdiagValue.size());
+    boost::int32_t header[4] = { _size, nRuns, _compressed ? nValues : 0, _singlePrecision };
+    double options[3] = { _logDeterminant, _compressionThreshold, _compressionError };
+    binary::writeArray(os,header,4);
+    binary::writeArray(os,options,3);
+    if(_compressed) {
+        binary::writeArray(os,&_diag[0],_size);
+        if(nRuns > 0) {
+            binary::writeArray(os,&_offdiagRuns[0],2*nRuns);
+            if(_singlePrecision) {
+                binary::writeArray(os,&_offdiagFloat[0],nValues);
+            }
+            else {
+                binary::writeArray(os,&_offdiagValue[0],nValues);
+            }
+        }
+    }
+    else {
+        binary::writeArray(os,&_icov[0],_ncov);
+    }
+}
+
+local::CovarianceMatrixPtr local::CovarianceMatrix::readBinary(std::istream &is) {
+    static const std::string context("CovarianceMatrix::readBinary");
+    boost::int32_t header[4];
+    double options[3];
+    binary::readArray(is,header,4,context);
+    binary::readArray(is,options,3,context);
+    CovarianceMatrixPtr matrix(new CovarianceMatrix(header[0]));
+    int size(matrix->_size), nRuns(header[1]), nValues(header[2]);
+    if(nRuns >= 0) {
+        if(nValues < 0 || nValues > (size*(size-1))/2 || nRuns > nValues) {
+            throw RuntimeError("CovarianceMatrix::readBinary: invalid number of elements.");
+        }
+        binary::readArray(is,matrix->_diag,size,context);
+        std::vector<int> &runs(matrix->_offdiagRuns);
+        binary::readArray(is,runs,2*nRuns,context);
+        // Check that the runs are consistent with our size and number of values.
+        long total(0);
+        for(int run = 0; run < nRuns; ++run) {
+            int start(runs[2*run]), length(runs[2*run+1]);
+            if(start < 0 || length <= 0 || start >= matrix->_ncov) {
+                throw RuntimeError("CovarianceMatrix::readBinary: invalid run.");
+            }
+            // Each run must end above the diagonal.
+            int col(packedColumn(start));
+            if(start + length > (col*(col+3))/2) {
+                throw RuntimeError("CovarianceMatrix::readBinary: invalid run.");
+            }
+            total += length;
+        }
+        if(total != nValues) {
+            throw RuntimeError("CovarianceMatrix::readBinary: invalid number of elements.");
+        }
+        matrix->_singlePrecision = (0 != header[3]);
+        if(matrix->_singlePrecision) {
+            binary::readArray(is,matrix->_offdiagFloat,nValues,context);
+        }
+        else {
+            binary::readArray(is,matrix->_offdiagValue,nValues,context);
+        }
+        matrix->_compressed = true;
+    }
+    else {
+        binary::readArray(is,matrix->_icov,matrix->_ncov,context);
+    }
+    matrix->_logDeterminant = options[0];
+    matrix->_compressionThreshold = options[1];
+    matrix->_compressionError = options[2];
+    return matrix;
+}
+
 void local::CovarianceMatrix::_uncompress() const {
     // Are we already decompressed?
     if(!_compressed) return;
@@ -145,8 +353,16 @@ void local::CovarianceMatrix::_uncompress() const {
     assert(0 == _cholesky.capacity());
     // Decompress the inverse covariance matrix.
     std::vector<double>(_ncov,0).swap(_icov);
-    for(int k = 0; k < _offdiagIndex.size(); ++k) {
-        _icov[_offdiagIndex[k]] = _offdiagValue[k];
+    int next(0);
+    for(int run = 0; run < _offdiagRuns.size(); run += 2) {
+        int start(_offdiagRuns[run]), length(_offdiagRuns[run+1]);
+        if(_singlePrecision) {
+            std::copy(&_offdiagFloat[next],&_offdiagFloat[next]+length,&_icov[start]);
+        }
+        else {
+            std::copy(&_offdiagValue[next],&_offdiagValue[next]+length,&_icov[start]);
+        }
+        next += length;
     }
     for(int k = 0; k < _size; ++k) {
         _icov[(k*(k+3))/2] = _diag[k];
@@ -173,13 +389,58 @@ int local::symmetricMatrixSize(int nelem) {
     return size;
 }
 
+namespace {
+    // Packed matrices with at least this many rows are processed in full storage.
+    int fullStorageThreshold(256);
+    // Copies the upper triangle of a packed 'U' matrix into full column-major storage.
+    // Elements below the diagonal are not initialized.
+    void unpackUpper(std::vector<double> const &packed, int size, std::vector<double> &full) {
+        full.resize(size*size);
+        double const *packedPtr(&packed[0]);
+        for(int col = 0; col < size; ++col) {
+            double *fullPtr(&full[col*size]);
+            for(int row = 0; row <= col; ++row) *fullPtr++ = *packedPtr++;
+        }
+    }
+    // Copies the upper triangle of a full column-major matrix into packed 'U' storage.
+    void packUpper(std::vector<double> const &full, int size, std::vector<double> &packed) {
+        double *packedPtr(&packed[0]);
+        for(int col = 0; col < size; ++col) {
+            double const *fullPtr(&full[col*size]);
+            for(int row = 0; row <= col; ++row) *packedPtr++ = *fullPtr++;
+        }
+    }
+}
+
+void local::setFullStorageThreshold(int size) {
+    if(size < 0) {
+        throw RuntimeError("setFullStorageThreshold: expected size >= 0.");
+    }
+    fullStorageThreshold = size;
+}
+
+int local::getFullStorageThreshold() {
+    return fullStorageThreshold;
+}
+
+bool local::useFullStorage(int size) {
+    return fullStorageThreshold > 0 && size >= fullStorageThreshold;
+}
+
 double local::choleskyDecompose(std::vector<double> &matrix, int size) {
     static char uplo('U');
-    static int info(0);
+    int info(0);
     if(0 == size) size = symmetricMatrixSize(matrix.size());
-    dpptrf_(&uplo,&size,&matrix[0],&info);
+    if(useFullStorage(size)) {
+        std::vector<double> full;
+        unpackUpper(matrix,size,full);
+        dpotrf_(&uplo,&size,&full[0],&size,&info);
+        if(0 == info) packUpper(full,size,matrix);
+    }
+    else {
+        dpptrf_(&uplo,&size,&matrix[0],&info);
+    }
     if(0 != info) {
-        info = 0;
         throw RuntimeError("choleskyDecomposition: matrix is not positive definite.");
     }
     // Calculate and the product of diagonal Cholesky matrix elements squared.
@@ -192,19 +453,55 @@ double local::choleskyDecompose(std::vector<double> &matrix, int size) {
 
 void local::invertCholesky(std::vector<double> &matrix, int size) {
     static char uplo('U');
-    static int info(0);
+    int info(0);
     if(0 == size) size = symmetricMatrixSize(matrix.size());
-    dpptri_(&uplo,&size,&matrix[0],&info);
+    if(useFullStorage(size)) {
+        std::vector<double> full;
+        unpackUpper(matrix,size,full);
+        dpotri_(&uplo,&size,&full[0],&size,&info);
+        if(0 == info) packUpper(full,size,matrix);
+    }
+    else {
+        dpptri_(&uplo,&size,&matrix[0],&info);
+    }
     if(0 != info) {
-        info = 0;
         throw RuntimeError("invertCholesky: symmetric matrix inversion failed.");
     }
 } 
 
+double local::choleskyRankOneUpdate(std::vector<double> &cholesky, std::vector<double> vector,
+double weight, int size) {
+    if(0 == size) size = symmetricMatrixSize(cholesky.size());
+    if(vector.size() != size) {
+        throw RuntimeError("choleskyRankOneUpdate: incompatible matrix and vector sizes.");
+    }
+    // Absorb the magnitude of the weight into the vector.
+    double sign(weight > 0 ? +1 : -1), scale(std::sqrt(std::fabs(weight)));
+    for(int k = 0; k < size; ++k) vector[k] *= scale;
+    // See http://en.wikipedia.org/wiki/Cholesky_decomposition#Rank-one_update, written for
+    // the lower-triangular L = Ut, so that L(row,k) = U(k,row) is stored at k+row*(row+1)/2.
+    double logdet(0);
+    for(int k = 0; k < size; ++k) {
+        double &diag(cholesky[(k*(k+3))/2]);
+        double rsq(diag*diag + sign*vector[k]*vector[k]);
+        if(rsq <= 0) {
+            throw RuntimeError("choleskyRankOneUpdate: result is not positive definite.");
+        }
+        double r(std::sqrt(rsq)), c(r/diag), s(vector[k]/diag);
+        diag = r;
+        logdet += 2*std::log(r);
+        for(int row = k+1; row < size; ++row) {
+            double &L(cholesky[k+(row*(row+1))/2]);
+            L = (L + sign*s*vector[row])/c;
+            vector[row] = c*vector[row] - s*L;
+        }
+    }
+    return logdet;
+}
+
 void local::matrixSquare(std::vector<double> const &matrix, std::vector<double> &result,
 bool transposeLeft, int size) {
     static char uplo('U');
-    static int info(0);
     static double alpha(1),beta(0);
     // Calculate the matrix size, if necessary.
     if(0 == size) size = symmetricMatrixSize(matrix.size());
@@ -241,12 +538,25 @@ std::vector<double> const &vector, std::vector<double> &result) {
 void local::symmetricMatrixEigenSolve(std::vector<double> const &matrix,
 std::vector<double> &eigenvalues, std::vector<double> &eigenvectors, int size) {
     static char jobz('V'), uplo('U');
-    static int info(0);
+    int info(0);
     // Calculate the matrix size if it was not provided.
     if(0 == size) size = symmetricMatrixSize(matrix.size());
     // Allocate space for the eigenvalues and vectors.
     eigenvalues.resize(size), eigenvectors.resize(size*size);
-    {
+    if(useFullStorage(size)) {
+        // Solve in place in the eigenvectors array, which has the full storage layout.
+        unpackUpper(matrix,size,eigenvectors);
+        int workSize(1+6*size+2*size*size), iworkSize(3+5*size);
+        boost::scoped_array<double> work(new double[workSize]);
+        boost::scoped_array<int> iwork(new int[iworkSize]);
+        dsyevd_(&jobz,&uplo,&size,&eigenvectors[0],&size,&eigenvalues[0],
+            &work[0],&workSize,&iwork[0],&iworkSize,&info);
+        if(0 != info) {
+            throw RuntimeError("symmetricMatrixEigenSolve: failed with info = " +
+                boost::lexical_cast<std::string>(info));
+        }
+    }
+    else {
         // copy the input matrix since the algorithm overwrites it
         std::vector<double> matrixCopy(matrix);
         // allocate temporory workspaces
@@ -264,6 +574,54 @@ std::vector<double> &eigenvalues, std::vector<double> &eigenvectors, int size) {
     }   
 }
 
+void local::symmetricMatrixPartialEigenSolve(std::vector<double> const &matrix, int first, int count,
+std::vector<double> &eigenvalues, std::vector<double> &eigenvectors, int size) {
+    static char jobz('V'), range('I'), uplo('U');
+    static double unused(0);
+    int info(0), found(0);
+    if(0 == size) size = symmetricMatrixSize(matrix.size());
+    if(first < 0 || count <= 0 || first + count > size) {
+        throw RuntimeError("symmetricMatrixPartialEigenSolve: invalid range of eigenvalues.");
+    }
+    // LAPACK uses 1-based indices for the range of eigenvalues.
+    int il(first+1), iu(first+count);
+    // Use the smallest tolerance recommended for accurate eigenvectors.
+    double abstol(2*std::numeric_limits<double>::min());
+    // The eigenvalues array must have room for all eigenvalues.
+    eigenvalues.resize(size), eigenvectors.resize(count*size);
+    if(useFullStorage(size)) {
+        std::vector<double> full;
+        unpackUpper(matrix,size,full);
+        boost::scoped_array<int> isuppz(new int[2*count]);
+        // Query the optimal workspace sizes.
+        int workSize(-1), iworkSize(-1), iworkQuery;
+        double workQuery;
+        dsyevr_(&jobz,&range,&uplo,&size,&full[0],&size,&unused,&unused,&il,&iu,&abstol,&found,
+            &eigenvalues[0],&eigenvectors[0],&size,&isuppz[0],&workQuery,&workSize,
+            &iworkQuery,&iworkSize,&info);
+        workSize = (int)workQuery;
+        iworkSize = iworkQuery;
+        boost::scoped_array<double> work(new double[workSize]);
+        boost::scoped_array<int> iwork(new int[iworkSize]);
+        dsyevr_(&jobz,&range,&uplo,&size,&full[0],&size,&unused,&unused,&il,&iu,&abstol,&found,
+            &eigenvalues[0],&eigenvectors[0],&size,&isuppz[0],&work[0],&workSize,
+            &iwork[0],&iworkSize,&info);
+    }
+    else {
+        // copy the input matrix since the algorithm overwrites it
+        std::vector<double> matrixCopy(matrix);
+        boost::scoped_array<double> work(new double[8*size]);
+        boost::scoped_array<int> iwork(new int[5*size]), ifail(new int[size]);
+        dspevx_(&jobz,&range,&uplo,&size,&matrixCopy[0],&unused,&unused,&il,&iu,&abstol,&found,
+            &eigenvalues[0],&eigenvectors[0],&size,&work[0],&iwork[0],&ifail[0],&info);
+    }
+    if(0 != info || found != count) {
+        throw RuntimeError("symmetricMatrixPartialEigenSolve: failed with info = " +
+            boost::lexical_cast<std::string>(info));
+    }
+    eigenvalues.resize(count);
+}
+
 void local::CovarianceMatrix::prune(std::set<int> const &keep) {
     int newSize(keep.size());
     if(newSize == getSize()) return;
@@ -296,21 +654,18 @@ void local::CovarianceMatrix::prune(std::set<int> const &keep) {
     assert(0 == _icov.capacity());
     assert(0 == _cholesky.capacity());
     assert(0 == _diag.capacity());
-    assert(0 == _offdiagIndex.capacity());
     assert(0 == _offdiagValue.capacity());
+    assert(0 == _offdiagRuns.capacity());
+    assert(0 == _offdiagFloat.capacity());
 }
 
 void local::CovarianceMatrix::_changesCov() {
     _uncompress();
     // Any cached determinant is now invalid.
     _logDeterminant = 0;
-    // Any cached compressed matrix data is now invalid so delete it.
-    if(!_diag.empty()) {
-        // TODO: use resize(0) instead?
-        std::vector<double>().swap(_diag);
-        std::vector<double>().swap(_offdiagIndex);
-        std::vector<double>().swap(_offdiagValue);
-    }
+    // Any cached compressed matrix data and eigenmodes are now invalid so delete them.
+    _dropCompressed();
+    _dropEigenModes();
     // Do we have a matrix to change?
     if(_cov.empty()) {
         // Have we allocated anything yet?
@@ -345,13 +700,9 @@ void local::CovarianceMatrix::_changesICov() {
     _uncompress();
     // Any cached determinant is now invalid.
     _logDeterminant = 0;
-    // Any cached compressed matrix data is now invalid so delete it.
-    if(!_diag.empty()) {
-        // TODO: use resize(0) instead?
-        std::vector<double>().swap(_diag);
-        std::vector<double>().swap(_offdiagIndex);
-        std::vector<double>().swap(_offdiagValue);
-    }
+    // Any cached compressed matrix data and eigenmodes are now invalid so delete them.
+    _dropCompressed();
+    _dropEigenModes();
     // Do we have a matrix to change?
     if(_icov.empty()) {
         // Have we allocated anything yet?
@@ -510,6 +861,29 @@ void local::CovarianceMatrix::multiplyByCovariance(std::vector<double> &vector)
 }
 
 void local::CovarianceMatrix::multiplyByInverseCovariance(std::vector<double> &vector) const {
+    if(_compressed) {
+        if(vector.size() != _size) {
+            throw RuntimeError("CovarianceMatrix::multiplyByInverseCovariance: vector has wrong size.");
+        }
+        // Multiply directly using our compressed representation.
+        std::vector<double> result(_size);
+        for(int k = 0; k < _size; ++k) result[k] = _diag[k]*vector[k];
+        int next(0);
+        for(int run = 0; run < _offdiagRuns.size(); run += 2) {
+            int start(_offdiagRuns[run]), length(_offdiagRuns[run+1]);
+            int col(packedColumn(start)), row(start - (col*(col+1))/2);
+            double sum(0), vcol(vector[col]);
+            for(int k = 0; k < length; ++k) {
+                double value(_singlePrecision ? _offdiagFloat[next+k] : _offdiagValue[next+k]);
+                result[row+k] += value*vcol;
+                sum += value*vector[row+k];
+            }
+            result[col] += sum;
+            next += length;
+        }
+        vector.swap(result);
+        return;
+    }
     _readsICov();
     std::vector<double> result;
     symmetricMatrixMultiply(_icov,vector,result);
@@ -517,22 +891,97 @@ void local::CovarianceMatrix::multiplyByInverseCovariance(std::vector<double> &v
 }
 
 double local::CovarianceMatrix::chiSquare(std::vector<double> const &delta) const {
-    std::vector<double> icovDelta = delta;
-    multiplyByInverseCovariance(icovDelta);
+    if(delta.size() != _size) {
+        throw RuntimeError("CovarianceMatrix::chiSquare: delta has wrong size.");
+    }
+    if(_compressed) {
+        // Evaluate delta.Cinv.delta directly using our compressed representation.
+        double diag(0), offdiag(0);
+        for(int k = 0; k < _size; ++k) diag += _diag[k]*delta[k]*delta[k];
+        int next(0);
+        for(int run = 0; run < _offdiagRuns.size(); run += 2) {
+            int start(_offdiagRuns[run]), length(_offdiagRuns[run+1]);
+            int col(packedColumn(start)), row(start - (col*(col+1))/2);
+            double sum(0);
+            if(_singlePrecision) {
+                float const *value = &_offdiagFloat[next];
+                for(int k = 0; k < length; ++k) sum += value[k]*delta[row+k];
+            }
+            else {
+                double const *value = &_offdiagValue[next];
+                for(int k = 0; k < length; ++k) sum += value[k]*delta[row+k];
+            }
+            offdiag += sum*delta[col];
+            next += length;
+        }
+        return diag + 2*offdiag;
+    }
+    if(!_readsICov()) {
+        throw RuntimeError("CovarianceMatrix::chiSquare: no elements have been set.");
+    }
+    // Evaluate delta.Cinv.delta directly from the packed upper triangle of Cinv, one
+    // column at a time, so that no temporary Cinv.delta vector is needed.
     double result(0);
-    for(int k = 0; k < delta.size(); ++k) {
-        result += delta[k]*icovDelta[k];
+    double const *column(&_icov[0]);
+    for(int col = 0; col < _size; ++col) {
+        double offdiag(0);
+        for(int row = 0; row < col; ++row) offdiag += column[row]*delta[row];
+        result += delta[col]*(2*offdiag + column[col]*delta[col]);
+        column += col+1;
     }
     return result;
 }
 
+void local::CovarianceMatrix::chiSquareBatch(std::vector<double> &deltas,
+std::vector<double> &chi2) const {
+    if(deltas.size() % _size != 0) {
+        throw RuntimeError("CovarianceMatrix::chiSquareBatch: deltas has wrong size.");
+    }
+    int nvec(deltas.size()/_size);
+    chi2.assign(nvec,0);
+    if(0 == nvec) return;
+    _readsCholesky();
+    // Process vectors in blocks that fit in a 256Kb cache, with at least one vector per block.
+    int blockSize(std::max(1,32768/_size));
+    for(int first = 0; first < nvec; first += blockSize) {
+        int last(std::min(nvec,first+blockSize));
+        // Solve Ut.y = delta for each vector in this block, one row of Ut at a time, so that
+        // each packed column of U is only read once per block. The solution y overwrites
+        // delta in place since y[j] only depends on delta[j] and y[0:j-1].
+        double const *column(&_cholesky[0]);
+        for(int j = 0; j < _size; ++j) {
+            double diag(column[j]);
+            for(int k = first; k < last; ++k) {
+                double *y(&deltas[k*_size]);
+                double sum(0);
+                for(int i = 0; i < j; ++i) sum += column[i]*y[i];
+                double value = (y[j] - sum)/diag;
+                y[j] = value;
+                chi2[k] += value*value;
+            }
+            column += j+1;
+        }
+    }
+}
+
 void local::CovarianceMatrix::getEigenModes(
 std::vector<double> &eigenvalues, std::vector<double> &eigenvectors) const {
-    // Solve our eigensystem for Cinv
+    // Solve our eigensystem for Cinv, if necessary.
     // TODO: if only C is available, solve its eigensystem instead, remembering to transform
     // lambda -> 1/lambda and to reverse eigenvalues vector.
-    _readsICov();
-    symmetricMatrixEigenSolve(_icov,eigenvalues,eigenvectors,_size);    
+    getEigenModes(0,_size,eigenvalues,eigenvectors);
+}
+
+void local::CovarianceMatrix::getEigenModes(int first, int count,
+std::vector<double> &eigenvalues, std::vector<double> &eigenvectors) const {
+    if(first < 0 || count <= 0 || first + count > _size) {
+        throw RuntimeError("CovarianceMatrix::getEigenModes: invalid range of modes.");
+    }
+    _readsEigenModes(first,count);
+    // Copy the requested modes from our cache.
+    int offset(first - _eigenFirst);
+    eigenvalues.assign(&_eigenvalues[offset],&_eigenvalues[offset]+count);
+    eigenvectors.assign(&_eigenvectors[offset*_size],&_eigenvectors[offset*_size]+count*_size);
 }
 
 double local::CovarianceMatrix::chiSquareModes(std::vector<double> const &delta,
@@ -564,26 +1013,41 @@ void local::CovarianceMatrix::rescaleEigenvalues(std::vector<double> const &scal
     if(scales.size() != _size) {
         throw RuntimeError("CovarianceMatrix::rescaleEigenvalues: bad size for scales.");
     }
-    // Solve our eigensystem for Cinv
-    _changesICov();
-    std::vector<double> eigenvalues,eigenvectors;
-    symmetricMatrixEigenSolve(_icov,eigenvalues,eigenvectors,_size);
-    // Rescale each eigenvalue.
-    std::vector<double> scaleFactors(eigenvalues);
+    // Find the range of modes that are actually rescaled.
+    int first(_size), last(-1);
     for(int j = 0; j < _size; ++j) {
         if(scales[j] <= 0) throw RuntimeError("CovarianceMatrix::rescaleEigenvalues: got scale <= 0.");
-        // The sqrt is because we will be use matrixSquare below.
-        scaleFactors[j] = std::sqrt(eigenvalues[j]/scales[j]);
+        if(scales[j] == 1) continue;
+        if(first == _size) first = j;
+        last = j;
     }
-    // Next we replace X with S.X where S is a diagonal matrix of scaleFactors and X[j*size+i] is
+    if(last < 0) return;
+    int count(last-first+1);
+    // Solve our eigensystem for Cinv, or use our cached modes, before we change anything.
+    std::vector<double> eigenvalues,eigenvectors;
+    getEigenModes(first,count,eigenvalues,eigenvectors);
+    _changesICov();
+    if(count < _size) {
+        // Add the change lambda*(1/scale-1) in each rescaled eigenvalue lambda of Cinv
+        // to our existing Cinv, one mode at a time.
+        static char uplo('U');
+        static int incr(1);
+        for(int k = 0; k < count; ++k) {
+            double alpha(eigenvalues[k]*(1/scales[first+k]-1));
+            if(0 == alpha) continue;
+            dspr_(&uplo,&_size,&alpha,&eigenvectors[k*_size],&incr,&_icov[0]);
+        }
+        return;
+    }
+    // Next we replace X with S.X where S is a diagonal matrix of scale factors and X[j*size+i] is
     // the i-th element of the j-th eigenvector.
     int index(0);
     // Loop over eigenvectors
     for(int j = 0; j < _size; ++j) {
+        // The sqrt is because we will be use matrixSquare below.
         double scale = std::sqrt(eigenvalues[j]/scales[j]);
         // Loop over components of this eigenvector
         for(int i = 0; i < _size; ++i) {
-            //eigenvectors[index++] *= scaleFactors[i];
             eigenvectors[index++] *= scale;
         }
     }
@@ -626,13 +1090,9 @@ void local::CovarianceMatrix::replaceWithTripleProduct(CovarianceMatrix const &o
     if(other.getSize() != _size) {
         throw RuntimeError("CovarianceMatrix::addInverse: incompatible sizes.");
     }
-    // Any cached compressed matrix data is now invalid so delete it.
-    if(!_diag.empty()) {
-        // TODO: use resize(0) instead?
-        std::vector<double>().swap(_diag);
-        std::vector<double>().swap(_offdiagIndex);
-        std::vector<double>().swap(_offdiagValue);
-    }
+    // Any cached compressed matrix data and eigenmodes are now invalid so delete them.
+    _dropCompressed();
+    _dropEigenModes();
     // Instead of calculating C -> A.Cinv.A we calculate Cinv -> Ainv.C.Ainv using:
     //
     //   Ainv.C.Ainv = Ainv.U*.U.Ainv = (U.Ainv)*.(U.Ainv)
@@ -818,8 +1278,8 @@ std::vector<std::string> const &labels) const {
 }
 
 void local::CovarianceMatrix::addInverse(CovarianceMatrix const &other, double weight) {
-    if(weight <= 0) {
-        throw RuntimeError("CovarianceMatrix::addInverse: expected weight > 0.");
+    if(0 == weight) {
+        throw RuntimeError("CovarianceMatrix::addInverse: expected weight != 0.");
     }
     if(other.getSize() != _size) {
         throw RuntimeError("CovarianceMatrix::addInverse: incompatible sizes.");
@@ -829,21 +1289,174 @@ void local::CovarianceMatrix::addInverse(CovarianceMatrix const &other, double w
         for(int k = 0; k < _size; ++k) {
             _icov[(k*(k+3))/2] += weight*other._diag[k];
         }
-        for(int k = 0; k < other._offdiagIndex.size(); ++k) {
-            _icov[other._offdiagIndex[k]] += weight*other._offdiagValue[k];
+        int next(0);
+        for(int run = 0; run < other._offdiagRuns.size(); run += 2) {
+            double *icov = &_icov[other._offdiagRuns[run]];
+            int length(other._offdiagRuns[run+1]);
+            if(other._singlePrecision) {
+                float const *value = &other._offdiagFloat[next];
+                for(int k = 0; k < length; ++k) icov[k] += weight*value[k];
+            }
+            else {
+                double const *value = &other._offdiagValue[next];
+                for(int k = 0; k < length; ++k) icov[k] += weight*value[k];
+            }
+            next += length;
         }
     }
     else {
-        for(int col = 0; col < _size; ++col) {
-            for(int row = 0; row <= col; ++row) {
-                double otherValue = other.getInverseCovariance(row,col);
-                double myValue = getInverseCovariance(row,col);
-                setInverseCovariance(row,col,myValue+weight*otherValue);
+        if(!other._readsICov()) {
+            throw RuntimeError("CovarianceMatrix::addInverse: other matrix has no elements set.");
+        }
+        _changesICov();
+        for(int index = 0; index < _ncov; ++index) _icov[index] += weight*other._icov[index];
+        // Check that our diagonal elements are still positive.
+        for(int k = 0; k < _size; ++k) {
+            if(_icov[(k*(k+3))/2] <= 0) {
+                throw RuntimeError("CovarianceMatrix::addInverse: diagonal elements must be > 0.");
             }
         }
     }
 }
 
+void local::CovarianceMatrix::addInverse(std::vector<CovarianceMatrixCPtr> const &others,
+std::vector<double> const &weights, int nThreads) {
+    if(others.size() != weights.size()) {
+        throw RuntimeError("CovarianceMatrix::addInverse: wrong number of weights.");
+    }
+    if(nThreads <= 0) {
+        throw RuntimeError("CovarianceMatrix::addInverse: expected nThreads > 0.");
+    }
+    // Prepare each input for reading now, since this might change its internal state.
+    for(int k = 0; k < others.size(); ++k) {
+        CovarianceMatrix const *other(others[k].get());
+        if(0 == other || other == this) {
+            throw RuntimeError("CovarianceMatrix::addInverse: invalid matrix.");
+        }
+        if(0 == weights[k]) {
+            throw RuntimeError("CovarianceMatrix::addInverse: expected weight != 0.");
+        }
+        if(other->getSize() != _size) {
+            throw RuntimeError("CovarianceMatrix::addInverse: incompatible sizes.");
+        }
+        if(!other->isCompressed() && !other->_readsICov()) {
+            throw RuntimeError("CovarianceMatrix::addInverse: other matrix has no elements set.");
+        }
+    }
+    if(0 == others.size()) return;
+    _changesICov();
+    if(nThreads > 1) {
+        // Give each thread a contiguous range of our packed inverse.
+        boost::thread_group threads;
+        for(int thread = 0; thread < nThreads; ++thread) {
+            int begin((long)_ncov*thread/nThreads), end((long)_ncov*(thread+1)/nThreads);
+            if(begin == end) continue;
+            threads.create_thread(boost::bind(&CovarianceMatrix::_addInverseRange,this,
+                boost::cref(others),boost::cref(weights),begin,end));
+        }
+        threads.join_all();
+    }
+    else {
+        _addInverseRange(others,weights,0,_ncov);
+    }
+    // Check that our diagonal elements are still positive.
+    for(int k = 0; k < _size; ++k) {
+        if(_icov[(k*(k+3))/2] <= 0) {
+            throw RuntimeError("CovarianceMatrix::addInverse: diagonal elements must be > 0.");
+        }
+    }
+}
+
+void local::CovarianceMatrix::_addInverseRange(std::vector<CovarianceMatrixCPtr> const &others,
+std::vector<double> const &weights, int begin, int end) {
+    // The number of packed elements in each block of our inverse (16 Kb).
+    static const int blockSize(2048);
+    int nmat(others.size());
+    // Find the first run of each compressed matrix that ends after begin, and the offset
+    // of its first value.
+    std::vector<int> run(nmat,0), next(nmat,0);
+    for(int k = 0; k < nmat; ++k) {
+        CovarianceMatrix const &other(*others[k]);
+        if(!other._compressed) continue;
+        std::vector<int> const &runs(other._offdiagRuns);
+        while(run[k] < runs.size() && runs[run[k]] + runs[run[k]+1] <= begin) {
+            next[k] += runs[run[k]+1];
+            run[k] += 2;
+        }
+    }
+    for(int lo = begin; lo < end; lo += blockSize) {
+        int hi(std::min(lo + blockSize,end));
+        double *icov(&_icov[0]);
+        // Find the first diagonal element in this block.
+        int firstCol(packedColumn(lo));
+        if((firstCol*(firstCol+3))/2 < lo) firstCol++;
+        for(int k = 0; k < nmat; ++k) {
+            CovarianceMatrix const &other(*others[k]);
+            double weight(weights[k]);
+            if(!other._compressed) {
+                double const *otherICov(&other._icov[0]);
+                for(int index = lo; index < hi; ++index) icov[index] += weight*otherICov[index];
+                continue;
+            }
+            for(int col = firstCol; col < _size && (col*(col+3))/2 < hi; ++col) {
+                icov[(col*(col+3))/2] += weight*other._diag[col];
+            }
+            // Add the parts of any runs that overlap this block.
+            std::vector<int> const &runs(other._offdiagRuns);
+            while(run[k] < runs.size() && runs[run[k]] < hi) {
+                int start(runs[run[k]]), length(runs[run[k]+1]);
+                int from(std::max(start,lo)), to(std::min(start+length,hi));
+                int first(next[k] + from - start);
+                if(other._singlePrecision) {
+                    float const *value(&other._offdiagFloat[first]);
+                    for(int index = from; index < to; ++index) icov[index] += weight*(*value++);
+                }
+                else {
+                    double const *value(&other._offdiagValue[first]);
+                    for(int index = from; index < to; ++index) icov[index] += weight*(*value++);
+                }
+                // Does this run continue into the next block?
+                if(start + length > hi) break;
+                next[k] += length;
+                run[k] += 2;
+            }
+        }
+    }
+}
+
+void local::CovarianceMatrix::addRankOne(std::vector<double> const &vector, double weight) {
+    if(vector.size() != _size) {
+        throw RuntimeError("CovarianceMatrix::addRankOne: vector has wrong size.");
+    }
+    if(0 == weight) return;
+    // Make sure we have a Cholesky decomposition to update. This will also ensure that
+    // we have a covariance matrix.
+    _readsCholesky();
+    // Update a copy of the Cholesky decomposition first, so that we are unchanged if
+    // this would not be positive definite.
+    std::vector<double> cholesky(_cholesky);
+    double logdet = choleskyRankOneUpdate(cholesky,vector,weight,_size);
+    _cholesky.swap(cholesky);
+    _logDeterminant = logdet;
+    // Any cached compressed matrix data and eigenmodes are now invalid so delete them.
+    _dropCompressed();
+    _dropEigenModes();
+    static char uplo('U');
+    static int incr(1);
+    // Update the covariance, C -> C + weight*v.vt
+    dspr_(&uplo,&_size,&weight,&vector[0],&incr,&_cov[0]);
+    // Update any inverse covariance using the Sherman-Morrison formula:
+    // Cinv -> Cinv - weight*(Cinv.v).(Cinv.v)t/(1 + weight*vt.Cinv.v)
+    if(!_icov.empty()) {
+        std::vector<double> icovVector;
+        symmetricMatrixMultiply(_icov,vector,icovVector);
+        double vCinvv(0);
+        for(int k = 0; k < _size; ++k) vCinvv += vector[k]*icovVector[k];
+        double alpha(-weight/(1 + weight*vCinvv));
+        dspr_(&uplo,&_size,&alpha,&icovVector[0],&incr,&_icov[0]);
+    }
+}
+
 int local::CovarianceMatrix::getNElements() const {
     // Prepare to read from the covariance matrix, and return zero if nothing has
     // been allocated yet.
@@ -919,6 +1532,8 @@ void local::CovarianceMatrix::applyScaleFactor(double scaleFactor) {
         for(int index = 0; index < _ncov; ++index) _cholesky[index] *= scale;
     }
     if(_logDeterminant != 0) _logDeterminant += _size*std::log(scaleFactor);
+    // Cached eigenmodes of the inverse covariance keep their eigenvectors and order.
+    for(int k = 0; k < _eigenvalues.size(); ++k) _eigenvalues[k] /= scaleFactor;
 }
 
 local::CovarianceMatrixPtr local::createDiagonalCovariance(int size, double diagonalValue) {
@@ -74,16 +74,38 @@ namespace likely {
         
         // Fills the vectors provided with the eigenvectors and eigenmodes of our inverse covariance.
         // Vectors are ordered by increasing inverse covariance eigenvalue, i.e., from large to small
-        // variance. See symmetricMatrixEigenSolve for details.
+        // variance. See symmetricMatrixEigenSolve for details. The modes are cached until our
+        // matrix changes or is compressed, so repeated calls only copy the cached modes.
         void getEigenModes(std::vector<double> &eigenvalues, std::vector<double> &eigenvectors) const;
+        // Fills the vectors provided with only the count eigenmodes starting from index first in
+        // the order used above, without calculating any other modes, which is much faster when
+        // count is small. See symmetricMatrixPartialEigenSolve for details. Uses any cached modes
+        // that cover the requested range, or else replaces the cache with the requested modes.
+        // Throws a RuntimeError for an invalid range.
+        void getEigenModes(int first, int count, std::vector<double> &eigenvalues,
+            std::vector<double> &eigenvectors) const;
 
         // Multiplies the specified vector by the (inverse) covariance or throws a RuntimeError.
         // The result is stored in the input vector, overwriting its original contents.
+        // Multiplying a compressed matrix by its inverse does not uncompress it, and only
+        // visits the stored elements.
         void multiplyByCovariance(std::vector<double> &vector) const;
         void multiplyByInverseCovariance(std::vector<double> &vector) const;
         // Calculates the chi-square = delta.Cinv.delta for the specified residuals vector delta
-        // or throws a RuntimeError.
+        // or throws a RuntimeError. No memory is allocated once our inverse is available, and
+        // a compressed matrix is evaluated directly from its stored elements without being
+        // uncompressed.
         double chiSquare(std::vector<double> const &delta) const;
+        // Calculates the chi-squares delta.Cinv.delta for a batch of K residual vectors stored
+        // consecutively in deltas, so that element j of vector k is deltas[k*size+j], and saves
+        // the results in chi2, which is resized to K. Uses forward substitution with our
+        // Cholesky decomposition C = Ut.U so that chi2[k] = |Ut^-1.delta[k]|^2, and processes
+        // vectors in cache-sized blocks so that U is only read once per block. This is faster
+        // than K separate calls to chiSquare and performs no memory allocation once a Cholesky
+        // decomposition is cached and chi2 has enough capacity. The deltas vector is used as
+        // workspace and contains the whitened residuals Ut^-1.delta on return. Throws a
+        // RuntimeError unless the size of deltas is a multiple of our size.
+        void chiSquareBatch(std::vector<double> &deltas, std::vector<double> &chi2) const;
         // Calculates the contributions to the chi-square for delta associated with each of
         // our eigenmodes, or throws a RuntimeError. Returns the chi-square value and fills the
         // vectors provided with the eigenvalues (in decreasing order), corresponding orthonormal
@@ -97,17 +119,39 @@ namespace likely {
         // Multiplies all elements of the covariance matrix by the specified positive scale factor.
         void applyScaleFactor(double scaleFactor);
         // Rescales the covariance eigenvalues, listed in decreasing order, with the specified
-        // vector of scale factors.
+        // vector of scale factors. Only the modes between the first and last scale factors
+        // different from one are calculated.
         void rescaleEigenvalues(std::vector<double> const &scales);
         // Replaces the original covariance matrix contents C with the triple matrix
         // product A.Cinv.A for the specified other covariance matrix A. For A,C both positive
         // definite, the result is a new (positive definite) covariance matrix.
         void replaceWithTripleProduct(CovarianceMatrix const &other);
         // Adds each element of the inverse of the specified CovarianceMatrix to our inverse
-        // elements, using the specified weight (which must be positive in order to preserve
-        // our positive-definiteness). If the other matrix is compressed, this method will
+        // elements, using the specified non-zero weight. A positive weight always preserves
+        // our positive-definiteness. A negative weight can be used to remove a matrix that
+        // was previously added, but it is then up to the caller to ensure that the result
+        // is still positive definite. If the other matrix is compressed, this method will
         // not uncompress it.
         void addInverse(CovarianceMatrix const &other, double weight = 1);
+        // Adds the inverses of several matrices with the corresponding non-zero weights, which
+        // is equivalent to calling addInverse for each matrix in turn but only makes a single
+        // pass through our inverse. Our packed inverse is divided into blocks that fit in cache,
+        // and the corresponding elements of every input matrix are added to one block before
+        // moving on to the next. The blocks are divided among nThreads threads. Compressed input
+        // matrices are not uncompressed. Throws a RuntimeError for incompatible inputs.
+        void addInverse(std::vector<CovarianceMatrixCPtr> const &others,
+            std::vector<double> const &weights, int nThreads = 1);
+        // Adds weight*v.vt to our covariance matrix C for the specified vector v, e.g., to add a
+        // systematic error template (weight > 0) or remove one that was previously added
+        // (weight < 0). A diagonal element can be changed by delta using a unit vector with
+        // weight = delta. Any existing covariance, inverse covariance (via the Sherman-Morrison
+        // formula), Cholesky decomposition and log(determinant) are updated in O(size^2)
+        // operations, instead of being invalidated and recalculated in O(size^3) the next
+        // time they are needed. The first call after a change by any other method needs one
+        // Cholesky decomposition, but subsequent calls do not. Throws a RuntimeError for a
+        // vector of the wrong size, or if the result would not be positive definite (in
+        // which case our matrix is not changed).
+        void addRankOne(std::vector<double> const &vector, double weight = 1);
 
         // Fills the vector provided with a single random sampling of the Gausian probability
         // density implied by this object, or throws a RuntimeError. Returns the value of
@@ -141,42 +185,71 @@ namespace likely {
             std::string format = std::string("%+10.3lg"),
             std::vector<std::string> const &labels = std::vector<std::string>()) const;
         // Requests that this covariance matrix be compressed to reduce its memory usage,
-        // if possible. Returns immediately if we are already compressed. Any compression
-        // is lossless. The next call to any method except getSize(), compress(), or isCompressed().
-        // will automatically trigger a decompression. However, a compressed matrix can be
-        // added to another matrix (via addInverse) without being uncompressed. Also, we may
-        // already have a cached log(determinant) value as a side effect of previous operations,
-        // which can be retrieved by getLogDeterminant() without uncompression. If determinant
-        // caching is an important optimization for your application, be sure to call
-        // getLogDeterminant() before calling compress(). Return value indicates if any
-        // compression was actually performed.
-        bool compress() const;
+        // if possible. Returns immediately if we are already compressed. The diagonal of the
+        // inverse covariance is always stored exactly, and its off-diagonal elements are stored
+        // as runs of consecutive packed elements, so that a banded or block-diagonal inverse
+        // only needs a (start,length) pair for each column besides its non-zero values. With
+        // the default arguments, only exact zeros are dropped and compression is lossless.
+        // Otherwise, off-diagonal elements with |Cinv(i,j)| <= threshold*sqrt(Cinv(i,i)*Cinv(j,j))
+        // are also dropped and, if singlePrecision is true, the remaining off-diagonal values
+        // are stored as floats. The resulting error bound is available from getCompressionError()
+        // and lossy compression permanently replaces the inverse covariance with its compressed
+        // approximation, which is not guaranteed to be positive definite for large thresholds.
+        // The next call to any method except getSize(), compress(), isCompressed(),
+        // getCompressionError(), chiSquare(), multiplyByInverseCovariance() or writeBinary()
+        // will automatically trigger a decompression. The chiSquare() and
+        // multiplyByInverseCovariance() methods work directly on the compressed form, and a
+        // compressed matrix can also be added to another matrix (via addInverse) without being
+        // uncompressed. Also, we may already have a cached log(determinant) value as a side
+        // effect of previous operations, which can be retrieved by getLogDeterminant() without
+        // uncompression, unless the compression was lossy. If determinant caching is an
+        // important optimization for your application, be sure to call getLogDeterminant()
+        // before calling compress(). Return value indicates if any compression was actually
+        // performed. Throws a RuntimeError if threshold < 0.
+        bool compress(double threshold = 0, bool singlePrecision = false) const;
+        // Returns an upper bound on the normalized error |dCinv(i,j)|/sqrt(Cinv(i,i)*Cinv(j,j))
+        // of any inverse covariance element introduced by the most recent compression, which
+        // is zero for a lossless compression or if we have never been compressed.
+        double getCompressionError() const;
         // Returns true if this covariance matrix is currently compressed.
         bool isCompressed() const;
+        // Writes this matrix to the specified stream in a native-endian binary format, as
+        // used by BinnedData::saveBinary. A compressed matrix is written in its compressed form
+        // and otherwise the packed inverse covariance is written, together with any cached
+        // log(determinant). The total number of bytes written is always a multiple of 8.
+        // Throws a RuntimeError if no elements have been set.
+        void writeBinary(std::ostream &os) const;
+        // Creates a new matrix from the binary data at the current position of the specified
+        // stream, as written by writeBinary. The matrix is restored to the same (compressed or
+        // uncompressed) state with each array read directly into place in a single bulk read,
+        // so no parsing or matrix inversion is required. On return, the stream is positioned
+        // after the data read. Throws a RuntimeError if the input is invalid or truncated.
+        static CovarianceMatrixPtr readBinary(std::istream &is);
         // Returns the memory usage of this object.
         std::size_t getMemoryUsage() const;
         // Returns a string describing this object's internal state in the form
         // 
-        // [MICDZV] nnnnnnn
+        // [MICLDZVE] nnnnnnn
         //
         // where each letter indicates the memory allocation state of an internal
         // vector and nnnnnn is the total number of bytes used by this object, as reported
         // by getMemoryUsage(). The letter codes are: M = _cov, I = _icov, C = _cholesky,
-        // L = log(det), D = _diag, Z = _offdiagIndex, V = _offdiagValue. A "-" indidcates
-        // that the vector is not allocated. A "." below is a wildcard. Lower case indicates
-        // that the vector has spaced reserved but is empty.
+        // L = log(det), D = _diag, Z = _offdiagRuns, V = _offdiagValue or _offdiagFloat,
+        // E = cached eigenmodes. A "-" indidcates that the vector is not allocated. A "." below
+        // is a wildcard. Lower case indicates that the vector has spaced reserved but is empty.
         //
-        // [----...] : newly created object with no elements set
-        // [M---...] : most recent change was to covariance matrix
-        // [-I--...] : most recent change was to inverse covariance matrix
-        // [MI-L...] : synchronized covariance and inverse covariance both in memory
-        // [--C....] : ** this should never happen **
-        // [M-CL...] : Cholesky decomposition and covariance in memory
-        // [-ICL...] : Cholesky decomposition and inverse covariance in memory
-        // [MICL...] : Cholesky decomposition, covariance and inverse covariance in memory
-        // [....D--] : Matrix is diagonal and compressed
-        // [...-DZV] : Matrix is non-diagonal and compressed without cached log(det)
-        // [...LDZV] : Matrix is non-diagonal and compressed with cached log(det)
+        // [----....] : newly created object with no elements set
+        // [M---....] : most recent change was to covariance matrix
+        // [-I--....] : most recent change was to inverse covariance matrix
+        // [MI-L....] : synchronized covariance and inverse covariance both in memory
+        // [--C.....] : ** this should never happen **
+        // [M-CL....] : Cholesky decomposition and covariance in memory
+        // [-ICL....] : Cholesky decomposition and inverse covariance in memory
+        // [MICL....] : Cholesky decomposition, covariance and inverse covariance in memory
+        // [....D---] : Matrix is diagonal and compressed
+        // [...-DZV-] : Matrix is non-diagonal and compressed without cached log(det)
+        // [...LDZV-] : Matrix is non-diagonal and compressed with cached log(det)
+        // [.I.....E] : Eigenmodes of the inverse covariance are cached
         std::string getMemoryState() const;
         
     private:
@@ -193,8 +266,19 @@ namespace likely {
         // Prepares to change at least one element of _cov or _icov.
         void _changesCov();
         void _changesICov();
+        // Deletes any cached compressed matrix data, which is invalidated by any change.
+        void _dropCompressed() const;
+        // Prepares to read the cached eigenmodes first,...,first+count-1 of _icov, calculating
+        // them if necessary.
+        void _readsEigenModes(int first, int count) const;
+        // Deletes any cached eigenmodes, which are invalidated by any change.
+        void _dropEigenModes() const;
+        // Adds the weighted packed inverse elements in [begin,end) of the specified matrices,
+        // which must already be prepared for reading, to our inverse.
+        void _addInverseRange(std::vector<CovarianceMatrixCPtr> const &others,
+            std::vector<double> const &weights, int begin, int end);
         // Helper function used by getMemoryState()
-        char _tag(char symbol, std::vector<double> const &vector) const;
+        template <class T> char _tag(char symbol, std::vector<T> const &vector) const;
 
         // TODO: is a cached value of _ncov = (_size*(_size+1))/2 really necessary?
         int _size, _ncov;
@@ -209,7 +293,19 @@ namespace likely {
         mutable std::vector<double> _cov, _icov, _cholesky;
         // compression replaces _cov, _icov, _cholesky with the following
         // smaller vectors, that encode the inverse covariance matrix (_icov not _cov).
-        mutable std::vector<double> _diag, _offdiagIndex, _offdiagValue;
+        // _offdiagRuns stores (start,length) pairs of packed off-diagonal index ranges whose
+        // values are stored consecutively in _offdiagValue, or _offdiagFloat when compressed
+        // with singlePrecision.
+        mutable std::vector<double> _diag, _offdiagValue;
+        mutable std::vector<int> _offdiagRuns;
+        mutable std::vector<float> _offdiagFloat;
+        // The options used to build our cached compressed data, and its error bound.
+        mutable double _compressionThreshold, _compressionError;
+        mutable bool _singlePrecision;
+        // Cached eigenmodes of _icov with indices starting from _eigenFirst, using the layout
+        // of symmetricMatrixPartialEigenSolve. Empty when no modes are cached.
+        mutable int _eigenFirst;
+        mutable std::vector<double> _eigenvalues, _eigenvectors;
 	}; // CovarianceMatrix
 	
     void swap(CovarianceMatrix& a, CovarianceMatrix& b);
@@ -217,6 +313,7 @@ namespace likely {
     inline int CovarianceMatrix::getSize() const { return _size; }
     
     inline bool CovarianceMatrix::isCompressed() const { return _compressed; }
+    inline double CovarianceMatrix::getCompressionError() const { return _compressionError; }
 
     // Returns the array offset index for the BLAS packed 'U' symmetric matrix format
     // described at http://www.netlib.org/lapack/lug/node123.html or throws a
@@ -233,6 +330,18 @@ namespace likely {
     // symmetricMatrixIndex, or throws a RuntimeError. The size is related to the
     // number nelem of packed matrix elements by size = (nelem*(nelem+1))/2.
     int symmetricMatrixSize(int nelem);
+    // Sets the matrix size at and above which choleskyDecompose, invertCholesky and
+    // symmetricMatrixEigenSolve temporarily unpack their packed 'U' input into full column-major
+    // storage in order to use the blocked (level-3 BLAS) LAPACK routines dpotrf, dpotri and
+    // dsyevd, which are much faster for large matrices than their packed equivalents, at the
+    // cost of a temporary size*size array. Packed storage is always used for the results,
+    // so this choice is transparent to callers. Use a size of zero to always use the packed
+    // routines. The default threshold is 256. This setting is global and should not be changed
+    // while other threads are using these functions. Throws a RuntimeError if size < 0.
+    void setFullStorageThreshold(int size);
+    int getFullStorageThreshold();
+    // Returns true if full storage will be used for a matrix of the specified size.
+    bool useFullStorage(int size);
     // Performs a Cholesky decomposition in place of a symmetric positive definite matrix
     // or throws a RuntimeError if the matrix is not positive definite. The input matrix
     // is assumed to be in the BLAS packed format implied by packedMatrixIndex(row,col).
@@ -245,6 +354,15 @@ namespace likely {
     // implied by packedMatrixIndex(row,col), e.g. by first calling _choleskyDecompose(matrix).
     // The matrix size will be calculated unless a positive value is provided.
     void invertCholesky(std::vector<double> &matrix, int size = 0);
+    // Updates in place the Cholesky decomposition U of a symmetric positive definite matrix
+    // M = Ut.U so that it becomes the decomposition of M + weight*v.vt, using O(size^2)
+    // Givens-like rotations. The input decomposition must be in the BLAS packed 'U' format
+    // implied by packedMatrixIndex(row,col), e.g. from choleskyDecompose(matrix). The matrix
+    // size will be calculated unless a positive value is provided. Returns the log(determinant)
+    // of the updated matrix, or throws a RuntimeError if a downdate (weight < 0) would not be
+    // positive definite, in which case the contents of the input decomposition are undefined.
+    double choleskyRankOneUpdate(std::vector<double> &cholesky, std::vector<double> vector,
+        double weight, int size = 0);
     // Multiplies a symmetric matrix by a vector, or throws a RuntimeError. The input matrix
     // is assumed to be in the BLAS packed 'U' format implied by packedMatrixIndex(row,col).
     void symmetricMatrixMultiply(std::vector<double> const &matrix,
@@ -262,6 +380,14 @@ namespace likely {
     // eigenvectors are orthonormal.
     void symmetricMatrixEigenSolve(std::vector<double> const &matrix,
         std::vector<double> &eigenvalues, std::vector<double> &eigenvectors, int size = 0);
+    // Solves for the count eigenvalues of a symmetric matrix starting from index first, in
+    // increasing order, and their eigenvectors, or throws a RuntimeError. The input matrix and
+    // size are as for symmetricMatrixEigenSolve. Eigenvectors are stored consecutively, so
+    // that eigenvectors[k*size+i] is element i of the eigenvector for eigenvalues[k]. Uses
+    // the LAPACK routines dsyevr (full storage) or dspevx (packed storage), which only
+    // calculate the requested eigenvectors.
+    void symmetricMatrixPartialEigenSolve(std::vector<double> const &matrix, int first, int count,
+        std::vector<double> &eigenvalues, std::vector<double> &eigenvectors, int size = 0);
         
     // Creates a diagonal covariance matrix with constant elements (first form) or specified
     // positive elements (second form).
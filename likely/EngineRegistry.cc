@@ -13,9 +13,16 @@
 #include "likely/MarkovChainEngine.h"
 
 #include "boost/regex.hpp"
+#include "boost/thread/mutex.hpp"
 
 namespace local = likely;
 
+namespace {
+    // Serializes engine registration and registry lookups, so that engines can be created
+    // concurrently in different threads.
+    boost::mutex registryMutex;
+}
+
 local::EngineRegistry &local::getEngineRegistry() {
     static EngineRegistry *registry = new EngineRegistry();
     return *registry;
@@ -23,6 +30,7 @@ local::EngineRegistry &local::getEngineRegistry() {
 
 local::AbsEnginePtr local::getEngine(std::string const methodName,
 FunctionPtr f, GradientCalculatorPtr gc, FitParameters const &parameters) {
+    boost::mutex::scoped_lock lock(registryMutex);
     // Trigger first-time registration of all engine implementations.
 #ifdef HAVE_LIBGSL
     registerGslEngineMethods();
@@ -46,6 +54,7 @@ FunctionPtr f, GradientCalculatorPtr gc, FitParameters const &parameters) {
     }
     // Create and return a new engine for this function.
     EngineFactory factory = found->second;
+    lock.unlock();
     AbsEnginePtr engine(factory(f,gc,parameters,algorithmName));
     return engine;
 }
@@ -117,14 +117,14 @@ int local::FunctionMinimum::findName(std::string const &name) const {
 }
 
 double local::FunctionMinimum::setRandomParameters(Parameters const &fromParams,
-Parameters &toParams) const {
+Parameters &toParams, RandomPtr random) const {
     if(!hasCovariance()) {
         throw RuntimeError(
             "FunctionMinimum::getRandomParameters: no covariance matrix available.");
     }
     // Generate random offsets for our floating parameters.
     std::vector<double> floating;
-    double nlWeight = _covar->sample(floating);
+    double nlWeight = _covar->sample(floating,random);
     std::vector<double>::const_iterator nextOffset(floating.begin());
     // Prepare to fill the parameter values vector we are provided.
     toParams=fromParams;
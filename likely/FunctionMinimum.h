@@ -60,8 +60,10 @@ namespace likely {
         void updateCovariance(CovarianceMatrixCPtr covariance);
         // Fills toParams by adding a vector sampled from our covariance matrix to the
         // input fromParams vector. Returns the -log(liklihood) associated with the random
-        // offset vector (see CovarianceMatrix::sample for details)
-        double setRandomParameters(const Parameters &fromParams, Parameters &toParams) const;
+        // offset vector (see CovarianceMatrix::sample for details). Uses the random generator
+        // provided or else the default Random::instance().
+        double setRandomParameters(const Parameters &fromParams, Parameters &toParams,
+            RandomPtr random = RandomPtr()) const;
         // Sets the number of times the function and its gradient have been evaluated to
         // obtain this estimate of the minimum.
         void setCounts(long nEvalCount, long nGradCount);
@@ -74,29 +74,27 @@ FitParameters const &parameters, std::string const &algorithm)
         // Check that we have a gradient calculator to use.
         if(!_gc) {
             throw RuntimeError(
-                "GslEngine: selected algorithm needs a gradient calculator.");
+                "GslEngine: selected algorithm needs a gradient calculator "
+                "(try createNumericalGradientCalculator).");
         }
         // Bind this function and its gradient calculator to our GSL global function
         _funcWithGradient.n = _nPar;
         _funcWithGradient.f = _evaluate;
         _funcWithGradient.df = _evaluateGradient;
         _funcWithGradient.fdf = _evaluateBoth;
-        _funcWithGradient.params = 0;
+        _funcWithGradient.params = this;
         _grad = Gradient(_nPar);        
     }
     else {
         // Bind this function to our GSL global function
         _func.n = _nPar;
         _func.f = _evaluate;
-        _func.params = 0;
+        _func.params = this;
     }
     _params = Parameters(_nPar);
-    _getEngineStack().push(this);        
 }
 
-local::GslEngine::~GslEngine() {
-    _getEngineStack().pop();
-}
+local::GslEngine::~GslEngine() { }
 
 void local::GslEngine::minimizeWithGradient(fdfMethod method, FunctionMinimumPtr fmin,
 double prec, long maxIterations, double lineMinTol) {
@@ -181,52 +179,47 @@ double prec, long maxIterations) {
 double local::GslEngine::_evaluate(const gsl_vector *v, void *p) {
     // Declare our error-handling context.
     GslErrorHandler eh("GslEngine::_evaluate");
-    // Get the top engine on the stack.
-    GslEngine *top(_useTopEngine(v));
+    // Get the engine that is being evaluated.
+    GslEngine *engine(_useEngine(v,p));
     // Call the function and return its value.
-    top->incrementEvalCount();
-    return (*(top->_f))(top->_params);
+    engine->incrementEvalCount();
+    return (*(engine->_f))(engine->_params);
 }
 
 void local::GslEngine::_evaluateGradient(const gsl_vector *v, void *p, gsl_vector *g) {
     // Declare our error-handling context.
     GslErrorHandler eh("GslEngine::_evaluateGradient");
-    // Get the top engine on the stack.
-    GslEngine *top(_useTopEngine(v));
+    // Get the engine that is being evaluated.
+    GslEngine *engine(_useEngine(v,p));
     // Fill the engine's gradient vector.
-    top->incrementGradCount();
-    (*(top->_gc))(top->_params,top->_grad);
+    engine->incrementGradCount();
+    (*(engine->_gc))(engine->_params,engine->_grad);
     // Copy the gradient components to the GSL vector provided.
-    for(int i = 0; i < top->_nPar; ++i) gsl_vector_set(g,i,top->_grad[i]);
+    for(int i = 0; i < engine->_nPar; ++i) gsl_vector_set(g,i,engine->_grad[i]);
 }
 
 void local::GslEngine::_evaluateBoth(const gsl_vector *v, void *p,
 double *fval, gsl_vector *g) {
     // Declare our error-handling context.
     GslErrorHandler eh("GslEngine::_evaluateBoth");
-    // Get the top engine on the stack.
-    GslEngine *top(_useTopEngine(v));
+    // Get the engine that is being evaluated.
+    GslEngine *engine(_useEngine(v,p));
     // Call the function and save its value.
-    top->incrementEvalCount();
-    *fval = (*(top->_f))(top->_params);
+    engine->incrementEvalCount();
+    *fval = (*(engine->_f))(engine->_params);
     // Fill the engine's gradient vector.
-    top->incrementGradCount();
-    (*(top->_gc))(top->_params,top->_grad);
+    engine->incrementGradCount();
+    (*(engine->_gc))(engine->_params,engine->_grad);
     // Copy the gradient components to the GSL vector provided.
-    for(int i = 0; i < top->_nPar; ++i) gsl_vector_set(g,i,top->_grad[i]);
-}
-
-local::GslEngine* local::GslEngine::_useTopEngine(const gsl_vector *v) {
-    // Get the top function on the stack.
-    GslEngine *top(_getEngineStack().top());
-    // Copy the input GSL vector to the top engine's _params.
-    for(int i = 0; i < top->_nPar; ++i) top->_params[i] = gsl_vector_get(v,i);
-    return top;
+    for(int i = 0; i < engine->_nPar; ++i) gsl_vector_set(g,i,engine->_grad[i]);
 }
 
-std::stack<local::GslEngine*> &local::GslEngine::_getEngineStack() {
-    static std::stack<GslEngine*> *stack = new std::stack<GslEngine*>();
-    return *stack;
+local::GslEngine* local::GslEngine::_useEngine(const gsl_vector *v, void *params) {
+    // GSL passes back the params pointer we provided, which points to the engine.
+    GslEngine *engine(static_cast<GslEngine*>(params));
+    // Copy the input GSL vector to the engine's _params.
+    for(int i = 0; i < engine->_nPar; ++i) engine->_params[i] = gsl_vector_get(v,i);
+    return engine;
 }
 
 void local::registerGslEngineMethods() {
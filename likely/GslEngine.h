@@ -9,7 +9,6 @@
 #include "gsl/gsl_multimin.h"
 
 #include <string>
-#include <stack>
 
 namespace likely {
     // Implements GSL multidimensional minimization algorithms. For details, see:
@@ -38,14 +37,13 @@ namespace likely {
         Gradient _grad;
         gsl_multimin_function _func;
         gsl_multimin_function_fdf _funcWithGradient;
-        // Global C-style callbacks that evaluate the top engine on the stack.
+        // Global C-style callbacks that evaluate the engine passed via their params pointer,
+        // so that different engines can be used concurrently in different threads.
         static double _evaluate(const gsl_vector *v, void *p);
         static void _evaluateGradient(const gsl_vector *v, void *p, gsl_vector *g);
         static void _evaluateBoth(const gsl_vector *v, void *p, double *f, gsl_vector *g);
-        // Maintains a function stack that the global callbacks use to determine which
-        // function to invoke when they are called.
-        static std::stack<GslEngine*> &_getEngineStack();
-        static GslEngine* _useTopEngine(const gsl_vector *v);
+        // Copies the input GSL vector to the _params of the engine passed via params.
+        static GslEngine* _useEngine(const gsl_vector *v, void *params);
 	}; // GslEngine
 
     // Registers our named methods.
@@ -4,30 +4,51 @@
 #include "likely/RuntimeError.h"
 
 #include "boost/format.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/tss.hpp"
 
 #include <iostream>
 
 namespace local = likely;
 
+namespace {
+    // Tracks the number of threads with an active context and the handler that was
+    // installed before the first of them.
+    boost::mutex handlerMutex;
+    int handlerCount(0);
+    gsl_error_handler_t *originalHandler(0);
+}
+
 local::GslErrorHandler::GslErrorHandler(std::string const &context)
-: _original(gsl_set_error_handler(_handle))
 {
-    getContextStack().push(context);
+    std::stack<std::string> &contextStack(getContextStack());
+    contextStack.push(context);
+    // Only the outermost context of each thread is counted, so that nested contexts (for
+    // example, one for each function evaluation during a fit) never need the lock.
+    if(contextStack.size() > 1) return;
+    boost::mutex::scoped_lock lock(handlerMutex);
+    if(0 == handlerCount++) originalHandler = gsl_set_error_handler(_handle);
 }
 
 local::GslErrorHandler::~GslErrorHandler() {
-    getContextStack().pop();
-    gsl_set_error_handler(_original);
+    std::stack<std::string> &contextStack(getContextStack());
+    contextStack.pop();
+    if(!contextStack.empty()) return;
+    boost::mutex::scoped_lock lock(handlerMutex);
+    if(0 == --handlerCount) gsl_set_error_handler(originalHandler);
 }
 
 void local::GslErrorHandler::_handle(
 const char *reason,const char *file,int line,int gsl_errno) {
-    static boost::format messageFormat("%s <GSL error at line %d of %s> %s\n");
-    throw RuntimeError(boost::str(
-        messageFormat % getContextStack().top() % line % file % reason));
+    // Errors in a thread without any context of its own are reported without one.
+    std::stack<std::string> &contextStack(getContextStack());
+    std::string context(contextStack.empty() ? "GSL" : contextStack.top());
+    boost::format messageFormat("%s <GSL error at line %d of %s> %s\n");
+    throw RuntimeError(boost::str(messageFormat % context % line % file % reason));
 }
 
 std::stack<std::string> &local::GslErrorHandler::getContextStack() {
-    static std::stack<std::string> *contextStack = new std::stack<std::string>();
+    static boost::thread_specific_ptr<std::stack<std::string> > contextStack;
+    if(0 == contextStack.get()) contextStack.reset(new std::stack<std::string>());
     return *contextStack;
 }
@@ -11,16 +11,18 @@
 namespace likely {
 	class GslErrorHandler {
 	public:
-	    // Installs a new context-specific error handler, remembering the original handler.
+	    // Enters a new context for reporting GSL errors in the calling thread. GSL only
+	    // supports a single process-wide error handler, so ours is installed when the
+	    // first thread enters a context, and the original handler is restored when the
+	    // last thread leaves its outermost context. Nested contexts do not take a lock.
 		GslErrorHandler(std::string const &context);
-		// Restores the error handler that was in place when this object was created.
+		// Leaves the context entered when this object was created.
 		virtual ~GslErrorHandler();
 	private:
-		// Remembers the original handler
-        gsl_error_handler_t *_original;
-		// Handles an error by throwing a RuntimeError with a descriptive message.
+		// Handles an error by throwing a RuntimeError with a descriptive message that
+		// includes the calling thread's innermost context.
 		static void _handle(const char *reason,const char *file,int line,int gsl_errno);
-        // Keeps track of the current context in case of nested handlers.
+        // Keeps track of the calling thread's current context in case of nested handlers.
         static std::stack<std::string> &getContextStack();
 	}; // GslErrorHandler	
 } // likely
@@ -45,7 +45,7 @@ _pimpl(new Implementation())
     _pimpl->qawo_table = 0;
     // Link the function wrapper to our static evaluator.
     _pimpl->function.function = &_evaluate;
-    _pimpl->function.params = 0;
+    _pimpl->function.params = this;
 #else
     throw RuntimeError("Integrator: GSL required for all integration methods.");
 #endif
@@ -64,7 +64,6 @@ local::Integrator::~Integrator() {
 
 double local::Integrator::integrateSmooth(double a, double b) {
     double result(0);
-    _getStack().push(this);
 #ifdef HAVE_LIBGSL
     // Declare our error-handling context.
     GslErrorHandler eh("Integrator::integrateSmooth");
@@ -73,13 +72,11 @@ double local::Integrator::integrateSmooth(double a, double b) {
     int status = gsl_integration_qag(&_pimpl->function,a,b,_epsAbs,_epsRel,
         _pimpl->workspaceSize,GSL_INTEG_GAUSS61,_pimpl->workspace,&result,&_absError);
 #endif
-    _getStack().pop();
     return result;
 }
 
 double local::Integrator::integrateRobust(double a, double b) {
     double result(0);
-    _getStack().push(this);
 #ifdef HAVE_LIBGSL
     // Declare our error-handling context.
     GslErrorHandler eh("Integrator::integrateRobust");
@@ -89,13 +86,11 @@ double local::Integrator::integrateRobust(double a, double b) {
     int status = gsl_integration_cquad(&_pimpl->function,a,b,_epsAbs,_epsRel,
         _pimpl->cquad_workspace,&result,&_absError,&nEvals);
 #endif
-    _getStack().pop();
     return result;
 }
 
 double local::Integrator::integrateSingular(double a, double b) {
     double result(0);
-    _getStack().push(this);
 #ifdef HAVE_LIBGSL
     // Declare our error-handling context.
     GslErrorHandler eh("Integrator::integrateSingular");
@@ -104,13 +99,11 @@ double local::Integrator::integrateSingular(double a, double b) {
     int status = gsl_integration_qags(&_pimpl->function,a,b,_epsAbs,_epsRel,
         _pimpl->workspaceSize,_pimpl->workspace,&result,&_absError);
 #endif
-    _getStack().pop();
     return result;
 }
 
 double local::Integrator::integrateUp(double a) {
         double result(0);
-        _getStack().push(this);
     #ifdef HAVE_LIBGSL
         // Declare our error-handling context.
         GslErrorHandler eh("Integrator::integrateUp");
@@ -119,13 +112,11 @@ double local::Integrator::integrateUp(double a) {
         int status = gsl_integration_qagiu(&_pimpl->function,a,_epsAbs,_epsRel,
             _pimpl->workspaceSize,_pimpl->workspace,&result,&_absError);
     #endif
-        _getStack().pop();
         return result;    
 }
 
 double local::Integrator::integrateDown(double b) {
         double result(0);
-        _getStack().push(this);
     #ifdef HAVE_LIBGSL
         // Declare our error-handling context.
         GslErrorHandler eh("Integrator::integrateDown");
@@ -134,13 +125,11 @@ double local::Integrator::integrateDown(double b) {
         int status = gsl_integration_qagil(&_pimpl->function,b,_epsAbs,_epsRel,
             _pimpl->workspaceSize,_pimpl->workspace,&result,&_absError);
     #endif
-        _getStack().pop();
         return result;    
 }
 
 double local::Integrator::integrateAll() {
         double result(0);
-        _getStack().push(this);
     #ifdef HAVE_LIBGSL
         // Declare our error-handling context.
         GslErrorHandler eh("Integrator::integrateDown");
@@ -149,13 +138,11 @@ double local::Integrator::integrateAll() {
         int status = gsl_integration_qagi(&_pimpl->function,_epsAbs,_epsRel,
             _pimpl->workspaceSize,_pimpl->workspace,&result,&_absError);
     #endif
-        _getStack().pop();
         return result;    
 }
 
 double local::Integrator::integrateOsc(double a, double b, double omega, bool useSin) {
         double result(0);
-        _getStack().push(this);
     #ifdef HAVE_LIBGSL
         // Declare our error-handling context.
         GslErrorHandler eh("Integrator::integrateOsc");
@@ -172,13 +159,11 @@ double local::Integrator::integrateOsc(double a, double b, double omega, bool us
         int status = gsl_integration_qawo(&_pimpl->function,a,_epsAbs,_epsRel,
             _pimpl->workspaceSize,_pimpl->workspace,_pimpl->qawo_table,&result,&_absError);
     #endif
-        _getStack().pop();
         return result;    
 }
 
 double local::Integrator::integrateOscUp(double a, double omega, bool useSin) {
         double result(0);
-        _getStack().push(this);
     #ifdef HAVE_LIBGSL
         // Declare our error-handling context.
         GslErrorHandler eh("Integrator::integrateOscUp");
@@ -198,16 +183,10 @@ double local::Integrator::integrateOscUp(double a, double omega, bool useSin) {
             _pimpl->workspaceSize,_pimpl->workspace,_pimpl->cycle_workspace,
             _pimpl->qawo_table,&result,&_absError);
     #endif
-        _getStack().pop();
         return result;    
 }
 
 double local::Integrator::_evaluate(double x, void *params) {
-    const Integrator *top(_getStack().top());
-    return (*(top->_integrand))(x);
-}
-
-std::stack<const local::Integrator*> &local::Integrator::_getStack() {
-    static std::stack<const Integrator*> *stack = new std::stack<const Integrator*>();
-    return *stack;
+    const Integrator *self(static_cast<const Integrator*>(params));
+    return (*(self->_integrand))(x);
 }
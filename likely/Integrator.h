@@ -6,8 +6,6 @@
 #include "boost/function.hpp"
 #include "boost/smart_ptr.hpp"
 
-#include <stack>
-
 namespace likely {
     // Implements one-dimensional numerical integration algorithms.
 	class Integrator {
@@ -51,11 +49,9 @@ namespace likely {
         double _epsAbs, _epsRel, _absError;
         class Implementation;
         boost::scoped_ptr<Implementation> _pimpl;
-        // Global C-style callbacks that evaluate the top engine on the stack.
+        // Global C-style callback that evaluates the integrand of the Integrator passed via
+        // params, so that different integrators can be used concurrently in different threads.
         static double _evaluate(double x, void *params);
-        // Maintains an integrand stack that the global callback uses to determine which
-        // function to invoke when called.
-        static std::stack<const Integrator*> &_getStack();
 	}; // Integrator
 	
     inline double Integrator::getAbsError() const { return _absError; }
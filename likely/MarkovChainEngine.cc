@@ -14,11 +14,15 @@
 #include "boost/accumulators/statistics/variates/covariate.hpp"
 #include "boost/functional/factory.hpp"
 #include "boost/bind.hpp"
+#include "boost/ref.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/barrier.hpp"
 
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <limits>
 
 using namespace boost::accumulators;
 
@@ -28,6 +32,12 @@ typedef std::vector<Accumulator> Accumulators;
 
 namespace local = likely;
 
+const int local::MarkovChainEngine::EnsembleChains = 8;
+const int local::MarkovChainEngine::EnsembleColdChains = 4;
+const int local::MarkovChainEngine::EnsembleTrialsPerParam = 200;
+const int local::MarkovChainEngine::EnsembleSwapsPerCycle = 20;
+const double local::MarkovChainEngine::EnsembleMaxTemperature = 16;
+
 local::MarkovChainEngine::MarkovChainEngine(FunctionPtr f, GradientCalculatorPtr gc,
 FitParameters const &parameters, std::string const &algorithm, RandomPtr random)
 : _f(f), _random(random)
@@ -45,6 +55,12 @@ FitParameters const &parameters, std::string const &algorithm, RandomPtr random)
         minimumFinder = boost::bind(&MarkovChainEngine::minimize,this,
             _1,_2,_3,50,5000);
     }
+    else if(algorithm == "ensemble") {
+        minimumFinder = boost::bind(&MarkovChainEngine::_ensemble,this,_1,_2,_3,1);
+    }
+    else if(algorithm == "parallel_ensemble") {
+        minimumFinder = boost::bind(&MarkovChainEngine::_ensemble,this,_1,_2,_3,0);
+    }
     else {
         throw RuntimeError("MarkovChainEngine: unknown algorithm '" + algorithm + "'");
     }
@@ -75,7 +91,7 @@ int maxTrials, Callback callback, int callbackInterval) const {
     while(remaining > 0 && (maxTrials == 0 || nTrials < maxTrials)) {
         nTrials++;
         // Take a trial step sampled from the estimated function minimum's covariance.
-        fmin->setRandomParameters(current, trial);
+        fmin->setRandomParameters(current, trial, _random);
         // Evaluate the true NLL at this trial point.
         double trialNLL((*_f)(trial));
         incrementEvalCount();
@@ -145,6 +161,241 @@ int acceptsPerParam, int maxTrialsPerParam) {
     }
 }
 
+// Holds the state of one chain of an ensemble.
+class local::MarkovChainEngine::Chain {
+public:
+    Chain() : temperature(1), currentNLL(0), minNLL(0), nEvals(0) { }
+    // The temperature used to scale NLL differences and the proposal covariance.
+    double temperature;
+    // This chain's own random generator and proposal covariance, so that chains can
+    // run concurrently without sharing any mutable state.
+    RandomPtr random;
+    CovarianceMatrixPtr proposal;
+    // Accumulates residuals of the floating parameters for cold chains, or is null.
+    CovarianceAccumulatorPtr accumulator;
+    // The indices of floating parameters, and their values at the start of this cycle.
+    std::vector<int> floatingIndex;
+    Parameters initialFloating;
+    // The current state of this chain, and the best point it has found this cycle.
+    Parameters current, minParams;
+    double currentNLL, minNLL;
+    long nEvals;
+    // Any error message generated while running this chain.
+    std::string error;
+};
+
+void local::MarkovChainEngine::_runChain(Chain &chain, int nTrials) const {
+    try {
+        int nFloating(chain.floatingIndex.size());
+        std::vector<double> offsets;
+        Parameters trial, residual(nFloating);
+        for(int count = 0; count < nTrials; ++count) {
+            // Take a trial step sampled from this chain's proposal covariance.
+            chain.proposal->sample(offsets,chain.random);
+            trial = chain.current;
+            for(int j = 0; j < nFloating; ++j) trial[chain.floatingIndex[j]] += offsets[j];
+            // Evaluate the true NLL at this trial point.
+            double trialNLL((*_f)(trial));
+            chain.nEvals++;
+            // Is this a new minimum?
+            if(trialNLL < chain.minNLL) {
+                chain.minParams = trial;
+                chain.minNLL = trialNLL;
+            }
+            // Do we accept this trial step?
+            double logProbRatio((chain.currentNLL-trialNLL)/chain.temperature);
+            if(logProbRatio >= 0 || chain.random->getUniform() < std::exp(logProbRatio)) {
+                chain.current = trial;
+                chain.currentNLL = trialNLL;
+            }
+            // Accumulate covariance statistics for a cold chain.
+            if(chain.accumulator) {
+                for(int j = 0; j < nFloating; ++j) {
+                    residual[j] = chain.current[chain.floatingIndex[j]] - chain.initialFloating[j];
+                }
+                chain.accumulator->accumulate(residual);
+            }
+        }
+    }
+    catch(std::exception const &e) {
+        chain.error = e.what();
+    }
+}
+
+// Runs the chains of an ensemble on nThreads threads that live as long as this object.
+// The calling thread runs its share of the chains in run(), while the other threads wait
+// at a barrier between segments, so that no threads are created for each segment.
+class local::MarkovChainEngine::ChainPool {
+public:
+    ChainPool(MarkovChainEngine const &engine, std::vector<Chain> &chains, int nThreads)
+    : _engine(engine), _chains(chains), _nThreads(nThreads), _nTrials(0), _stop(false),
+    _start(nThreads), _done(nThreads) {
+        for(int thread = 1; thread < _nThreads; ++thread) {
+            _threads.create_thread(boost::bind(&ChainPool::_work,this,thread));
+        }
+    }
+    ~ChainPool() {
+        // Release our threads from the start barrier and wait for them to exit.
+        _stop = true;
+        _start.wait();
+        _threads.join_all();
+    }
+    // Runs nTrials in every chain and returns when all chains have finished.
+    void run(int nTrials) {
+        _nTrials = nTrials;
+        _start.wait();
+        _runShare(0);
+        _done.wait();
+    }
+private:
+    void _work(int thread) {
+        while(true) {
+            _start.wait();
+            if(_stop) return;
+            _runShare(thread);
+            _done.wait();
+        }
+    }
+    void _runShare(int thread) {
+        for(int k = thread; k < _chains.size(); k += _nThreads) {
+            _engine._runChain(_chains[k],_nTrials);
+        }
+    }
+    MarkovChainEngine const &_engine;
+    std::vector<Chain> &_chains;
+    int _nThreads, _nTrials;
+    bool _stop;
+    boost::barrier _start, _done;
+    boost::thread_group _threads;
+};
+
+int local::MarkovChainEngine::_temperCycle(FunctionMinimumPtr fmin, std::vector<Chain> &chains,
+ChainPool &pool, int nCold, int trialsPerChain, int swapsPerCycle) const {
+    int nChains(chains.size());
+    // Prepare each chain for this cycle using the current covariance estimate.
+    Parameters initialFloating(fmin->getParameters(true));
+    CovarianceMatrixCPtr covariance(fmin->getCovariance());
+    for(int k = 0; k < nChains; ++k) {
+        Chain &chain(chains[k]);
+        chain.proposal.reset(new CovarianceMatrix(*covariance));
+        chain.proposal->applyScaleFactor(chain.temperature);
+        if(k < nCold) chain.accumulator.reset(new CovarianceAccumulator(_nFloating));
+        chain.initialFloating = initialFloating;
+        chain.minParams = fmin->getParameters();
+        chain.minNLL = fmin->getMinValue();
+        chain.nEvals = 0;
+    }
+    // Run each segment of this cycle.
+    int nTrials(0);
+    for(int segment = 0; segment < swapsPerCycle; ++segment) {
+        int nSegment = (trialsPerChain*(segment+1))/swapsPerCycle
+            - (trialsPerChain*segment)/swapsPerCycle;
+        pool.run(nSegment);
+        nTrials += nChains*nSegment;
+        for(int k = 0; k < nChains; ++k) {
+            if(chains[k].error.length() > 0) {
+                throw RuntimeError("MarkovChainEngine::temper: " + chains[k].error);
+            }
+        }
+        // Propose exchanges between neighboring chains in the temperature ladder.
+        for(int k = 0; k < nChains-1; ++k) {
+            Chain &cooler(chains[k]), &hotter(chains[k+1]);
+            double logProbRatio((cooler.currentNLL - hotter.currentNLL)*
+                (1/cooler.temperature - 1/hotter.temperature));
+            if(logProbRatio >= 0 || _random->getUniform() < std::exp(logProbRatio)) {
+                cooler.current.swap(hotter.current);
+                std::swap(cooler.currentNLL,hotter.currentNLL);
+            }
+        }
+    }
+    long nEvals(0);
+    for(int k = 0; k < nChains; ++k) nEvals += chains[k].nEvals;
+    incrementEvalCount(nEvals);
+    // Merge the covariance statistics of our cold chains and record the result before
+    // updating the parameter values, so that the updated errors are available.
+    try {
+        CovarianceAccumulator merged(_nFloating);
+        for(int k = 0; k < nCold; ++k) merged.merge(*chains[k].accumulator);
+        // Make sure we have a valid positive-definite matrix before we use it.
+        CovarianceMatrixCPtr C = merged.getCovariance();
+        C->getLogDeterminant();
+        fmin->updateCovariance(C);
+    }
+    catch(RuntimeError const &e) {
+        // Stick with our original covariance estimate for now.
+    }
+    // Record the best minimum found by any chain.
+    int best(0);
+    for(int k = 1; k < nChains; ++k) {
+        if(chains[k].minNLL < chains[best].minNLL) best = k;
+    }
+    fmin->updateParameterValues(chains[best].minNLL,chains[best].minParams);
+    return nTrials;
+}
+
+void local::MarkovChainEngine::temper(FunctionMinimumPtr fmin, double prec, int maxSteps,
+int nChains, int nCold, double maxTemperature, int trialsPerParam, int swapsPerCycle,
+int nThreads) {
+    if(nCold <= 0 || nChains < nCold) {
+        throw RuntimeError("MarkovChainEngine::temper: expected 0 < nCold <= nChains.");
+    }
+    if(maxTemperature < 1) {
+        throw RuntimeError("MarkovChainEngine::temper: expected maxTemperature >= 1.");
+    }
+    if(trialsPerParam <= 0 || swapsPerCycle <= 0) {
+        throw RuntimeError("MarkovChainEngine::temper: expected trialsPerParam,swapsPerCycle > 0.");
+    }
+    if(nThreads < 0) {
+        throw RuntimeError("MarkovChainEngine::temper: expected nThreads >= 0.");
+    }
+    if(0 == nThreads) nThreads = boost::thread::hardware_concurrency();
+    if(nThreads < 1) nThreads = 1;
+    // Build an initial diagonal convariance using the fit parameter errors provided.
+    Parameters initialErrors = fmin->getErrors(true);
+    CovarianceMatrixPtr covariance(new CovarianceMatrix(_nFloating));
+    for(int k = 0; k < _nFloating; ++k) {
+        covariance->setCovariance(k,k,initialErrors[k]*initialErrors[k]);
+    }
+    fmin->updateCovariance(covariance);
+    // Find the indices of our floating parameters.
+    std::vector<int> floatingIndex;
+    FitParameters parameters(fmin->getFitParameters());
+    for(int index = 0; index < parameters.size(); ++index) {
+        if(parameters[index].isFloating()) floatingIndex.push_back(index);
+    }
+    // Draw the seed for our chain substreams from our generator.
+    RandomPtr master(new Random());
+    master->setSeed(_random->getInteger(0,std::numeric_limits<int>::max()));
+    // Initialize our chains at the starting point.
+    std::vector<Chain> chains(nChains);
+    int nHot(nChains-nCold);
+    for(int k = 0; k < nChains; ++k) {
+        Chain &chain(chains[k]);
+        chain.temperature = (k < nCold) ? 1 : std::pow(maxTemperature,(k-nCold+1.)/nHot);
+        chain.random = master->createStream(k);
+        chain.floatingIndex = floatingIndex;
+        chain.current = fmin->getParameters();
+        chain.currentNLL = fmin->getMinValue();
+    }
+    // Start the threads that run our chains, with no more threads than chains.
+    ChainPool pool(*this,chains,std::min(nThreads,nChains));
+    // Run cycles until we converge or reach our trial limit.
+    int trialsPerChain(trialsPerParam*_nFloating), trials(0);
+    if(swapsPerCycle > trialsPerChain) swapsPerCycle = trialsPerChain;
+    while(maxSteps == 0 || trials < maxSteps) {
+        double initialFval(fmin->getMinValue());
+        trials += _temperCycle(fmin,chains,pool,nCold,trialsPerChain,swapsPerCycle);
+        // Check if we have reached the requested "precision"
+        if(initialFval - fmin->getMinValue() < prec) break;
+    }
+}
+
+void local::MarkovChainEngine::_ensemble(FunctionMinimumPtr fmin, double prec, int maxSteps,
+int nThreads) {
+    temper(fmin,prec,maxSteps,EnsembleChains,EnsembleColdChains,EnsembleMaxTemperature,
+        EnsembleTrialsPerParam,EnsembleSwapsPerCycle,nThreads);
+}
+
 void local::registerMarkovChainEngineMethods() {
     static bool registered = false;
     if(registered) return;
@@ -8,6 +8,8 @@
 
 #include "boost/function.hpp"
 
+#include <vector>
+
 namespace likely {
 	class MarkovChainEngine : public AbsEngine {
 	public:
@@ -31,7 +33,45 @@ namespace likely {
         typedef boost::function<void (Parameters const&, Parameters const&, double, double, bool)> Callback;
         int generate(FunctionMinimumPtr fmin, int nAccepts, int maxTrials,
             Callback callback = Callback(), int callbackInterval = 1) const;
+        // Searches for a minimum using an ensemble of nChains Metropolis chains. The chains
+        // are run on nThreads threads (including the calling thread), or the number of
+        // available cores if nThreads is zero, which are created once for the whole search.
+        // With more than one thread, the function is evaluated from several threads at once
+        // and so must be safe to call concurrently. The first nCold chains sample the
+        // function at temperature T = 1 and the remaining chains use temperatures increasing
+        // geometrically up to maxTemperature, so that they explore widely separated minima
+        // more easily. Proposals for a chain at temperature T are sampled from the current
+        // covariance estimate scaled by T. Each cycle runs trialsPerParam*nFloating trials in
+        // each chain, divided into swapsPerCycle segments, and proposes exchanges between
+        // neighboring chains in the temperature ladder after each segment. At the end of each
+        // cycle, the covariance statistics of the cold chains are merged to update the
+        // covariance estimate and the best point found by any chain is used to update the
+        // minimum. Cycles continue until the minimum improves by less than prec or else the
+        // total number of trials in all chains exceeds maxSteps (when > 0). All random
+        // numbers are drawn from substreams of a seed obtained from our generator, so results
+        // are reproducible and independent of nThreads and of thread scheduling.
+        // The "ensemble" algorithm runs all chains on the calling thread, and the
+        // "parallel_ensemble" algorithm uses one thread per available core (up to nChains).
+        // Both use the ensemble settings defined below.
+        void temper(FunctionMinimumPtr fmin, double prec, int maxSteps, int nChains, int nCold,
+            double maxTemperature, int trialsPerParam, int swapsPerCycle, int nThreads = 1);
+        // Ensemble settings used by the "ensemble" and "parallel_ensemble" algorithms: half
+        // of the chains are cold, the hottest chain runs at T = 16, and each cycle runs 200
+        // trials per floating parameter in each chain with 20 rounds of exchanges.
+        static const int EnsembleChains, EnsembleColdChains, EnsembleTrialsPerParam,
+            EnsembleSwapsPerCycle;
+        static const double EnsembleMaxTemperature;
 	private:
+	    // Runs a single chain of an ensemble for the specified number of trials.
+        class Chain;
+        void _runChain(Chain &chain, int nTrials) const;
+        // Runs the chains of an ensemble on a fixed set of threads.
+        class ChainPool;
+        // Runs one cycle of temper() and returns the total number of trials generated.
+        int _temperCycle(FunctionMinimumPtr fmin, std::vector<Chain> &chains, ChainPool &pool,
+            int nCold, int trialsPerChain, int swapsPerCycle) const;
+        // Implements the "ensemble" and "parallel_ensemble" algorithms.
+        void _ensemble(FunctionMinimumPtr fmin, double prec, int maxSteps, int nThreads);
         int _nParam,_nFloating;
         FunctionPtr _f;
         mutable RandomPtr _random;
@@ -0,0 +1,70 @@
+#include "likely/MarkovChainReader.h"
+#include "likely/MarkovChainWriter.h"
+#include "likely/RuntimeError.h"
+
+#include "boost/interprocess/file_mapping.hpp"
+#include "boost/interprocess/mapped_region.hpp"
+#include "boost/cstdint.hpp"
+
+#include <cstring>
+
+namespace local = likely;
+namespace ipc = boost::interprocess;
+
+namespace likely {
+    struct MarkovChainReader::Implementation {
+        ipc::file_mapping file;
+        ipc::mapped_region region;
+    }; // MarkovChainReader::Implementation
+} // likely::
+
+local::MarkovChainReader::MarkovChainReader(std::string const &filename)
+: _pimpl(new Implementation())
+{
+    try {
+        ipc::file_mapping(filename.c_str(),ipc::read_only).swap(_pimpl->file);
+        ipc::mapped_region(_pimpl->file,ipc::read_only).swap(_pimpl->region);
+    }
+    catch(ipc::interprocess_exception const &e) {
+        throw RuntimeError("MarkovChainReader: unable to map " + filename + ": " + e.what());
+    }
+    char const *base = static_cast<char const*>(_pimpl->region.get_address());
+    std::size_t size = _pimpl->region.get_size();
+    // Parse and validate our header.
+    if(size < 24 || 0 != std::memcmp(base,MarkovChainWriter::getSignature(),8)) {
+        throw RuntimeError("MarkovChainReader: not a chain file: " + filename);
+    }
+    boost::int32_t version, nFloating;
+    boost::int64_t dataOffset;
+    std::memcpy(&version,base+8,sizeof(version));
+    std::memcpy(&nFloating,base+12,sizeof(nFloating));
+    std::memcpy(&dataOffset,base+16,sizeof(dataOffset));
+    if(version != MarkovChainWriter::getVersion()) {
+        throw RuntimeError("MarkovChainReader: unsupported version in " + filename);
+    }
+    if(nFloating <= 0 || dataOffset < 24 || dataOffset > size || 0 != dataOffset%8) {
+        throw RuntimeError("MarkovChainReader: invalid header in " + filename);
+    }
+    char const *next(base+24), *end(base+dataOffset);
+    for(int k = 0; k < nFloating; ++k) {
+        char const *stop = static_cast<char const*>(std::memchr(next,'\0',end-next));
+        if(0 == stop) {
+            throw RuntimeError("MarkovChainReader: invalid parameter names in " + filename);
+        }
+        _names.push_back(std::string(next,stop));
+        next = stop+1;
+    }
+    _nFloating = nFloating;
+    _recordSize = MarkovChainWriter::getRecordSize(nFloating);
+    _nSamples = (size - dataOffset)/(sizeof(double)*_recordSize);
+    _records = reinterpret_cast<double const*>(end);
+}
+
+local::MarkovChainReader::~MarkovChainReader() { }
+
+double const *local::MarkovChainReader::_getRecord(long index) const {
+    if(index < 0 || index >= _nSamples) {
+        throw RuntimeError("MarkovChainReader: invalid sample index.");
+    }
+    return _records + index*_recordSize;
+}
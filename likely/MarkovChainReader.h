@@ -0,0 +1,64 @@
+#ifndef LIKELY_MARKOV_CHAIN_READER
+#define LIKELY_MARKOV_CHAIN_READER
+
+#include "boost/smart_ptr.hpp"
+#include "boost/utility.hpp"
+
+#include <string>
+#include <vector>
+
+namespace likely {
+    // Provides read-only access to a chain file written by a MarkovChainWriter. The file is
+    // memory mapped, so opening even a very large file is fast and records are only read
+    // from disk when they are accessed. A trailing partial record (for example, from a
+    // chain that is still being written) is ignored.
+	class MarkovChainReader : boost::noncopyable {
+	public:
+	    // Opens the named chain file or throws a RuntimeError.
+		explicit MarkovChainReader(std::string const &filename);
+		virtual ~MarkovChainReader();
+        // Returns the number of floating parameters stored in each record.
+        int getNParameters() const;
+        // Returns the names of the floating parameters stored in each record.
+        std::vector<std::string> const &getParameterNames() const;
+        // Returns the number of complete records in the file.
+        long getNSamples() const;
+        // Returns pointers to the getNParameters() current or trial parameter values stored
+        // in the specified record, which remain valid for the lifetime of this object.
+        // Throws a RuntimeError for an invalid index.
+        double const *getCurrent(long index) const;
+        double const *getTrial(long index) const;
+        // Returns the NLL values at the current and trial parameters of the specified record.
+        double getCurrentNLL(long index) const;
+        double getTrialNLL(long index) const;
+        // Returns true if the trial of the specified record was accepted.
+        bool isAccepted(long index) const;
+	private:
+        double const *_getRecord(long index) const;
+        int _nFloating, _recordSize;
+        long _nSamples;
+        std::vector<std::string> _names;
+        double const *_records;
+        class Implementation;
+        boost::scoped_ptr<Implementation> _pimpl;
+	}; // MarkovChainReader
+
+    inline int MarkovChainReader::getNParameters() const { return _nFloating; }
+    inline std::vector<std::string> const &MarkovChainReader::getParameterNames() const { return _names; }
+    inline long MarkovChainReader::getNSamples() const { return _nSamples; }
+    inline double const *MarkovChainReader::getCurrent(long index) const { return _getRecord(index); }
+    inline double const *MarkovChainReader::getTrial(long index) const {
+        return _getRecord(index) + _nFloating;
+    }
+    inline double MarkovChainReader::getCurrentNLL(long index) const {
+        return _getRecord(index)[2*_nFloating];
+    }
+    inline double MarkovChainReader::getTrialNLL(long index) const {
+        return _getRecord(index)[2*_nFloating+1];
+    }
+    inline bool MarkovChainReader::isAccepted(long index) const {
+        return _getRecord(index)[2*_nFloating+2] != 0;
+    }
+} // likely
+
+#endif // LIKELY_MARKOV_CHAIN_READER
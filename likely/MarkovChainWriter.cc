@@ -0,0 +1,180 @@
+#include "likely/MarkovChainWriter.h"
+#include "likely/RuntimeError.h"
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/cstdint.hpp"
+
+#include <fstream>
+#include <vector>
+
+namespace local = likely;
+
+namespace likely {
+    struct MarkovChainWriter::Implementation {
+        std::ofstream out;
+        int nFloating, recordSize, bufferSize;
+        std::vector<int> floatingIndex;
+        // The front buffer is filled by write() while the background thread drains the
+        // back buffer. Both are protected by mutex except that the front buffer is only
+        // ever touched by the writing thread.
+        std::vector<double> front, back;
+        int nFront, nBack;
+        bool backPending, stopping, closed;
+        long nRecords;
+        std::string error;
+        boost::mutex mutex;
+        boost::condition_variable changed;
+        boost::thread thread;
+    }; // MarkovChainWriter::Implementation
+} // likely::
+
+local::MarkovChainWriter::MarkovChainWriter(std::string const &filename,
+FitParameters const &parameters, int bufferSize)
+: _pimpl(new Implementation())
+{
+    if(bufferSize <= 0) {
+        throw RuntimeError("MarkovChainWriter: expected bufferSize > 0.");
+    }
+    std::vector<std::string> names;
+    for(int index = 0; index < parameters.size(); ++index) {
+        if(!parameters[index].isFloating()) continue;
+        _pimpl->floatingIndex.push_back(index);
+        names.push_back(parameters[index].getName());
+    }
+    _pimpl->nFloating = names.size();
+    if(0 == _pimpl->nFloating) {
+        throw RuntimeError("MarkovChainWriter: number of floating parameters must be > 0.");
+    }
+    _pimpl->out.open(filename.c_str(),std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!_pimpl->out.good()) {
+        throw RuntimeError("MarkovChainWriter: unable to open " + filename);
+    }
+    // Build our header: signature, version, nFloating, data offset, then the null-terminated
+    // parameter names padded with zeros so that the records start on an 8-byte boundary.
+    std::string nameList;
+    for(int k = 0; k < _pimpl->nFloating; ++k) {
+        nameList += names[k];
+        nameList.push_back('\0');
+    }
+    boost::int64_t dataOffset(8 + 4 + 4 + 8 + nameList.size());
+    dataOffset = 8*((dataOffset+7)/8);
+    boost::int32_t version(getVersion()), nFloating(_pimpl->nFloating);
+    _pimpl->out.write(getSignature(),8);
+    _pimpl->out.write(reinterpret_cast<char const*>(&version),sizeof(version));
+    _pimpl->out.write(reinterpret_cast<char const*>(&nFloating),sizeof(nFloating));
+    _pimpl->out.write(reinterpret_cast<char const*>(&dataOffset),sizeof(dataOffset));
+    nameList.resize(dataOffset - 24,'\0');
+    _pimpl->out.write(nameList.data(),nameList.size());
+    if(!_pimpl->out.good()) {
+        throw RuntimeError("MarkovChainWriter: unable to write header to " + filename);
+    }
+    // Allocate our buffers.
+    _pimpl->recordSize = getRecordSize(_pimpl->nFloating);
+    _pimpl->bufferSize = bufferSize;
+    _pimpl->front.resize(bufferSize*_pimpl->recordSize);
+    _pimpl->back.resize(bufferSize*_pimpl->recordSize);
+    _pimpl->nFront = _pimpl->nBack = 0;
+    _pimpl->backPending = _pimpl->stopping = _pimpl->closed = false;
+    _pimpl->nRecords = 0;
+    // Start our background writer.
+    _pimpl->thread = boost::thread(boost::bind(&MarkovChainWriter::_writeLoop,this));
+}
+
+local::MarkovChainWriter::~MarkovChainWriter() {
+    try {
+        close();
+    }
+    catch(RuntimeError const &e) {
+        // Never throw from a destructor.
+    }
+}
+
+char const *local::MarkovChainWriter::getSignature() { return "LIKELYMC"; }
+
+int local::MarkovChainWriter::getVersion() { return 1; }
+
+long local::MarkovChainWriter::getNRecords() const { return _pimpl->nRecords; }
+
+void local::MarkovChainWriter::write(Parameters const &current, Parameters const &trial,
+double currentNLL, double trialNLL, bool accepted) {
+    if(_pimpl->closed) {
+        throw RuntimeError("MarkovChainWriter::write: file is already closed.");
+    }
+    int nParam(_pimpl->floatingIndex.back()+1);
+    if(current.size() < nParam || trial.size() < nParam) {
+        throw RuntimeError("MarkovChainWriter::write: unexpected number of parameters.");
+    }
+    if(_pimpl->nFront == _pimpl->bufferSize) _flush();
+    int nFloating(_pimpl->nFloating);
+    double *record = &_pimpl->front[_pimpl->nFront*_pimpl->recordSize];
+    for(int k = 0; k < nFloating; ++k) {
+        int index(_pimpl->floatingIndex[k]);
+        record[k] = current[index];
+        record[nFloating+k] = trial[index];
+    }
+    record[2*nFloating] = currentNLL;
+    record[2*nFloating+1] = trialNLL;
+    record[2*nFloating+2] = accepted ? 1 : 0;
+    _pimpl->nFront++;
+    _pimpl->nRecords++;
+}
+
+local::MarkovChainEngine::Callback local::MarkovChainWriter::getCallback() {
+    return boost::bind(&MarkovChainWriter::write,this,_1,_2,_3,_4,_5);
+}
+
+void local::MarkovChainWriter::_flush() {
+    boost::unique_lock<boost::mutex> lock(_pimpl->mutex);
+    // Wait for the background thread to finish with the back buffer.
+    while(_pimpl->backPending) _pimpl->changed.wait(lock);
+    if(_pimpl->error.length() > 0) {
+        throw RuntimeError("MarkovChainWriter: " + _pimpl->error);
+    }
+    _pimpl->front.swap(_pimpl->back);
+    _pimpl->nBack = _pimpl->nFront;
+    _pimpl->nFront = 0;
+    _pimpl->backPending = true;
+    _pimpl->changed.notify_all();
+}
+
+void local::MarkovChainWriter::_writeLoop() {
+    boost::unique_lock<boost::mutex> lock(_pimpl->mutex);
+    while(true) {
+        while(!_pimpl->backPending && !_pimpl->stopping) _pimpl->changed.wait(lock);
+        if(!_pimpl->backPending) break;
+        // Write the back buffer without holding the lock, so that the front buffer can
+        // continue to fill in the meantime.
+        lock.unlock();
+        _pimpl->out.write(reinterpret_cast<char const*>(&_pimpl->back[0]),
+            sizeof(double)*_pimpl->nBack*_pimpl->recordSize);
+        bool ok(_pimpl->out.good());
+        lock.lock();
+        if(!ok && 0 == _pimpl->error.length()) _pimpl->error = "write failed.";
+        _pimpl->backPending = false;
+        _pimpl->changed.notify_all();
+    }
+}
+
+void local::MarkovChainWriter::close() {
+    if(_pimpl->closed) return;
+    _pimpl->closed = true;
+    try {
+        if(_pimpl->nFront > 0) _flush();
+    }
+    catch(RuntimeError const &e) {
+        // Stop our background thread before reporting this error below.
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(_pimpl->mutex);
+        _pimpl->stopping = true;
+        _pimpl->changed.notify_all();
+    }
+    _pimpl->thread.join();
+    _pimpl->out.close();
+    if(_pimpl->error.length() > 0) {
+        throw RuntimeError("MarkovChainWriter: " + _pimpl->error);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef LIKELY_MARKOV_CHAIN_WRITER
+#define LIKELY_MARKOV_CHAIN_WRITER
+
+#include "likely/types.h"
+#include "likely/FitParameter.h"
+#include "likely/MarkovChainEngine.h"
+
+#include "boost/smart_ptr.hpp"
+#include "boost/utility.hpp"
+
+#include <string>
+
+namespace likely {
+    // Streams the samples generated by a MarkovChainEngine to an append-only binary file.
+    // The file starts with a header that names the floating parameters, followed by one
+    // fixed-width record per trial consisting of 2*nFloating+3 doubles:
+    //
+    //   current[0..nFloating-1] trial[0..nFloating-1] currentNLL trialNLL accepted
+    //
+    // where accepted is 1 or 0. Values are written in native byte order. Records are
+    // collected in memory and written by a background thread with double buffering, so
+    // the chain only waits for I/O when the disk cannot keep up with it. Use a
+    // MarkovChainReader to read the file back.
+	class MarkovChainWriter : boost::noncopyable {
+	public:
+	    // Creates a new chain file with the specified name, replacing any existing file, for
+	    // samples of the floating parameters in the specified list. Records are written in
+	    // blocks of bufferSize records. Throws a RuntimeError if the file cannot be opened
+	    // or there are no floating parameters.
+		MarkovChainWriter(std::string const &filename, FitParameters const &parameters,
+            int bufferSize = 4096);
+        // Writes any buffered records and closes our file, if this has not already been done.
+		virtual ~MarkovChainWriter();
+        // Appends a record for the specified values of all parameters (fixed parameters are
+        // dropped). The arguments match those of MarkovChainEngine::Callback. Throws a
+        // RuntimeError if the parameters have the wrong size, the file has been closed, or
+        // a previous background write failed.
+        void write(Parameters const &current, Parameters const &trial,
+            double currentNLL, double trialNLL, bool accepted);
+        // Returns a callback that writes to this object, for use with MarkovChainEngine::generate.
+        // The returned callback must not be invoked after this object is deleted.
+        MarkovChainEngine::Callback getCallback();
+        // Writes any buffered records and closes our file. Throws a RuntimeError if any
+        // write has failed. Does nothing if the file is already closed.
+        void close();
+        // Returns the number of records written so far, including those still being buffered.
+        long getNRecords() const;
+        // Returns the number of doubles in each record for the specified number of floating
+        // parameters.
+        static int getRecordSize(int nFloating);
+        // Returns the 8-byte signature at the start of every chain file and its format version.
+        static char const *getSignature();
+        static int getVersion();
+	private:
+        void _flush();
+        void _writeLoop();
+        class Implementation;
+        boost::scoped_ptr<Implementation> _pimpl;
+	}; // MarkovChainWriter
+
+    inline int MarkovChainWriter::getRecordSize(int nFloating) { return 2*nFloating + 3; }
+} // likely
+
+#endif // LIKELY_MARKOV_CHAIN_WRITER
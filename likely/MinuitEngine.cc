@@ -79,7 +79,8 @@ FitParameters const &parameters, std::string const &algorithm)
         // Check that we have a gradient calculator to use.
         if(!_gc) {
             throw RuntimeError(
-                "MinuitEngine: selected algorithm needs a gradient calculator.");
+                "MinuitEngine: selected algorithm needs a gradient calculator "
+                "(try createNumericalGradientCalculator).");
         }
     }
 }
@@ -3,6 +3,7 @@
 #include "likely/NonUniformBinning.h"
 #include "likely/BinningError.h"
 
+#include <algorithm>
 #include <ostream>
 
 namespace local = likely;
@@ -21,19 +22,64 @@ local::NonUniformBinning::NonUniformBinning(std::vector<double> const &binEdges)
             throw BinningError("NonUniformBinning: bin edges are not in increasing order.");
         }
     }
+    // Build a lookup table with two buckets per bin on average, unless all of our bins
+    // have zero width.
+    int nBuckets(2*(nBins-1));
+    double range(_binEdges.back() - _binEdges.front());
+    _bucketScale = (range > 0) ? nBuckets/range : 0;
+    if(0 == _bucketScale) nBuckets = 0;
+    _bucketBin.reserve(nBuckets+1);
+    for(int bucket = 0; bucket < nBuckets; ++bucket) {
+        double lowEdge(_binEdges.front() + bucket/_bucketScale);
+        int bin(std::upper_bound(_binEdges.begin(),_binEdges.end(),lowEdge) - _binEdges.begin() - 1);
+        _bucketBin.push_back(std::max(0,std::min(bin,nBins-2)));
+    }
+    _bucketBin.push_back(nBins-2);
 }
 
 local::NonUniformBinning::~NonUniformBinning() { }
 
 int local::NonUniformBinning::getBinIndex(double value) const {
-    // should use bisection for this, and cache the last bin found...
-    if(value < _binEdges[0]) {
+    if(value < _binEdges.front()) {
         throw BinningError("getBinIndex: value is below binning interval.");
     }
-    for(int bin = 1; bin < _binEdges.size(); ++bin) {
-        if(value < _binEdges[bin]) return bin-1;
+    // This test also rejects a NaN value.
+    if(!(value < _binEdges.back())) {
+        throw BinningError("getBinIndex: value is above binning interval.");
+    }
+    return _findBin(value);
+}
+
+int local::NonUniformBinning::getBinIndices(double const *values, int *indices, int n) const {
+    int nOutside(0);
+    double lo(_binEdges.front()), hi(_binEdges.back());
+    for(int k = 0; k < n; ++k) {
+        double value(values[k]);
+        if(value >= lo && value < hi) {
+            indices[k] = _findBin(value);
+        }
+        else {
+            indices[k] = -1;
+            nOutside++;
+        }
+    }
+    return nOutside;
+}
+
+int local::NonUniformBinning::_findBin(double value) const {
+    // Find the range of bins spanned by the bucket containing this value.
+    int bucket(std::min((int)((value - _binEdges.front())*_bucketScale),(int)_bucketBin.size()-1));
+    std::vector<double>::const_iterator first(_binEdges.begin() + _bucketBin[bucket] + 1);
+    std::vector<double>::const_iterator last(_binEdges.begin() +
+        _bucketBin[std::min(bucket+1,(int)_bucketBin.size()-1)] + 2);
+    // The bin containing value has the last low edge <= value, taking care to select the
+    // last of any zero-width bins.
+    int bin(std::upper_bound(first,last,value) - _binEdges.begin() - 1);
+    if(value < _binEdges[bin] || value >= _binEdges[bin+1]) {
+        // Our bucket boundaries suffered a round-off error, so bisect all bins instead.
+        bin = std::upper_bound(_binEdges.begin(),_binEdges.end(),value) - _binEdges.begin() - 1;
     }
-    throw BinningError("getBinIndex: value is above binning interval.");
+    return bin;
 }
 
 int local::NonUniformBinning::getNBins() const {
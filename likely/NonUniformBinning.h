@@ -17,8 +17,14 @@ namespace likely {
 		explicit NonUniformBinning(std::vector<double> const &binEdges);
 		virtual ~NonUniformBinning();
         // Returns the bin index [0,nBins-1] corresponding to the specified value, or throws a
-        // BinningError if value does not fall in any bin.
+        // BinningError if value does not fall in any bin. Uses a table of uniform buckets
+        // covering our interval to find the range of bins that might contain value, and then
+        // bisects this range, so lookups take O(1) time on average when bin widths vary
+        // slowly and O(log(nBins)) time in the worst case.
         virtual int getBinIndex(double value) const;
+        // Fills the array indices with the bin index of each of the n values provided, or -1
+        // for a value that does not fall in any bin. Returns the number of such values.
+        virtual int getBinIndices(double const *values, int *indices, int n) const;
         // Returns the total number of bins.
         virtual int getNBins() const;
         // Returns the lower bound of the specified bin. Throws a BinningError if index is out of range.
@@ -35,7 +41,13 @@ namespace likely {
         // Prints this binning to the specified output stream in a format compatible with createBinning.
         virtual void printToStream(std::ostream &os) const;
 	private:
+        // Returns the bin containing a value that is known to be within our interval.
+        int _findBin(double value) const;
         std::vector<double> _binEdges;
+        // The bin containing the low edge of each lookup bucket, plus a final entry for the
+        // last bin, and the number of buckets per unit value.
+        std::vector<int> _bucketBin;
+        double _bucketScale;
 	}; // NonUniformBinning
 } // likely
 
@@ -3,6 +3,7 @@
 #include "likely/NonUniformSampling.h"
 #include "likely/BinningError.h"
 
+#include <algorithm>
 #include <cmath>
 #include <ostream>
 
@@ -31,17 +32,23 @@ local::NonUniformSampling::NonUniformSampling(std::vector<double> const &sampleP
 local::NonUniformSampling::~NonUniformSampling() { }
 
 int local::NonUniformSampling::getBinIndex(double value) const {
+    int nSamples(_samplePoints.size());
     if(value < (_samplePoints[0] - _ftol*(_samplePoints[1]-_samplePoints[0]))) {
         throw BinningError("getBinIndex: value is below binning interval.");
     }
-    for(int sample = 0; sample < _samplePoints.size(); ++sample) {
+    // Bisect to find the first sample above value. The only candidates are this sample and the
+    // last sample <= value (or the first of several identical samples).
+    int above(std::upper_bound(_samplePoints.begin(),_samplePoints.end(),value) - _samplePoints.begin());
+    int below(above-1);
+    while(below > 0 && _samplePoints[below-1] == _samplePoints[below]) --below;
+    for(int sample = std::max(0,below); sample <= above && sample < nSamples; ++sample) {
         int prev = (sample > 0) ? sample-1 : 0;
-        int next = (sample < _samplePoints.size()-1) ? sample+1 : _samplePoints.size()-1;
+        int next = (sample < nSamples-1) ? sample+1 : nSamples-1;
         double scale = (next > prev) ? (_samplePoints[next] - _samplePoints[prev])/(next-prev) : 0;
-        if(std::fabs(getBinCenter(sample) - value) <= _ftol*scale) return sample;
-        if(value < getBinCenter(sample)) {
-            throw BinningError("getBinIndex: value is not one of our samples.");
-        }
+        if(std::fabs(_samplePoints[sample] - value) <= _ftol*scale) return sample;
+    }
+    if(above < nSamples) {
+        throw BinningError("getBinIndex: value is not one of our samples.");
     }
     throw BinningError("getBinIndex: value is above binning interval.");
 }
@@ -19,7 +19,8 @@ namespace likely {
 		virtual ~NonUniformSampling();
         // Returns the bin index [0,nBins-1] corresponding to the specified value, or throws a
         // BinningError if value is not within ftol*spacing of a sample point, where spacing is the
-        // average spacing of nearby sample points.
+        // average spacing of nearby sample points. Uses bisection to find the nearest samples
+        // in O(log(nBins)) time.
         virtual int getBinIndex(double value) const;
         // Returns the total number of bins.
         virtual int getNBins() const;
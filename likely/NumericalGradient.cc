@@ -0,0 +1,189 @@
+#include "likely/NumericalGradient.h"
+#include "likely/RuntimeError.h"
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+
+#include <vector>
+#include <string>
+
+namespace local = likely;
+
+namespace likely {
+    struct NumericalGradient::Implementation {
+        ~Implementation();
+        FunctionPtr f;
+        Method method;
+        int nPar, pointsPerParam, nPoints;
+        // The index and step size of each floating parameter.
+        std::vector<int> floatingIndex;
+        std::vector<double> steps;
+        // The state of the gradient currently being calculated, protected by mutex.
+        Parameters const *center;
+        std::vector<double> values;
+        int next, nDone;
+        long generation, evalCount;
+        bool stop;
+        std::string error;
+        boost::mutex mutex, callMutex;
+        boost::condition_variable work, done;
+        boost::thread_group workers;
+        // Returns the offset of the specified stencil point from the center, in units of
+        // the corresponding parameter's step size.
+        double getOffset(int point) const;
+        // Evaluates stencil points until none are left, using the specified workspace.
+        void evaluatePoints(Parameters &workspace);
+        // Waits for each new gradient and helps evaluate its stencil points.
+        void workerLoop();
+    }; // NumericalGradient::Implementation
+} // likely::
+
+local::NumericalGradient::Implementation::~Implementation() {
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stop = true;
+        work.notify_all();
+    }
+    workers.join_all();
+}
+
+double local::NumericalGradient::Implementation::getOffset(int point) const {
+    static const double offsets[4] = { +1, -1, +0.5, -0.5 };
+    return offsets[point % pointsPerParam];
+}
+
+void local::NumericalGradient::Implementation::evaluatePoints(Parameters &workspace) {
+    boost::mutex::scoped_lock lock(mutex);
+    while(next < nPoints) {
+        int point = next++;
+        lock.unlock();
+        int k(point/pointsPerParam), index(floatingIndex[k]);
+        double value(0);
+        std::string message;
+        try {
+            workspace = *center;
+            workspace[index] += getOffset(point)*steps[k];
+            value = (*f)(workspace);
+        }
+        catch(std::exception const &e) {
+            message = e.what();
+        }
+        lock.lock();
+        if(message.length() > 0 && error.length() == 0) error = message;
+        values[point] = value;
+        evalCount++;
+        if(++nDone == nPoints) done.notify_all();
+    }
+}
+
+void local::NumericalGradient::Implementation::workerLoop() {
+    Parameters workspace;
+    long seen(0);
+    boost::mutex::scoped_lock lock(mutex);
+    while(true) {
+        while(!stop && generation == seen) work.wait(lock);
+        if(stop) return;
+        seen = generation;
+        lock.unlock();
+        evaluatePoints(workspace);
+        lock.lock();
+    }
+}
+
+local::NumericalGradient::NumericalGradient(FunctionPtr f, FitParameters const &parameters,
+Method method, double stepScale, int nThreads)
+: _pimpl(new Implementation())
+{
+    if(!f) {
+        throw RuntimeError("NumericalGradient: missing function.");
+    }
+    if(stepScale <= 0) {
+        throw RuntimeError("NumericalGradient: expected stepScale > 0.");
+    }
+    if(nThreads < 0) {
+        throw RuntimeError("NumericalGradient: expected nThreads >= 0.");
+    }
+    _pimpl->f = f;
+    _pimpl->method = method;
+    _pimpl->nPar = parameters.size();
+    for(int index = 0; index < _pimpl->nPar; ++index) {
+        if(!parameters[index].isFloating()) continue;
+        _pimpl->floatingIndex.push_back(index);
+        _pimpl->steps.push_back(stepScale*parameters[index].getError());
+    }
+    _pimpl->pointsPerParam = (method == Richardson) ? 4 : 2;
+    _pimpl->nPoints = _pimpl->pointsPerParam*_pimpl->floatingIndex.size();
+    _pimpl->values.resize(_pimpl->nPoints);
+    _pimpl->center = 0;
+    _pimpl->next = _pimpl->nDone = _pimpl->nPoints;
+    _pimpl->generation = _pimpl->evalCount = 0;
+    _pimpl->stop = false;
+    // The calling thread always evaluates points too, so only start nThreads-1 workers.
+    if(0 == nThreads) nThreads = boost::thread::hardware_concurrency();
+    if(nThreads > _pimpl->nPoints) nThreads = _pimpl->nPoints;
+    for(int thread = 1; thread < nThreads; ++thread) {
+        _pimpl->workers.create_thread(boost::bind(&Implementation::workerLoop,_pimpl.get()));
+    }
+}
+
+local::NumericalGradient::~NumericalGradient() { }
+
+void local::NumericalGradient::operator()(Parameters const &pValues, Gradient &gValues) const {
+    if(pValues.size() != _pimpl->nPar) {
+        throw RuntimeError("NumericalGradient: gradient evaluated with wrong number of parameters.");
+    }
+    boost::mutex::scoped_lock callLock(_pimpl->callMutex);
+    // Publish this gradient's stencil to our workers.
+    {
+        boost::mutex::scoped_lock lock(_pimpl->mutex);
+        _pimpl->center = &pValues;
+        _pimpl->next = _pimpl->nDone = 0;
+        _pimpl->error.clear();
+        _pimpl->generation++;
+        _pimpl->work.notify_all();
+    }
+    // Help evaluate the stencil points and wait for any that are still being evaluated.
+    Parameters workspace;
+    _pimpl->evaluatePoints(workspace);
+    {
+        boost::mutex::scoped_lock lock(_pimpl->mutex);
+        while(_pimpl->nDone < _pimpl->nPoints) _pimpl->done.wait(lock);
+        _pimpl->center = 0;
+        if(_pimpl->error.length() > 0) {
+            throw RuntimeError("NumericalGradient: " + _pimpl->error);
+        }
+    }
+    // Combine the function values at the stencil points.
+    gValues.assign(_pimpl->nPar,0);
+    for(int k = 0; k < _pimpl->floatingIndex.size(); ++k) {
+        double h(_pimpl->steps[k]);
+        double const *v = &_pimpl->values[k*_pimpl->pointsPerParam];
+        double coarse((v[0]-v[1])/(2*h));
+        if(_pimpl->method == Richardson) {
+            double fine((v[2]-v[3])/h);
+            gValues[_pimpl->floatingIndex[k]] = (4*fine - coarse)/3;
+        }
+        else {
+            gValues[_pimpl->floatingIndex[k]] = coarse;
+        }
+    }
+}
+
+long local::NumericalGradient::getEvalCount() const {
+    boost::mutex::scoped_lock lock(_pimpl->mutex);
+    return _pimpl->evalCount;
+}
+
+int local::NumericalGradient::getPointsPerGradient() const {
+    return _pimpl->nPoints;
+}
+
+local::GradientCalculatorPtr local::createNumericalGradientCalculator(FunctionPtr f,
+FitParameters const &parameters, NumericalGradient::Method method, double stepScale,
+int nThreads) {
+    GradientCalculatorPtr gc(new GradientCalculator(
+        NumericalGradient(f,parameters,method,stepScale,nThreads)));
+    return gc;
+}
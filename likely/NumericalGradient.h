@@ -0,0 +1,51 @@
+#ifndef LIKELY_NUMERICAL_GRADIENT
+#define LIKELY_NUMERICAL_GRADIENT
+
+#include "likely/types.h"
+#include "likely/FitParameter.h"
+
+#include "boost/smart_ptr.hpp"
+
+namespace likely {
+    // Estimates the gradient of a function using finite differences, for use as a
+    // GradientCalculator with engines that need derivatives. The step size for each
+    // floating parameter is a fixed fraction of its FitParameter error, and the gradient
+    // components of fixed parameters are always zero. The function values at the stencil
+    // points are evaluated concurrently by a pool of worker threads that is created once
+    // and reused for every gradient, so the function must be safe to call from several
+    // threads at once. Copies of this object share the same worker pool and counters.
+	class NumericalGradient {
+	public:
+        // Central differences use the 2 points x +/- h per parameter and have errors O(h^2).
+        // Richardson extrapolation combines central differences with steps h and h/2, using
+        // 4 points per parameter, to cancel the leading error term and achieve O(h^4).
+        enum Method { CentralDifference, Richardson };
+	    // Creates a new gradient calculator for the specified function. Uses steps of
+	    // stepScale times each floating parameter's error. Evaluations are divided among
+	    // nThreads threads (including the calling thread), or the number of available cores
+	    // if nThreads is zero. Throws a RuntimeError for invalid arguments.
+		NumericalGradient(FunctionPtr f, FitParameters const &parameters,
+            Method method = CentralDifference, double stepScale = 1e-3, int nThreads = 0);
+		virtual ~NumericalGradient();
+        // Calculates the gradient at the specified parameter values. Calls from different
+        // threads are serialized. Throws a RuntimeError if the function throws an exception.
+        void operator()(Parameters const &pValues, Gradient &gValues) const;
+        // Returns the total number of function evaluations used so far.
+        long getEvalCount() const;
+        // Returns the number of function evaluations used for each gradient.
+        int getPointsPerGradient() const;
+	private:
+        class Implementation;
+        boost::shared_ptr<Implementation> _pimpl;
+	}; // NumericalGradient
+
+	// Returns a smart pointer to a new NumericalGradient gradient calculator. Any evaluations it
+	// performs while it is used by findMinimum are included in the engine's evaluation count.
+	GradientCalculatorPtr createNumericalGradientCalculator(FunctionPtr f,
+        FitParameters const &parameters,
+        NumericalGradient::Method method = NumericalGradient::CentralDifference,
+        double stepScale = 1e-3, int nThreads = 0);
+
+} // likely
+
+#endif // LIKELY_NUMERICAL_GRADIENT
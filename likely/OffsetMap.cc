@@ -0,0 +1,91 @@
+#include "likely/OffsetMap.h"
+#include "likely/RuntimeError.h"
+
+namespace local = likely;
+
+namespace {
+    // Index ranges up to this size always use a dense table.
+    const int minSparseSize = 4096;
+    // The initial capacity of a hash table, which must be a power of two.
+    const int minCapacity = 64;
+}
+
+local::OffsetMap::OffsetMap(int size) {
+    reset(size);
+}
+
+local::OffsetMap::~OffsetMap() { }
+
+void local::OffsetMap::reset(int size) {
+    if(size < 0) {
+        throw RuntimeError("OffsetMap: expected size >= 0.");
+    }
+    _size = size;
+    _count = 0;
+    if(size <= minSparseSize) {
+        std::vector<int>(size,-1).swap(_dense);
+        std::vector<int>().swap(_keys);
+        std::vector<int>().swap(_values);
+        _mask = _shift = 0;
+    }
+    else {
+        std::vector<int>().swap(_dense);
+        _rehash(minCapacity);
+    }
+}
+
+void local::OffsetMap::set(int index, int offset) {
+    if(_keys.empty()) {
+        if(_dense[index] == -1) _count++;
+        _dense[index] = offset;
+        return;
+    }
+    int slot(_find(index));
+    if(_keys[slot] == -1) {
+        // Each hash table entry uses up to 16 bytes, including empty slots, compared with 4 bytes
+        // per index for a dense table, so switch to a dense table when it would be smaller.
+        if(4*(_count+1L) >= _size) {
+            _makeDense();
+            set(index,offset);
+            return;
+        }
+        // Keep our load factor below 1/2.
+        if(2*(_count+1) > (int)_keys.size()) {
+            _rehash(2*_keys.size());
+            slot = _find(index);
+        }
+        _keys[slot] = index;
+        _count++;
+    }
+    _values[slot] = offset;
+}
+
+std::size_t local::OffsetMap::getMemoryUsage() const {
+    return sizeof(int)*(_dense.capacity() + _keys.capacity() + _values.capacity());
+}
+
+void local::OffsetMap::_rehash(int capacity) {
+    std::vector<int> keys(capacity,-1), values(capacity,-1);
+    keys.swap(_keys);
+    values.swap(_values);
+    _mask = capacity-1;
+    // Our hash uses the top log2(capacity) bits of a 32-bit product.
+    _shift = 32;
+    while((1 << (32 - _shift)) < capacity) _shift--;
+    for(int slot = 0; slot < keys.size(); ++slot) {
+        if(keys[slot] == -1) continue;
+        int newSlot(_find(keys[slot]));
+        _keys[newSlot] = keys[slot];
+        _values[newSlot] = values[slot];
+    }
+}
+
+void local::OffsetMap::_makeDense() {
+    std::vector<int>(_size,-1).swap(_dense);
+    for(int slot = 0; slot < _keys.size(); ++slot) {
+        if(_keys[slot] != -1) _dense[_keys[slot]] = _values[slot];
+    }
+    std::vector<int>().swap(_keys);
+    std::vector<int>().swap(_values);
+    _mask = _shift = 0;
+}
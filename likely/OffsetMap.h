@@ -0,0 +1,64 @@
+#ifndef LIKELY_OFFSET_MAP
+#define LIKELY_OFFSET_MAP
+
+#include <vector>
+#include <cstddef>
+
+namespace likely {
+    // Maps integer indices in [0,size-1] to non-negative integer offsets, as used by BinnedData
+    // to locate the storage for each occupied bin of a grid. Uses a dense table with one entry
+    // per possible index when a large fraction of indices are mapped, and otherwise an
+    // open-addressing hash table whose memory usage is proportional to the number of mapped
+    // indices. The representation is selected automatically and switches from sparse to dense
+    // as entries are added. Lookups take O(1) time in either representation.
+	class OffsetMap {
+	public:
+	    // Creates a new empty map for indices in [0,size-1].
+		explicit OffsetMap(int size = 0);
+		virtual ~OffsetMap();
+        // Returns the offset mapped to the specified index, or -1 if there is none. The index
+        // must be in range but this is not checked.
+        int get(int index) const;
+        // Maps the specified index to a non-negative offset, replacing any previous offset.
+        // The index must be in range but this is not checked.
+        void set(int index, int offset);
+        // Removes all entries and sets a new index range.
+        void reset(int size);
+        // Returns the number of indices that have an offset.
+        int getCount() const;
+        // Returns true if we are currently using a sparse representation.
+        bool isSparse() const;
+        // Returns the memory used by our tables.
+        std::size_t getMemoryUsage() const;
+	private:
+        // Returns the position of the specified index in our hash table, or of the empty
+        // slot where it should be inserted.
+        int _find(int index) const;
+        // Rebuilds our hash table with the specified capacity, which must be a power of two.
+        void _rehash(int capacity);
+        // Switches to our dense representation.
+        void _makeDense();
+        int _size, _count, _mask, _shift;
+        // Our dense table of offsets for each index, which is empty when we are sparse.
+        std::vector<int> _dense;
+        // Our hash table of (index,offset) pairs with -1 indicating an empty slot.
+        std::vector<int> _keys, _values;
+	}; // OffsetMap
+
+    inline int OffsetMap::get(int index) const {
+        if(_keys.empty()) return _dense[index];
+        return _values[_find(index)];
+    }
+    inline int OffsetMap::getCount() const { return _count; }
+    inline bool OffsetMap::isSparse() const { return !_keys.empty(); }
+
+    inline int OffsetMap::_find(int index) const {
+        // Use a multiplicative (Fibonacci) hash with linear probing.
+        int slot = (int)(((unsigned int)index*2654435769u) >> _shift);
+        while(_keys[slot] != index && _keys[slot] != -1) slot = (slot + 1) & _mask;
+        return slot;
+    }
+
+} // likely
+
+#endif // LIKELY_OFFSET_MAP
@@ -7,6 +7,7 @@
 #include "boost/random/normal_distribution.hpp"
 #include "boost/random/uniform_int_distribution.hpp"
 #include "boost/random/variate_generator.hpp"
+#include "boost/random/seed_seq.hpp"
 #include "boost/lexical_cast.hpp"
 
 #include <cmath>
@@ -20,14 +21,27 @@
 
 namespace local = likely;
 
+namespace likely {
+    // Holds the SFMT generator state used by a single Random object.
+    class Random::Implementation {
+    public:
+        sfmt_t sfmt;
+    };
+}
+
 local::Random::Random() :
+_seed(boost::mt19937::default_seed),
 _uniform(boost::variate_generator<boost::mt19937&, boost::uniform_01<> >
     (_generator, boost::uniform_01<>())),
 _gauss(boost::variate_generator<boost::mt19937&, boost::normal_distribution<> >
-    (_generator, boost::normal_distribution<>(0,1)))
+    (_generator, boost::normal_distribution<>(0,1))),
+_pimpl(new Implementation())
 {
+    init_gen_rand(&_pimpl->sfmt,_seed);
 }
 
+local::Random::~Random() { }
+
 local::RandomPtr local::Random::instance() {
     // Allocate a new Random object the first time we are called, and associate it with
     // a static RandomPtr, so its reference count is always at least one.
@@ -37,8 +51,28 @@ local::RandomPtr local::Random::instance() {
 }
 
 void local::Random::setSeed(int seedValue) {
+    _seed = seedValue;
     _generator.seed(seedValue);
-    init_gen_rand(seedValue);
+    init_gen_rand(&_pimpl->sfmt,seedValue);
+}
+
+local::RandomPtr local::Random::createStream(int streamIndex) const {
+    if(streamIndex < 0) {
+        throw RuntimeError("Random::createStream: expected streamIndex >= 0.");
+    }
+    RandomPtr stream(new Random());
+    // Split our master seed using the stream index as an additional key. Both generator
+    // states are initialized from this key by algorithms that are different from (and so
+    // do not coincide with) the single-integer seeding used by setSeed.
+    uint32_t key[2] = { (uint32_t)_seed, (uint32_t)streamIndex };
+    boost::random::seed_seq seq(key,key+2);
+    stream->_generator.seed(seq);
+    init_by_array(&stream->_pimpl->sfmt,key,2);
+    // Derive a master seed for any nested substreams of this stream.
+    uint32_t nested;
+    seq.generate(&nested,&nested+1);
+    stream->_seed = (int)nested;
+    return stream;
 }
 
 int local::Random::getInteger(int min, int max) {
@@ -70,7 +104,7 @@ void local::Random::sampleWithReplacement(std::vector<int> &sample, int size) {
 }
 
 float local::Random::getFastUniform() {
-    return genrand_res53();
+    return genrand_res53(&_pimpl->sfmt);
 }
 
 void *local::allocateAlignedArray(std::size_t byteSize) {
@@ -127,8 +161,8 @@ int seed, int stride, int minimum) {
         ngen += stride - (ngen % stride);
     }
     // Set the random seed.
-    init_gen_rand(seed);
-    if(!initialized || idx != N32) {
+    init_gen_rand(&_pimpl->sfmt,seed);
+    if(!_pimpl->sfmt.initialized || _pimpl->sfmt.idx != N32) {
         throw RuntimeError("Random: init_gen_rand failed.");
     }
     return ngen;
@@ -143,8 +177,8 @@ boost::shared_array<double> local::Random::fillDoubleArrayUniform(std::size_t &n
     boost::shared_array<double> sarray = allocateAlignedDoubleArray(nrandom);
     double *array = sarray.get();
     // Fill the array with random bits.
-    gen_rand_array((w128_t *)array, nrandom/2);
-    idx = N32;
+    gen_rand_array(&_pimpl->sfmt,(w128_t *)array, nrandom/2);
+    _pimpl->sfmt.idx = N32;
 #if defined(BIG_ENDIAN64)
     swap((w128_t *)array, nrandom /2);
 #endif
@@ -171,8 +205,8 @@ boost::shared_array<double> local::Random::fillDoubleArrayNormal(std::size_t &nr
     // Calculate the 64-bit offset for filling the array in the top of the output array.
     int offset = nrandom - ngen/2;
     // Fill the array with random bits.
-    gen_rand_array((w128_t *)(array+offset), ngen/4);
-    idx = N32;    
+    gen_rand_array(&_pimpl->sfmt,(w128_t *)(array+offset), ngen/4);
+    _pimpl->sfmt.idx = N32;    
     // Calculate where to start reading the 32-bit random integers so we will not
     // overwrite them as we save the new double values. Step n involves reading the next
     // 32-bit int from [offset+n] and writing the new double into [2n] and [2n+1], so
@@ -197,8 +231,8 @@ boost::shared_array<float> local::Random::fillFloatArrayNormal(std::size_t &nran
     boost::shared_array<float> sarray = allocateAlignedFloatArray(nrandom);
     float *array = sarray.get();
     // Fill the array with random bits.
-    gen_rand_array((w128_t *)array, nrandom/4);
-    idx = N32;
+    gen_rand_array(&_pimpl->sfmt,(w128_t *)array, nrandom/4);
+    _pimpl->sfmt.idx = N32;
     // Read random integers and convert them to normally distributed floats.
     uint32_t *ptr((uint32_t*)array);
     for(int index = 0; index < nrandom; ++index) {
@@ -225,16 +259,16 @@ double local::Random::_zigguratConvert(uint32_t U) {
             double  y0, y1;
             y0 = _ziggurat_ytab[i];
             y1 = _ziggurat_ytab[i+1];
-            y = y1+(y0-y1)*genrand_res53();
+            y = y1+(y0-y1)*genrand_res53(&_pimpl->sfmt);
         }
         else {
-            x = PARAM_R - std::log(1.0-genrand_res53())/PARAM_R;
-            y = std::exp(-PARAM_R*(x-0.5*PARAM_R))*genrand_res53();
+            x = PARAM_R - std::log(1.0-genrand_res53(&_pimpl->sfmt))/PARAM_R;
+            y = std::exp(-PARAM_R*(x-0.5*PARAM_R))*genrand_res53(&_pimpl->sfmt);
         }
         if (y < std::exp(-0.5*x*x))  break;
         // If we get here, we need a new 32-bit random number in U.
         // We actually generate a 64-bit random integer to stay in synch.
-        U = gen_rand64() & 0xffffffff;
+        U = gen_rand64(&_pimpl->sfmt) & 0xffffffff;
     }
     return sign ? +x : -x;
 }
@@ -8,15 +8,35 @@
 #include "boost/random/mersenne_twister.hpp"
 #include "boost/function.hpp"
 #include "boost/smart_ptr.hpp"
+#include "boost/utility.hpp"
 
 #include <cstddef>
 #include <vector>
 
 namespace likely {
-	class Random {
+	// Each Random object owns its generator state, so different objects can be used
+	// concurrently from different threads, but a single object (including the shared
+	// instance()) should only be used by one thread at a time. Use createStream to
+	// give each thread or task its own reproducible substream of a master seed.
+	class Random : public boost::noncopyable {
 	public:
 		Random();
+		virtual ~Random();
+		// Sets the master seed used for all random numbers generated by this object,
+		// and by any substreams subsequently created with createStream.
         void setSeed(int seedValue);
+        // Returns the master seed set by the last call to setSeed, or the default seed.
+        int getSeed() const;
+        // Returns a new generator for the substream with the specified index, derived from
+        // this object's master seed. Substreams are independent of this object's own sequence
+        // and of each other, and each has its own generator and SFMT state so that different
+        // substreams can be used concurrently. The values generated by a substream depend
+        // only on the master seed and streamIndex (and not on which thread uses it or when it
+        // is created) so results are reproducible. Substreams are obtained by seed-splitting:
+        // the (seed,streamIndex) pair is hashed via a seed sequence into the full generator
+        // states, so overlaps between substreams are vanishingly unlikely given the 2^19937-1
+        // periods involved.
+        RandomPtr createStream(int streamIndex) const;
 
         // Returns a double-precision value uniformly sampled from [0,1).
         double getUniform();
@@ -37,8 +57,8 @@ namespace likely {
         // This is provided to support efficient generation of bootstrap samples.
         void sampleWithReplacement(std::vector<int> &sample, int size);
         
-        // Returns a single-precision value uniformly sampled from [0,1) using
-        // an inline coding of SFMT (http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/SFMT/)
+        // Returns a single-precision value uniformly sampled from [0,1) using this object's
+        // own state and an inline coding of SFMT (http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/SFMT/)
         float getFastUniform();
         // Returns a shared array filled with at least nrandom double-precision values uniformly
         // sampled from [0,1) using the specified seed (that is independent of the seed used by
@@ -70,22 +90,27 @@ namespace likely {
 	private:
 	    // Performs common initialization for the fillXArrayY methods and returns the actual
 	    // array size to allocate for filling, which will be >= nrandom.
-        static std::size_t _initializeFill(std::size_t nrandom, int seed, int stride, int minimum);
+        std::size_t _initializeFill(std::size_t nrandom, int seed, int stride, int minimum);
         // Converts a random 32-bit unsigned integer into a normally distributed double. Note that
         // the result does not have a full 64 bits of randomness. Uses the Ziggurat algorithm
         // described at http://www.seehuhn.de/pages/ziggurat. A small fraction of the time,
         // additional random integers will need to be generated by calling the SFMT genrand_res53()
-        // and gen_rand64() routines, so the SFMT generator must be appropriately initialized.
-        static double _zigguratConvert(uint32_t U);
+        // and gen_rand64() routines on this object's SFMT state, so that state must be
+        // appropriately initialized.
+        double _zigguratConvert(uint32_t U);
+        int _seed;
         boost::mt19937 _generator;
         boost::function<double ()> _uniform, _gauss;
         static const double _ziggurat_ytab[128], _ziggurat_wtab[128];
         static const uint32_t _ziggurat_ktab[128];
+        class Implementation;
+        boost::scoped_ptr<Implementation> _pimpl;
 	}; // Random
 	
     inline double Random::getUniform() { return _uniform(); }
     inline double Random::getNormal() { return _gauss(); }
     inline boost::mt19937 &Random::getGenerator() { return _generator; }
+    inline int Random::getSeed() const { return _seed; }
 	
     // Allocates an array with the 128-bit alignment required by the Random::fillArrayX methods
     // where size is in bytes.
@@ -65,22 +65,27 @@ typedef struct W128_T w128_t;
 #endif
 
 /*--------------------------------------
-  FILE GLOBAL VARIABLES
-  internal state, index counter and flag 
+  GENERATOR STATE
+  internal state, index counter and flag,
+  held per generator (instead of as file
+  globals) so that independent generators
+  can be used concurrently
   --------------------------------------*/
-/** the 128-bit internal state array */
-static w128_t sfmt[N];
+struct SFMT_T {
+    /** the 128-bit internal state array */
+    w128_t state[N];
+    /** index counter to the 32-bit internal state array */
+    int idx;
+    /** a flag: it is 0 if and only if the internal state is not yet
+     * initialized. */
+    int initialized;
+};
 /** the 32bit integer pointer to the 128-bit internal state array */
-static uint32_t *psfmt32 = &sfmt[0].u[0];
+#define PSFMT32(ctx) (&(ctx)->state[0].u[0])
 #if !defined(BIG_ENDIAN64) || defined(ONLY64)
 /** the 64bit integer pointer to the 128-bit internal state array */
-static uint64_t *psfmt64 = (uint64_t *)&sfmt[0].u[0];
+#define PSFMT64(ctx) ((uint64_t *)&(ctx)->state[0].u[0])
 #endif
-/** index counter to the 32-bit internal state array */
-static int idx;
-/** a flag: it is 0 if and only if the internal state is not yet
- * initialized. */
-static int initialized = 0;
 /** a parity check vector which certificate the period of 2^{MEXP} */
 static uint32_t parity[4] = {PARITY1, PARITY2, PARITY3, PARITY4};
 
@@ -90,11 +95,11 @@ static uint32_t parity[4] = {PARITY1, PARITY2, PARITY3, PARITY4};
 inline static int idxof(int i);
 inline static void rshift128(w128_t *out,  w128_t const *in, int shift);
 inline static void lshift128(w128_t *out,  w128_t const *in, int shift);
-inline static void gen_rand_all(void);
-inline static void gen_rand_array(w128_t *array, int size);
+inline static void gen_rand_all(sfmt_t *ctx);
+inline static void gen_rand_array(sfmt_t *ctx, w128_t *array, int size);
 inline static uint32_t func1(uint32_t x);
 inline static uint32_t func2(uint32_t x);
-static void period_certification(void);
+static void period_certification(sfmt_t *ctx);
 #if defined(BIG_ENDIAN64) && !defined(ONLY64)
 inline static void swap(w128_t *array, int size);
 #endif
@@ -248,21 +253,21 @@ inline static void do_recursion(w128_t *r, w128_t *a, w128_t *b, w128_t *c,
  * This function fills the internal state array with pseudorandom
  * integers.
  */
-inline static void gen_rand_all(void) {
+inline static void gen_rand_all(sfmt_t *ctx) {
     int i;
     w128_t *r1, *r2;
 
-    r1 = &sfmt[N - 2];
-    r2 = &sfmt[N - 1];
+    r1 = &ctx->state[N - 2];
+    r2 = &ctx->state[N - 1];
     for (i = 0; i < N - POS1; i++) {
-	do_recursion(&sfmt[i], &sfmt[i], &sfmt[i + POS1], r1, r2);
+	do_recursion(&ctx->state[i], &ctx->state[i], &ctx->state[i + POS1], r1, r2);
 	r1 = r2;
-	r2 = &sfmt[i];
+	r2 = &ctx->state[i];
     }
     for (; i < N; i++) {
-	do_recursion(&sfmt[i], &sfmt[i], &sfmt[i + POS1 - N], r1, r2);
+	do_recursion(&ctx->state[i], &ctx->state[i], &ctx->state[i + POS1 - N], r1, r2);
 	r1 = r2;
-	r2 = &sfmt[i];
+	r2 = &ctx->state[i];
     }
 }
 
@@ -273,19 +278,19 @@ inline static void gen_rand_all(void) {
  * @param array an 128-bit array to be filled by pseudorandom numbers.  
  * @param size number of 128-bit pseudorandom numbers to be generated.
  */
-inline static void gen_rand_array(w128_t *array, int size) {
+inline static void gen_rand_array(sfmt_t *ctx, w128_t *array, int size) {
     int i, j;
     w128_t *r1, *r2;
 
-    r1 = &sfmt[N - 2];
-    r2 = &sfmt[N - 1];
+    r1 = &ctx->state[N - 2];
+    r2 = &ctx->state[N - 1];
     for (i = 0; i < N - POS1; i++) {
-	do_recursion(&array[i], &sfmt[i], &sfmt[i + POS1], r1, r2);
+	do_recursion(&array[i], &ctx->state[i], &ctx->state[i + POS1], r1, r2);
 	r1 = r2;
 	r2 = &array[i];
     }
     for (; i < N; i++) {
-	do_recursion(&array[i], &sfmt[i], &array[i + POS1 - N], r1, r2);
+	do_recursion(&array[i], &ctx->state[i], &array[i + POS1 - N], r1, r2);
 	r1 = r2;
 	r2 = &array[i];
     }
@@ -295,13 +300,13 @@ inline static void gen_rand_array(w128_t *array, int size) {
 	r2 = &array[i];
     }
     for (j = 0; j < 2 * N - size; j++) {
-	sfmt[j] = array[j + size - N];
+	ctx->state[j] = array[j + size - N];
     }
     for (; i < size; i++, j++) {
 	do_recursion(&array[i], &array[i - N], &array[i + POS1 - N], r1, r2);
 	r1 = r2;
 	r2 = &array[i];
-	sfmt[j] = array[i];
+	ctx->state[j] = array[i];
     }
 }
 #endif
@@ -344,13 +349,13 @@ static uint32_t func2(uint32_t x) {
 /**
  * This function certificate the period of 2^{MEXP}
  */
-static void period_certification(void) {
+static void period_certification(sfmt_t *ctx) {
     int inner = 0;
     int i, j;
     uint32_t work;
 
     for (i = 0; i < 4; i++)
-	inner ^= psfmt32[idxof(i)] & parity[i];
+	inner ^= PSFMT32(ctx)[idxof(i)] & parity[i];
     for (i = 16; i > 0; i >>= 1)
 	inner ^= inner >> i;
     inner &= 1;
@@ -363,7 +368,7 @@ static void period_certification(void) {
 	work = 1;
 	for (j = 0; j < 32; j++) {
 	    if ((work & parity[i]) != 0) {
-		psfmt32[idxof(i)] ^= work;
+		PSFMT32(ctx)[idxof(i)] ^= work;
 		return;
 	    }
 	    work = work << 1;
@@ -407,15 +412,15 @@ int get_min_array_size64(void) {
  * init_gen_rand or init_by_array must be called before this function.
  * @return 32-bit pseudorandom number
  */
-uint32_t gen_rand32(void) {
+uint32_t gen_rand32(sfmt_t *ctx) {
     uint32_t r;
 
-    assert(initialized);
-    if (idx >= N32) {
-	gen_rand_all();
-	idx = 0;
+    assert(ctx->initialized);
+    if (ctx->idx >= N32) {
+	gen_rand_all(ctx);
+	ctx->idx = 0;
     }
-    r = psfmt32[idx++];
+    r = PSFMT32(ctx)[ctx->idx++];
     return r;
 }
 #endif
@@ -426,28 +431,28 @@ uint32_t gen_rand32(void) {
  * unless an initialization is again executed. 
  * @return 64-bit pseudorandom number
  */
-uint64_t gen_rand64(void) {
+uint64_t gen_rand64(sfmt_t *ctx) {
 #if defined(BIG_ENDIAN64) && !defined(ONLY64)
     uint32_t r1, r2;
 #else
     uint64_t r;
 #endif
 
-    assert(initialized);
-    assert(idx % 2 == 0);
+    assert(ctx->initialized);
+    assert(ctx->idx % 2 == 0);
 
-    if (idx >= N32) {
-	gen_rand_all();
-	idx = 0;
+    if (ctx->idx >= N32) {
+	gen_rand_all(ctx);
+	ctx->idx = 0;
     }
 #if defined(BIG_ENDIAN64) && !defined(ONLY64)
-    r1 = psfmt32[idx];
-    r2 = psfmt32[idx + 1];
-    idx += 2;
+    r1 = PSFMT32(ctx)[ctx->idx];
+    r2 = PSFMT32(ctx)[ctx->idx + 1];
+    ctx->idx += 2;
     return ((uint64_t)r2 << 32) | r1;
 #else
-    r = psfmt64[idx / 2];
-    idx += 2;
+    r = PSFMT64(ctx)[ctx->idx / 2];
+    ctx->idx += 2;
     return r;
 #endif
 }
@@ -478,14 +483,14 @@ uint64_t gen_rand64(void) {
  * memory. Mac OSX doesn't have these functions, but \b malloc of OSX
  * returns the pointer to the aligned memory block.
  */
-void fill_array32(uint32_t *array, int size) {
-    assert(initialized);
-    assert(idx == N32);
+void fill_array32(sfmt_t *ctx, uint32_t *array, int size) {
+    assert(ctx->initialized);
+    assert(ctx->idx == N32);
     assert(size % 4 == 0);
     assert(size >= N32);
 
-    gen_rand_array((w128_t *)array, size / 4);
-    idx = N32;
+    gen_rand_array(ctx, (w128_t *)array, size / 4);
+    ctx->idx = N32;
 }
 #endif
 
@@ -514,14 +519,14 @@ void fill_array32(uint32_t *array, int size) {
  * memory. Mac OSX doesn't have these functions, but \b malloc of OSX
  * returns the pointer to the aligned memory block.
  */
-void fill_array64(uint64_t *array, int size) {
-    assert(initialized);
-    assert(idx == N32);
+void fill_array64(sfmt_t *ctx, uint64_t *array, int size) {
+    assert(ctx->initialized);
+    assert(ctx->idx == N32);
     assert(size % 2 == 0);
     assert(size >= N64);
 
-    gen_rand_array((w128_t *)array, size / 2);
-    idx = N32;
+    gen_rand_array(ctx, (w128_t *)array, size / 2);
+    ctx->idx = N32;
 
 #if defined(BIG_ENDIAN64) && !defined(ONLY64)
     swap((w128_t *)array, size /2);
@@ -534,18 +539,18 @@ void fill_array64(uint64_t *array, int size) {
  *
  * @param seed a 32-bit integer used as the seed.
  */
-void init_gen_rand(uint32_t seed) {
+void init_gen_rand(sfmt_t *ctx, uint32_t seed) {
     int i;
 
-    psfmt32[idxof(0)] = seed;
+    PSFMT32(ctx)[idxof(0)] = seed;
     for (i = 1; i < N32; i++) {
-	psfmt32[idxof(i)] = 1812433253UL * (psfmt32[idxof(i - 1)] 
-					    ^ (psfmt32[idxof(i - 1)] >> 30))
+	PSFMT32(ctx)[idxof(i)] = 1812433253UL * (PSFMT32(ctx)[idxof(i - 1)] 
+					    ^ (PSFMT32(ctx)[idxof(i - 1)] >> 30))
 	    + i;
     }
-    idx = N32;
-    period_certification();
-    initialized = 1;
+    ctx->idx = N32;
+    period_certification(ctx);
+    ctx->initialized = 1;
 }
 
 /**
@@ -554,7 +559,7 @@ void init_gen_rand(uint32_t seed) {
  * @param init_key the array of 32-bit integers, used as a seed.
  * @param key_length the length of init_key.
  */
-void init_by_array(uint32_t *init_key, int key_length) {
+void init_by_array(sfmt_t *ctx, uint32_t *init_key, int key_length) {
     int i, j, count;
     uint32_t r;
     int lag;
@@ -572,49 +577,49 @@ void init_by_array(uint32_t *init_key, int key_length) {
     }
     mid = (size - lag) / 2;
 
-    memset(sfmt, 0x8b, sizeof(sfmt));
+    memset(ctx->state, 0x8b, sizeof(ctx->state));
     if (key_length + 1 > N32) {
 	count = key_length + 1;
     } else {
 	count = N32;
     }
-    r = func1(psfmt32[idxof(0)] ^ psfmt32[idxof(mid)] 
-	      ^ psfmt32[idxof(N32 - 1)]);
-    psfmt32[idxof(mid)] += r;
+    r = func1(PSFMT32(ctx)[idxof(0)] ^ PSFMT32(ctx)[idxof(mid)] 
+	      ^ PSFMT32(ctx)[idxof(N32 - 1)]);
+    PSFMT32(ctx)[idxof(mid)] += r;
     r += key_length;
-    psfmt32[idxof(mid + lag)] += r;
-    psfmt32[idxof(0)] = r;
+    PSFMT32(ctx)[idxof(mid + lag)] += r;
+    PSFMT32(ctx)[idxof(0)] = r;
 
     count--;
     for (i = 1, j = 0; (j < count) && (j < key_length); j++) {
-	r = func1(psfmt32[idxof(i)] ^ psfmt32[idxof((i + mid) % N32)] 
-		  ^ psfmt32[idxof((i + N32 - 1) % N32)]);
-	psfmt32[idxof((i + mid) % N32)] += r;
+	r = func1(PSFMT32(ctx)[idxof(i)] ^ PSFMT32(ctx)[idxof((i + mid) % N32)] 
+		  ^ PSFMT32(ctx)[idxof((i + N32 - 1) % N32)]);
+	PSFMT32(ctx)[idxof((i + mid) % N32)] += r;
 	r += init_key[j] + i;
-	psfmt32[idxof((i + mid + lag) % N32)] += r;
-	psfmt32[idxof(i)] = r;
+	PSFMT32(ctx)[idxof((i + mid + lag) % N32)] += r;
+	PSFMT32(ctx)[idxof(i)] = r;
 	i = (i + 1) % N32;
     }
     for (; j < count; j++) {
-	r = func1(psfmt32[idxof(i)] ^ psfmt32[idxof((i + mid) % N32)] 
-		  ^ psfmt32[idxof((i + N32 - 1) % N32)]);
-	psfmt32[idxof((i + mid) % N32)] += r;
+	r = func1(PSFMT32(ctx)[idxof(i)] ^ PSFMT32(ctx)[idxof((i + mid) % N32)] 
+		  ^ PSFMT32(ctx)[idxof((i + N32 - 1) % N32)]);
+	PSFMT32(ctx)[idxof((i + mid) % N32)] += r;
 	r += i;
-	psfmt32[idxof((i + mid + lag) % N32)] += r;
-	psfmt32[idxof(i)] = r;
+	PSFMT32(ctx)[idxof((i + mid + lag) % N32)] += r;
+	PSFMT32(ctx)[idxof(i)] = r;
 	i = (i + 1) % N32;
     }
     for (j = 0; j < N32; j++) {
-	r = func2(psfmt32[idxof(i)] + psfmt32[idxof((i + mid) % N32)] 
-		  + psfmt32[idxof((i + N32 - 1) % N32)]);
-	psfmt32[idxof((i + mid) % N32)] ^= r;
+	r = func2(PSFMT32(ctx)[idxof(i)] + PSFMT32(ctx)[idxof((i + mid) % N32)] 
+		  + PSFMT32(ctx)[idxof((i + N32 - 1) % N32)]);
+	PSFMT32(ctx)[idxof((i + mid) % N32)] ^= r;
 	r -= i;
-	psfmt32[idxof((i + mid + lag) % N32)] ^= r;
-	psfmt32[idxof(i)] = r;
+	PSFMT32(ctx)[idxof((i + mid + lag) % N32)] ^= r;
+	PSFMT32(ctx)[idxof(i)] = r;
 	i = (i + 1) % N32;
     }
 
-    idx = N32;
-    period_certification();
-    initialized = 1;
+    ctx->idx = N32;
+    period_certification(ctx);
+    ctx->initialized = 1;
 }
@@ -30,6 +30,20 @@ int local::UniformBinning::getBinIndex(double value) const {
     return bin;
 }
 
+int local::UniformBinning::getBinIndices(double const *values, int *indices, int n) const {
+    int nOutside(0);
+    double nBins(_nBins);
+    for(int k = 0; k < n; ++k) {
+        // Use the same arithmetic as getBinIndex. Truncation is equivalent to floor for
+        // non-negative values, and NaN values fail both comparisons.
+        double offset((values[k] - _minValue)/_binWidth);
+        bool inside(offset >= 0 && offset < nBins);
+        indices[k] = inside ? (int)offset : -1;
+        nOutside += !inside;
+    }
+    return nOutside;
+}
+
 int local::UniformBinning::getNBins() const {
     return _nBins;
 }
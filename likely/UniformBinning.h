@@ -16,6 +16,9 @@ namespace likely {
         // Returns the bin index [0,nBins-1] corresponding to the specified value, or throws a
         // BinningError if value does not fall in any bin.
         virtual int getBinIndex(double value) const;
+        // Fills the array indices with the bin index of each of the n values provided, or -1
+        // for a value that does not fall in any bin. Returns the number of such values.
+        virtual int getBinIndices(double const *values, int *indices, int n) const;
         // Returns the total number of bins.
         virtual int getNBins() const;
         // Returns the lower bound of the specified bin. Throws a BinningError if index is out of range.
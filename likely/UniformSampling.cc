@@ -46,6 +46,30 @@ int local::UniformSampling::getBinIndex(double value) const {
     throw BinningError("getBinIndex: value is not one of our samples.");
 }
 
+int local::UniformSampling::getBinIndices(double const *values, int *indices, int n) const {
+    int nOutside(0);
+    for(int k = 0; k < n; ++k) {
+        bool inside;
+        int index(0);
+        if(_nSamples == 1) {
+            inside = std::fabs(values[k] - _minValue) <= _ftol;
+        }
+        else {
+            // Use the same arithmetic as getBinIndex, but test the range before converting
+            // to an integer.
+            double nearest(std::floor((values[k] - _minValue)/_sampleSpacing + 0.5));
+            inside = nearest >= 0 && nearest < _nSamples;
+            if(inside) {
+                index = (int)nearest;
+                inside = std::fabs(values[k] - (_minValue + index*_sampleSpacing)) <= _ftol*_sampleSpacing;
+            }
+        }
+        indices[k] = inside ? index : -1;
+        nOutside += !inside;
+    }
+    return nOutside;
+}
+
 int local::UniformSampling::getNBins() const {
     return _nSamples;
 }
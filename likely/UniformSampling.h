@@ -19,6 +19,9 @@ namespace likely {
         // BinningError if value is not within ftol*spacing of a sample point, where spacing is
         // the fixed distance between samples returned by getBinWidth().
         virtual int getBinIndex(double value) const;
+        // Fills the array indices with the bin index of each of the n values provided, or -1
+        // for a value that does not fall in any bin. Returns the number of such values.
+        virtual int getBinIndices(double const *values, int *indices, int n) const;
         // Returns the total number of bins, which is equal to the number of samples.
         virtual int getNBins() const;
         // Returns the lower bound of the specified bin. Throws a BinningError if index is out of range.
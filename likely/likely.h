@@ -27,6 +27,7 @@
 
 #include "likely/CovarianceMatrix.h"
 #include "likely/BinnedGrid.h"
+#include "likely/OffsetMap.h"
 #include "likely/BinnedData.h"
 #include "likely/BinnedDataResampler.h"
 
@@ -34,9 +35,12 @@
 #include "likely/FitModel.h"
 #include "likely/FitParameterStatistics.h"
 #include "likely/AbsEngine.h"
+#include "likely/NumericalGradient.h"
 #include "likely/FunctionMinimum.h"
 
 #include "likely/MarkovChainEngine.h"
+#include "likely/MarkovChainWriter.h"
+#include "likely/MarkovChainReader.h"
 // The following "engine" class are not included here since their availability
 // depends on how the package was built. Note that including them will indirectly
 // pull in some GSL and Minuit headers and so requires an appropriate include path.
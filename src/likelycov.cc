@@ -205,6 +205,13 @@ int main(int argc, char **argv) {
         double t12 = 1e3*elapsed(t1,t2)/nelem, t23 = 1e3*elapsed(t2,t3)/nelem;
         std::cout << "sample = " << t12 << " ns/elem, accumulate = " << t23
             << " ns/elem, accumulate/sample = " << t23/t12 << std::endl;
+        // Accumulate the same samples as a single block.
+        lk::CovarianceAccumulator batch(size);
+        getrusage(RUSAGE_SELF,&t1);
+        batch.accumulateBatch(residuals.get(),nsample);
+        lk::CovarianceMatrixCPtr bptr = batch.getCovariance();
+        getrusage(RUSAGE_SELF,&t2);
+        std::cout << "accumulateBatch = " << 1e3*elapsed(t1,t2)/nelem << " ns/elem" << std::endl;
         std::cout << cov.getMemoryState() << std::endl;
     }
 
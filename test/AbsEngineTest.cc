@@ -0,0 +1,270 @@
+// Tests that fits and integrations can run concurrently in different threads.
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "likely/likely.h"
+#include "likely/EngineRegistry.h"
+
+#include "config.h" // propagates HAVE_LIBGSL from configure
+
+#include "boost/thread/thread.hpp"
+#include "boost/bind.hpp"
+#include "boost/ref.hpp"
+#include "boost/functional/factory.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace lk = likely;
+
+namespace {
+    // A quadratic NLL with its minimum at (offset,2*offset).
+    double quadraticNLL(lk::Parameters const &p, double offset) {
+        double dx(p[0]-offset), dy(p[1]-2*offset);
+        return 0.5*(dx*dx + 4*dy*dy + dx*dy);
+    }
+    double throwingFunction(lk::Parameters const &p) {
+        throw lk::RuntimeError("oops");
+    }
+    // A function whose evaluation takes a time that depends on its index.
+    double slowFunction(lk::Parameters const &p, int index) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(index % 7));
+        return index + p[0];
+    }
+    // A trivial engine that evaluates its function once at the initial parameters.
+    class OneShotEngine : public lk::AbsEngine {
+    public:
+        OneShotEngine(lk::FunctionPtr f, lk::GradientCalculatorPtr gc,
+        lk::FitParameters const &parameters, std::string const &algorithm) : _f(f) {
+            minimumFinder = boost::bind(&OneShotEngine::evaluate,this,_1);
+        }
+        void evaluate(lk::FunctionMinimumPtr fmin) {
+            lk::Parameters where(fmin->getParameters());
+            double fval((*_f)(where));
+            incrementEvalCount();
+            fmin->updateParameterValues(fval,where);
+        }
+    private:
+        lk::FunctionPtr _f;
+    };
+    // A function of three parameters whose value identifies where it was evaluated.
+    double gridFunction(lk::Parameters const &p) {
+        return 100*p[0] + 10*p[1] + p[2];
+    }
+    void createEngines(int nEngines, lk::FunctionPtr f, lk::FitParameters const &params) {
+        for(int count = 0; count < nEngines; ++count) {
+            lk::getEngine("mc::saunter",f,lk::GradientCalculatorPtr(),params);
+        }
+    }
+#ifdef HAVE_LIBGSL
+    // Runs nFits independent fits of quadraticNLL using the specified method and records
+    // each fit's distance from its true minimum.
+    void runFits(std::string const &methodName, bool useGradient, int first, int nFits,
+    std::vector<double> &distance) {
+        for(int index = first; index < first+nFits; ++index) {
+            double offset(0.1*index);
+            lk::FunctionPtr f(new lk::Function(boost::bind(quadraticNLL,_1,offset)));
+            lk::FitParameters params;
+            params.push_back(lk::FitParameter("x",0,1));
+            params.push_back(lk::FitParameter("y",0,1));
+            lk::GradientCalculatorPtr gc;
+            if(useGradient) {
+                gc = lk::createNumericalGradientCalculator(f,params,
+                    lk::NumericalGradient::Richardson,1e-3,1);
+            }
+            lk::FunctionMinimumPtr fmin = lk::findMinimum(f,gc,params,methodName,1e-8);
+            lk::Parameters where(fmin->getParameters());
+            distance[index] = std::fabs(where[0]-offset) + std::fabs(where[1]-2*offset);
+        }
+    }
+    double gaussian(double x, double sigma) {
+        return std::exp(-0.5*x*x/(sigma*sigma));
+    }
+    // Runs nIntegrals integrations and records the absolute error of each one.
+    void runIntegrals(int first, int nIntegrals, std::vector<double> &error) {
+        for(int index = first; index < first+nIntegrals; ++index) {
+            double sigma(1+0.01*index);
+            lk::Integrator::IntegrandPtr integrand(
+                new lk::Integrator::Integrand(boost::bind(gaussian,_1,sigma)));
+            lk::Integrator integrator(integrand,1e-10,1e-10);
+            error[index] = std::fabs(integrator.integrateAll() - sigma*std::sqrt(2*M_PI));
+        }
+    }
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE( AbsEngine )
+
+BOOST_AUTO_TEST_CASE( concurrentEngineCreation ) {
+    lk::FunctionPtr f(new lk::Function(boost::bind(quadraticNLL,_1,0.)));
+    lk::FitParameters params;
+    params.push_back(lk::FitParameter("x",0,1));
+    params.push_back(lk::FitParameter("y",0,1));
+    boost::thread_group threads;
+    for(int thread = 0; thread < 8; ++thread) {
+        threads.create_thread(boost::bind(createEngines,100,f,boost::cref(params)));
+    }
+    threads.join_all();
+    BOOST_CHECK_THROW(lk::getEngine("nosuch::method",f,lk::GradientCalculatorPtr(),params),
+        lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( findMinimaKeepsInputOrder ) {
+    lk::getEngineRegistry()["oneshot"] =
+        boost::bind(boost::factory<OneShotEngine*>(),_1,_2,_3,_4);
+    int nFits(100);
+    std::vector<lk::FunctionPtr> functions;
+    for(int index = 0; index < nFits; ++index) {
+        functions.push_back(lk::FunctionPtr(new lk::Function(boost::bind(slowFunction,_1,index))));
+    }
+    lk::FitParameters params;
+    params.push_back(lk::FitParameter("x",0.5,1));
+    lk::FitBatchStatistics stats;
+    std::vector<lk::FunctionMinimumPtr> results =
+        lk::findMinima(functions,params,"oneshot::any",1e-3,0,4,&stats);
+    BOOST_REQUIRE_EQUAL(results.size(),nFits);
+    BOOST_REQUIRE_EQUAL(stats.fitTime.size(),nFits);
+    for(int index = 0; index < nFits; ++index) {
+        BOOST_CHECK_EQUAL(results[index]->getMinValue(),index + 0.5);
+        BOOST_CHECK(stats.fitTime[index] >= 1e-3*(index % 7));
+    }
+    // Each fit evaluates its function once to initialize and once in the engine.
+    BOOST_CHECK_EQUAL(stats.evalCount,2*nFits);
+    BOOST_CHECK_EQUAL(stats.gradCount,0);
+    BOOST_CHECK(stats.batchTime > 0);
+    // A failing fit is reported.
+    functions[17].reset(new lk::Function(throwingFunction));
+    BOOST_CHECK_THROW(lk::findMinima(functions,params,"oneshot::any",1e-3,0,4),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( gridScanCoversGrid ) {
+    lk::getEngineRegistry()["oneshot"] =
+        boost::bind(boost::factory<OneShotEngine*>(),_1,_2,_3,_4);
+    lk::FunctionPtr f(new lk::Function(gridFunction));
+    lk::FitParameters params;
+    params.push_back(lk::FitParameter("x",0,1));
+    params.push_back(lk::FitParameter("y",0,1));
+    params.push_back(lk::FitParameter("z",0.5,1));
+    params[0].setBinning("{0:4}*5");
+    params[1].setBinning("[0:3]*3");
+    std::vector<lk::FunctionMinimumPtr> minima;
+    lk::FitBatchStatistics stats;
+    lk::BinnedDataPtr profile = lk::scanFitParametersGrid(f,params,"oneshot::any",1e-3,0,4,
+        &minima,&stats);
+    BOOST_REQUIRE_EQUAL(profile->getNBinsWithData(),15);
+    BOOST_REQUIRE_EQUAL(minima.size(),15);
+    BOOST_CHECK_EQUAL(stats.evalCount,2*15);
+    lk::BinnedGrid const &grid(profile->getGrid());
+    std::vector<double> centers;
+    for(int index = 0; index < 15; ++index) {
+        grid.getBinCenters(index,centers);
+        // The oneshot engine never moves the floating parameter from its initial value.
+        BOOST_CHECK_EQUAL(profile->getData(index),100*centers[0] + 10*centers[1] + 0.5);
+        lk::FitParameters fitted(minima[index]->getFitParameters());
+        BOOST_CHECK_EQUAL(fitted[0].getValue(),centers[0]);
+        BOOST_CHECK(!fitted[0].isFloating());
+        BOOST_CHECK(!fitted[1].isFloating());
+        BOOST_CHECK(fitted[2].isFloating());
+    }
+    // A scan needs at least one binned parameter.
+    params[0].removeBinning();
+    params[1].removeBinning();
+    BOOST_CHECK_THROW(lk::scanFitParametersGrid(f,params,"oneshot::any"),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( concurrentMarkovChainFits ) {
+    int nFits(12);
+    std::vector<lk::FunctionPtr> functions;
+    for(int index = 0; index < nFits; ++index) {
+        functions.push_back(lk::FunctionPtr(
+            new lk::Function(boost::bind(quadraticNLL,_1,0.1*index))));
+    }
+    lk::FitParameters params;
+    params.push_back(lk::FitParameter("x",0,1));
+    params.push_back(lk::FitParameter("y",0,1));
+    // Each fit samples its own random stream, so results do not depend on the threads used.
+    std::vector<lk::FunctionMinimumPtr> serial =
+        lk::findMinima(functions,params,"mc::saunter",1e-3,2000,1);
+    std::vector<lk::FunctionMinimumPtr> parallel =
+        lk::findMinima(functions,params,"mc::saunter",1e-3,2000,4);
+    BOOST_REQUIRE_EQUAL(parallel.size(),nFits);
+    for(int index = 0; index < nFits; ++index) {
+        BOOST_CHECK_EQUAL(parallel[index]->getMinValue(),serial[index]->getMinValue());
+        lk::Parameters where(parallel[index]->getParameters());
+        BOOST_CHECK_EQUAL(where[0],serial[index]->getParameters()[0]);
+        BOOST_CHECK_EQUAL(where[1],serial[index]->getParameters()[1]);
+    }
+}
+
+#ifdef HAVE_LIBGSL
+BOOST_AUTO_TEST_CASE( gridScanWithGsl ) {
+    lk::FunctionPtr f(new lk::Function(boost::bind(quadraticNLL,_1,0.)));
+    lk::FitParameters params;
+    params.push_back(lk::FitParameter("x",0,1));
+    params.push_back(lk::FitParameter("y",0,1));
+    params[0].setBinning("{-2:2}*41");
+    lk::BinnedDataPtr profile = lk::scanFitParametersGrid(f,params,"gsl::nmsimplex2",1e-8,0,8);
+    std::vector<double> centers;
+    for(int index = 0; index < 41; ++index) {
+        profile->getGrid().getBinCenters(index,centers);
+        // Minimizing over y gives a profile of 15/32 x^2.
+        BOOST_CHECK_SMALL(profile->getData(index) - 15./32.*centers[0]*centers[0],1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( concurrentFits ) {
+    int nThreads(8), fitsPerThread(25), nFits(nThreads*fitsPerThread);
+    std::vector<double> distance(nFits,1), gradDistance(nFits,1);
+    boost::thread_group threads;
+    for(int thread = 0; thread < nThreads; ++thread) {
+        threads.create_thread(boost::bind(runFits,"gsl::nmsimplex2",false,
+            thread*fitsPerThread,fitsPerThread,boost::ref(distance)));
+        threads.create_thread(boost::bind(runFits,"gsl::vector_bfgs2",true,
+            thread*fitsPerThread,fitsPerThread,boost::ref(gradDistance)));
+    }
+    threads.join_all();
+    for(int index = 0; index < nFits; ++index) {
+        BOOST_CHECK_SMALL(distance[index],1e-2);
+        BOOST_CHECK_SMALL(gradDistance[index],1e-2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( findMinimaWithGsl ) {
+    int nFits(200);
+    std::vector<lk::FunctionPtr> functions;
+    std::vector<lk::GradientCalculatorPtr> gradients;
+    lk::FitParameters params;
+    params.push_back(lk::FitParameter("x",0,1));
+    params.push_back(lk::FitParameter("y",0,1));
+    for(int index = 0; index < nFits; ++index) {
+        double offset(0.1*index);
+        functions.push_back(lk::FunctionPtr(new lk::Function(boost::bind(quadraticNLL,_1,offset))));
+        gradients.push_back(lk::createNumericalGradientCalculator(functions.back(),params,
+            lk::NumericalGradient::Richardson,1e-3,1));
+    }
+    std::vector<lk::FunctionMinimumPtr> results =
+        lk::findMinima(functions,gradients,params,"gsl::vector_bfgs2",1e-8,0,8);
+    for(int index = 0; index < nFits; ++index) {
+        lk::Parameters where(results[index]->getParameters());
+        BOOST_CHECK_SMALL(where[0]-0.1*index,1e-2);
+        BOOST_CHECK_SMALL(where[1]-0.2*index,1e-2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( concurrentIntegrals ) {
+    int nThreads(8), perThread(50), nIntegrals(nThreads*perThread);
+    std::vector<double> error(nIntegrals,1);
+    boost::thread_group threads;
+    for(int thread = 0; thread < nThreads; ++thread) {
+        threads.create_thread(boost::bind(runIntegrals,thread*perThread,perThread,
+            boost::ref(error)));
+    }
+    threads.join_all();
+    for(int index = 0; index < nIntegrals; ++index) {
+        BOOST_CHECK_SMALL(error[index],1e-8);
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END() // AbsEngine
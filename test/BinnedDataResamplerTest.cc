@@ -0,0 +1,148 @@
+// BinnedDataResampler class unit tests.
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+
+#include "likely/likely.h"
+
+namespace lk = likely;
+
+struct BinnedDataResamplerFixture
+{
+    BinnedDataResamplerFixture() : nbins(3), nobs(50) {
+        random.reset(new lk::Random());
+        random->setSeed(123);
+        lk::AbsBinningCPtr binning(new lk::UniformBinning(0.,1.,nbins));
+        lk::BinnedGrid grid(binning);
+        lk::BinnedData prototype(grid);
+        for(int k = 0; k < nbins; ++k) prototype.setData(k,k);
+        lk::CovarianceMatrixPtr cov(new lk::CovarianceMatrix(nbins));
+        (*cov).setCovariance(0,0,1).setCovariance(0,1,-0.5).setCovariance(1,1,2).setCovariance(2,2,3);
+        prototype.setCovarianceMatrix(cov);
+        for(int obs = 0; obs < nobs; ++obs) {
+            observations.push_back(lk::BinnedDataCPtr(prototype.sample(random)));
+        }
+    }
+    ~BinnedDataResamplerFixture() { }
+    // Returns a bootstrap covariance estimate using a resampler seeded with seed.
+    lk::CovarianceMatrixPtr estimate(int seed, int nThreads, int nSamples = 200) {
+        lk::RandomPtr generator(new lk::Random());
+        generator->setSeed(seed);
+        lk::BinnedDataResampler resampler(false,generator);
+        for(int obs = 0; obs < nobs; ++obs) resampler.addObservation(observations[obs]);
+        return resampler.estimateCombinedCovariance(nSamples,
+            lk::BinnedDataResampler::AccumulationCallback(),0,nThreads)->getCovariance();
+    }
+    int nbins, nobs;
+    lk::RandomPtr random;
+    std::vector<lk::BinnedDataCPtr> observations;
+};
+
+namespace {
+    bool countCallbacks(lk::CovarianceAccumulatorCPtr accumulator, int &ncalls, int stopAfter) {
+        BOOST_CHECK_EQUAL(accumulator->count(),10*(ncalls+1));
+        return ++ncalls < stopAfter;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE( BinnedDataResampler, BinnedDataResamplerFixture )
+
+BOOST_AUTO_TEST_CASE( parallelBootstrapIsReproducible ) {
+    lk::CovarianceMatrixPtr c2 = estimate(99,2), c2b = estimate(99,2), c4 = estimate(99,4);
+    for(int row = 0; row < nbins; ++row) {
+        for(int col = 0; col <= row; ++col) {
+            BOOST_CHECK_EQUAL(c2->getCovariance(row,col),c2b->getCovariance(row,col));
+            BOOST_CHECK_EQUAL(c2->getCovariance(row,col),c4->getCovariance(row,col));
+        }
+    }
+    lk::CovarianceMatrixPtr other = estimate(100,2);
+    BOOST_CHECK(other->getCovariance(0,0) != c2->getCovariance(0,0));
+}
+
+BOOST_AUTO_TEST_CASE( parallelBootstrapAgreesWithSerial ) {
+    lk::CovarianceMatrixPtr serial = estimate(99,1,2000), parallel = estimate(99,3,2000);
+    for(int row = 0; row < nbins; ++row) {
+        for(int col = 0; col <= row; ++col) {
+            BOOST_CHECK_SMALL(serial->getCovariance(row,col)-parallel->getCovariance(row,col),
+                0.2*std::sqrt(serial->getCovariance(row,row)*serial->getCovariance(col,col)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( parallelBootstrapCallsCallbackInOrder ) {
+    lk::BinnedDataResampler resampler(false,random);
+    for(int obs = 0; obs < nobs; ++obs) resampler.addObservation(observations[obs]);
+    int ncalls(0);
+    lk::CovarianceAccumulatorPtr accumulator = resampler.estimateCombinedCovariance(100,
+        boost::bind(countCallbacks,_1,boost::ref(ncalls),3),10,4);
+    BOOST_CHECK_EQUAL(ncalls,3);
+    BOOST_CHECK_EQUAL(accumulator->count(),30);
+}
+
+BOOST_AUTO_TEST_CASE( incrementalJackknifeAgreesWithStandard ) {
+    for(int scalar = 0; scalar < 2; ++scalar) {
+        lk::BinnedDataResampler resampler(scalar,random);
+        for(int obs = 0; obs < nobs; ++obs) resampler.addObservation(observations[obs]);
+        for(int ndrop = 0; ndrop <= 2; ++ndrop) {
+            unsigned long seqno(0);
+            while(true) {
+                lk::BinnedDataPtr standard = resampler.jackknife(ndrop,seqno);
+                lk::BinnedDataPtr incremental = resampler.jackknife(ndrop,seqno,true,true);
+                BOOST_REQUIRE_EQUAL(!standard,!incremental);
+                if(!standard) break;
+                for(int row = 0; row < nbins; ++row) {
+                    BOOST_CHECK_SMALL(standard->getData(row)-incremental->getData(row),1e-8);
+                    for(int col = 0; col <= row; ++col) {
+                        BOOST_CHECK_SMALL(standard->getCovariance(row,col)
+                            -incremental->getCovariance(row,col),1e-8);
+                    }
+                }
+                seqno++;
+            }
+            BOOST_CHECK_EQUAL(seqno,ndrop == 0 ? 1 : (ndrop == 1 ? nobs : nobs*(nobs-1)/2));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( lossyCompressionKeepsJackknifeConsistent ) {
+    for(int scalar = 0; scalar < 2; ++scalar) {
+        lk::BinnedDataResampler resampler(scalar,random);
+        // This threshold drops the only off-diagonal inverse covariance element.
+        resampler.setCompression(0.5,true);
+        for(int obs = 0; obs < nobs; ++obs) resampler.addObservation(observations[obs]);
+        // Saved observations are weighted, with no cached copy of their unweighted data.
+        for(int obs = 0; obs < nobs; ++obs) {
+            std::string state(resampler.getObservation(obs)->getMemoryState());
+            BOOST_CHECK(state.find("CinvD-") != std::string::npos);
+        }
+        lk::BinnedDataPtr combined = resampler.combined();
+        lk::BinnedDataPtr all = resampler.jackknife(0,0);
+        for(int seqno = 0; seqno < nobs; ++seqno) {
+            lk::BinnedDataPtr standard = resampler.jackknife(1,seqno);
+            lk::BinnedDataPtr incremental = resampler.jackknife(1,seqno,true,true);
+            for(int row = 0; row < nbins; ++row) {
+                BOOST_CHECK_SMALL(standard->getData(row)-incremental->getData(row),1e-8);
+                for(int col = 0; col <= row; ++col) {
+                    BOOST_CHECK_SMALL(standard->getCovariance(row,col)
+                        -incremental->getCovariance(row,col),1e-8);
+                }
+            }
+        }
+        for(int row = 0; row < nbins; ++row) {
+            BOOST_CHECK_SMALL(combined->getData(row)-all->getData(row),1e-8);
+            for(int col = 0; col <= row; ++col) {
+                BOOST_CHECK_SMALL(combined->getCovariance(row,col)-all->getCovariance(row,col),1e-8);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( shouldThrowErrorForInvalidThreadCount ) {
+    lk::BinnedDataResampler resampler(false,random);
+    resampler.addObservation(observations[0]);
+    BOOST_CHECK_THROW(resampler.estimateCombinedCovariance(10,
+        lk::BinnedDataResampler::AccumulationCallback(),0,0),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // BinnedDataResampler
@@ -5,6 +5,14 @@
 #include <boost/test/unit_test.hpp>
 
 #include "likely/likely.h"
+
+#include "TemporaryFile.h"
+
+#include "boost/scoped_ptr.hpp"
+
+#include <fstream>
+#include <cstdio>
+
 namespace lk = likely;
 
 struct BinnedDataFixture
@@ -39,5 +47,245 @@ BOOST_AUTO_TEST_CASE( shouldThrowBinningErrorInConstructorWithInvalidParameters
 // getBinWidths
 // hasData, getData, setData, addData
 
+BOOST_AUTO_TEST_CASE( shouldCalculateBatchOfGridIndices ) {
+	lk::BinnedGrid const &grid(binnedData->getGrid());
+	// Coordinates are stored by axis. The last point is outside the third axis.
+	int n(4);
+	double coordinates[12] = { 0.1, 0.9, 0.5, 0.5,  0, 1, 0.5, 0.5,  0.3, 0.99, 0, 1.5 };
+	int indices[4];
+	BOOST_CHECK_EQUAL(grid.getIndices(n,coordinates,indices),1);
+	std::vector<double> point(3);
+	for(int k = 0; k < n-1; ++k) {
+		for(int axis = 0; axis < 3; ++axis) point[axis] = coordinates[axis*n+k];
+		BOOST_CHECK_EQUAL(indices[k],grid.getIndex(point));
+	}
+	BOOST_CHECK_EQUAL(indices[n-1],-1);
+}
+
+BOOST_AUTO_TEST_CASE( shouldCalculateBatchOfChiSquares ) {
+	lk::BinnedData data(binnedData->getGrid());
+	// Fill bins in a non-sequential order.
+	int nbins(5), bins[5] = { 7, 2, 11, 0, 5 };
+	for(int k = 0; k < nbins; ++k) data.setData(bins[k],k-1);
+	std::vector<double> preds, chi2;
+	for(int k = 0; k < 3*nbins; ++k) preds.push_back(0.1*k);
+	std::vector<double> original(preds);
+	// Without a covariance, the scalar weight plays the role of Cinv.
+	data.chiSquareBatch(preds,chi2);
+	BOOST_REQUIRE_EQUAL(chi2.size(),3);
+	for(int k = 0; k < 3; ++k) {
+		std::vector<double> pred(&original[k*nbins],&original[(k+1)*nbins]);
+		BOOST_CHECK_CLOSE(chi2[k],data.chiSquare(pred),1e-10);
+	}
+	lk::CovarianceMatrixPtr cov(new lk::CovarianceMatrix(nbins));
+	for(int k = 0; k < nbins; ++k) cov->setCovariance(k,k,k+1);
+	cov->setCovariance(0,1,0.1).setCovariance(1,2,-0.2);
+	data.setCovarianceMatrix(cov);
+	preds = original;
+	data.chiSquareBatch(preds,chi2);
+	for(int k = 0; k < 3; ++k) {
+		std::vector<double> pred(&original[k*nbins],&original[(k+1)*nbins]);
+		BOOST_CHECK_CLOSE(chi2[k],data.chiSquare(pred),1e-10);
+	}
+	preds.push_back(0);
+	BOOST_CHECK_THROW(data.chiSquareBatch(preds,chi2),lk::RuntimeError);
+	// The workspace version gives the same result and leaves the prediction unchanged.
+	std::vector<double> pred(&original[0],&original[nbins]), workspace;
+	double expected(data.chiSquare(pred));
+	BOOST_CHECK_CLOSE(data.chiSquare(pred,workspace),expected,1e-10);
+	BOOST_CHECK_EQUAL(pred[1],original[1]);
+	BOOST_CHECK_CLOSE(data.chiSquare(pred,workspace),expected,1e-10);
+	pred.push_back(0);
+	BOOST_CHECK_THROW(data.chiSquare(pred,workspace),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldCombineManyDatasets ) {
+	int nbins(80), ndata(5);
+	lk::AbsBinningCPtr axis(new lk::UniformBinning(0.,1.,nbins));
+	lk::BinnedGrid grid(axis);
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(17);
+	std::vector<lk::BinnedDataCPtr> datasets;
+	for(int k = 0; k < ndata; ++k) {
+		lk::BinnedDataPtr data(new lk::BinnedData(grid));
+		for(int bin = 0; bin < nbins; ++bin) data->setData(bin,random->getNormal());
+		data->setCovarianceMatrix(lk::generateRandomCovariance(nbins,2,random));
+		// Mix compressed and uncompressed inputs.
+		if(k % 2) data->compress(true,0,k == 3);
+		datasets.push_back(data);
+	}
+	double w[5] = { 1, 2, 0.5, 0, 1 };
+	std::vector<double> weights(w,w+ndata);
+	lk::BinnedData expected(grid), combined(grid);
+	for(int k = 0; k < ndata; ++k) expected.add(*datasets[k],weights[k]);
+	combined.combine(datasets,weights,3);
+	BOOST_CHECK(datasets[3]->isCompressed());
+	BOOST_REQUIRE(combined.isCongruent(expected));
+	for(int j = 0; j < nbins; ++j) {
+		BOOST_CHECK_CLOSE(combined.getData(j),expected.getData(j),1e-8);
+		for(int k = 0; k <= j; ++k) {
+			BOOST_CHECK_CLOSE(combined.getInverseCovariance(j,k),expected.getInverseCovariance(j,k),1e-8);
+		}
+	}
+	// Datasets without covariances combine their scalar weights.
+	lk::BinnedData unweighted(grid), sum(grid);
+	for(int bin = 0; bin < nbins; ++bin) unweighted.setData(bin,bin);
+	std::vector<lk::BinnedDataCPtr> copies(3,lk::BinnedDataCPtr(unweighted.clone()));
+	sum.combine(copies);
+	BOOST_CHECK_EQUAL(sum.getData(7),7);
+	BOOST_CHECK_EQUAL(sum.getScalarWeight(),3);
+	BOOST_CHECK_THROW(sum.combine(copies,weights),lk::RuntimeError);
+	BOOST_CHECK_THROW(sum.combine(datasets),lk::RuntimeError);
+	// An empty dataset is left unchanged when any dataset is not congruent.
+	lk::BinnedData empty(grid);
+	std::vector<lk::BinnedDataCPtr> mixed(copies);
+	mixed.push_back(datasets[0]);
+	BOOST_CHECK_THROW(empty.combine(mixed),lk::RuntimeError);
+	BOOST_CHECK_EQUAL(empty.getNBinsWithData(),0);
+	BOOST_CHECK(!empty.hasCovariance());
+}
+
+BOOST_AUTO_TEST_CASE( shouldUseSparseOffsetsForMostlyEmptyGrids ) {
+	// A grid with 1.25x10^8 bins of which only a handful have data.
+	lk::AbsBinningCPtr axis(new lk::UniformBinning(0.,1.,500));
+	lk::BinnedGrid grid(axis,axis,axis);
+	lk::BinnedData data(grid);
+	int nfill(1000), stride(99991);
+	for(int k = 0; k < nfill; ++k) data.setData(k*stride,k);
+	BOOST_CHECK_EQUAL(data.getNBinsWithData(),nfill);
+	BOOST_CHECK(data.getMemoryUsage() < 100*nfill*sizeof(int));
+	BOOST_CHECK(data.hasData(17*stride));
+	BOOST_CHECK(!data.hasData(17*stride+1));
+	BOOST_CHECK_EQUAL(data.getOffsetForIndex(17*stride),17);
+	BOOST_CHECK_EQUAL(data.getData(17*stride),17);
+	data.addData(17*stride,1);
+	BOOST_CHECK_EQUAL(data.getData(17*stride),18);
+	boost::scoped_ptr<lk::BinnedData> copy(data.clone());
+	BOOST_CHECK(copy->isCongruent(data));
+	BOOST_CHECK_EQUAL(copy->getData(999*stride),999);
+	BOOST_CHECK_THROW(copy->getData(3),lk::RuntimeError);
+	// Offset maps switch to a dense table once a large fraction of indices are mapped.
+	lk::OffsetMap map(10000);
+	BOOST_CHECK(map.isSparse());
+	for(int index = 0; index < 10000; index += 2) map.set(index,index/2);
+	BOOST_CHECK(!map.isSparse());
+	BOOST_CHECK_EQUAL(map.getCount(),5000);
+	BOOST_CHECK_EQUAL(map.get(4242),2121);
+	BOOST_CHECK_EQUAL(map.get(4243),-1);
+	BOOST_CHECK(!lk::OffsetMap(4096).isSparse());
+}
+
+BOOST_AUTO_TEST_CASE( shouldCopySharedTablesOnWrite ) {
+	lk::BinnedData data(binnedData->getGrid());
+	int nbins(4), bins[4] = { 9, 1, 20, 3 };
+	for(int k = 0; k < nbins; ++k) data.setData(bins[k],k);
+	data.setCustomBinCenters(20,0.5,0.25,0.125);
+	lk::CovarianceMatrixPtr cov(new lk::CovarianceMatrix(nbins));
+	for(int k = 0; k < nbins; ++k) cov->setCovariance(k,k,k+1);
+	data.setCovarianceMatrix(cov);
+	// Changes to a copy are not seen by the original.
+	boost::scoped_ptr<lk::BinnedData> copy(data.clone());
+	copy->setData(1,-1);
+	copy->addData(3,10);
+	copy->setCustomBinCenters(9,1,2,3);
+	BOOST_CHECK_EQUAL(data.getData(1),1);
+	BOOST_CHECK_EQUAL(data.getData(3),3);
+	BOOST_CHECK_EQUAL(copy->getData(3),13);
+	BOOST_CHECK(!data.hasCustomBinCenters(9));
+	BOOST_CHECK_EQUAL(copy->getNCustomBins(),2);
+	// Weighting a copy does not change the original.
+	BOOST_CHECK_CLOSE(copy->getData(20,true),2./3.,1e-10);
+	BOOST_CHECK_EQUAL(data.getData(20),2);
+	// A dataset initialized from another shares its index table until it changes it.
+	lk::BinnedData sum(data.getGrid());
+	sum.add(data).add(*copy);
+	BOOST_CHECK(sum.isCongruent(data));
+	BOOST_CHECK_CLOSE(sum.getData(1),0,1e-10);
+	std::set<int> keep;
+	keep.insert(1);
+	keep.insert(20);
+	sum.prune(keep);
+	BOOST_CHECK_EQUAL(sum.getNBinsWithData(),2);
+	BOOST_CHECK_EQUAL(data.getNBinsWithData(),nbins);
+	BOOST_CHECK_EQUAL(data.getOffsetForIndex(20),2);
+	BOOST_CHECK_EQUAL(sum.getOffsetForIndex(20),1);
+	// Copies without a covariance can add bins until they are finalized.
+	lk::BinnedData plain(data.getGrid());
+	plain.setData(5,1);
+	lk::BinnedData plainCopy(plain);
+	plainCopy.setData(6,2);
+	BOOST_CHECK(!plain.hasData(6));
+	plainCopy.finalize();
+	BOOST_CHECK_THROW(plainCopy.setData(7,3),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldProjectOntoComplementaryModes ) {
+	int nbins(30), nkeep(4);
+	lk::AbsBinningCPtr axis(new lk::UniformBinning(0.,1.,nbins));
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(5);
+	lk::BinnedData data((lk::BinnedGrid(axis)));
+	for(int bin = 0; bin < nbins; ++bin) data.setData(bin,random->getNormal());
+	data.setCovarianceMatrix(lk::generateRandomCovariance(nbins,1,random));
+	lk::BinnedData kept(data), dropped(data);
+	BOOST_CHECK_EQUAL(kept.projectOntoModes(nkeep),nbins-nkeep);
+	BOOST_CHECK_EQUAL(dropped.projectOntoModes(nkeep-nbins),nkeep);
+	for(int bin = 0; bin < nbins; ++bin) {
+		BOOST_CHECK_SMALL(kept.getData(bin) + dropped.getData(bin) - data.getData(bin),1e-10);
+	}
+	BOOST_CHECK_THROW(kept.projectOntoModes(nbins),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldSaveAndLoadBinary ) {
+	lk::BinnedData data(binnedData->getGrid());
+	int nbins(4), bins[4] = { 9, 1, 20, 3 };
+	for(int k = 0; k < nbins; ++k) data.setData(bins[k],0.1*k-1./3.);
+	data.setCustomBinCenters(20,0.5,0.25,0.125);
+	lk::CovarianceMatrixPtr cov(new lk::CovarianceMatrix(nbins));
+	for(int k = 0; k < nbins; ++k) cov->setCovariance(k,k,k+1);
+	cov->setCovariance(0,3,0.3);
+	data.setCovarianceMatrix(cov);
+	lk::test::TemporaryFile file("BinnedDataTest-%%%%-%%%%.bin");
+	std::string filename(file.getName());
+	for(int compressed = 0; compressed < 2; ++compressed) {
+		if(compressed) data.compress();
+		data.saveBinary(filename);
+		lk::BinnedGrid grid(data.getGrid());
+		lk::BinnedDataCPtr loaded = lk::BinnedData::loadBinary(filename,&grid);
+		BOOST_CHECK(loaded->isFinalized());
+		BOOST_CHECK(loaded->isCongruent(data));
+		// Without a grid, the binning is recreated from the saved specifications.
+		lk::BinnedDataCPtr standalone = lk::BinnedData::loadBinary(filename);
+		BOOST_CHECK(!standalone->isCongruent(data,true));
+		BOOST_CHECK_EQUAL(standalone->getGrid().getAxisBinning(2)->getBinLowEdge(2),0.35);
+		BOOST_CHECK_EQUAL(loaded->isCompressed(),data.isCompressed());
+		BOOST_REQUIRE_EQUAL(loaded->getNBinsWithData(),nbins);
+		for(int k = 0; k < nbins; ++k) {
+			BOOST_CHECK_EQUAL(loaded->getIndexAtOffset(k),bins[k]);
+			BOOST_CHECK_CLOSE(loaded->getData(bins[k]),data.getData(bins[k]),1e-12);
+			for(int j = 0; j <= k; ++j) {
+				BOOST_CHECK_CLOSE(loaded->getInverseCovariance(bins[j],bins[k]),
+					data.getInverseCovariance(bins[j],bins[k]),1e-12);
+			}
+		}
+		std::vector<double> centers;
+		loaded->getCustomBinCenters(20,centers);
+		BOOST_CHECK_EQUAL(centers[2],0.125);
+		BOOST_CHECK(!loaded->hasCustomBinCenters(9));
+	}
+	// A truncated file is rejected.
+	boost::uintmax_t size(boost::filesystem::file_size(filename));
+	boost::filesystem::resize_file(filename,size-8);
+	BOOST_CHECK_THROW(lk::BinnedData::loadBinary(filename),lk::RuntimeError);
+	boost::filesystem::resize_file(filename,size/2);
+	BOOST_CHECK_THROW(lk::BinnedData::loadBinary(filename),lk::RuntimeError);
+	// A text file is rejected.
+	std::ofstream out(filename.c_str());
+	out << "0 1.5" << std::endl;
+	out.close();
+	BOOST_CHECK_THROW(lk::BinnedData::loadBinary(filename),lk::RuntimeError);
+	std::remove(filename.c_str());
+	BOOST_CHECK_THROW(lk::BinnedData::loadBinary(filename),lk::RuntimeError);
+}
 
 BOOST_AUTO_TEST_SUITE_END() // BinnedData
\ No newline at end of file
@@ -0,0 +1,147 @@
+// CovarianceAccumulator class unit tests.
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "likely/likely.h"
+
+#include <sstream>
+
+namespace lk = likely;
+
+struct CovarianceAccumulatorFixture
+{
+    CovarianceAccumulatorFixture() : size(4), nvec(100) {
+        lk::Random random;
+        random.setSeed(321);
+        for(int k = 0; k < nvec; ++k) {
+            for(int i = 0; i < size; ++i) vectors.push_back(1 + i + (i+1)*random.getNormal());
+            weights.push_back(0.5 + random.getUniform());
+        }
+    }
+    ~CovarianceAccumulatorFixture() { }
+    // Returns the weighted covariance of vectors [first,last) calculated with two passes.
+    double expected(int row, int col, int first, int last) {
+        double sumw(0), mrow(0), mcol(0), cov(0);
+        for(int k = first; k < last; ++k) {
+            sumw += weights[k];
+            mrow += weights[k]*vectors[k*size+row];
+            mcol += weights[k]*vectors[k*size+col];
+        }
+        mrow /= sumw;
+        mcol /= sumw;
+        for(int k = first; k < last; ++k) {
+            cov += weights[k]*(vectors[k*size+row]-mrow)*(vectors[k*size+col]-mcol);
+        }
+        return cov/sumw;
+    }
+    int size, nvec;
+    std::vector<double> vectors, weights;
+};
+
+BOOST_FIXTURE_TEST_SUITE( CovarianceAccumulator, CovarianceAccumulatorFixture )
+
+BOOST_AUTO_TEST_CASE( accumulateMatchesTwoPassCovariance ) {
+    lk::CovarianceAccumulator accumulator(size);
+    for(int k = 0; k < nvec; ++k) accumulator.accumulate(&vectors[k*size],weights[k]);
+    BOOST_CHECK_EQUAL(accumulator.count(),nvec);
+    lk::CovarianceMatrixCPtr cov = accumulator.getCovariance();
+    for(int row = 0; row < size; ++row) {
+        for(int col = 0; col <= row; ++col) {
+            BOOST_CHECK_CLOSE(cov->getCovariance(row,col),expected(row,col,0,nvec),1e-9);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( mergeMatchesSingleAccumulator ) {
+    lk::CovarianceAccumulator all(size), first(size), second(size), empty(size);
+    int split(37);
+    for(int k = 0; k < nvec; ++k) {
+        all.accumulate(&vectors[k*size],weights[k]);
+        if(k < split) first.accumulate(&vectors[k*size],weights[k]);
+        else second.accumulate(&vectors[k*size],weights[k]);
+    }
+    first.merge(second);
+    first.merge(empty);
+    empty.merge(first);
+    BOOST_CHECK_EQUAL(first.count(),nvec);
+    BOOST_CHECK_EQUAL(empty.count(),nvec);
+    BOOST_CHECK_CLOSE(first.sumOfWeights(),all.sumOfWeights(),1e-12);
+    lk::CovarianceMatrixCPtr c1 = all.getCovariance(), c2 = first.getCovariance(), c3 = empty.getCovariance();
+    for(int row = 0; row < size; ++row) {
+        for(int col = 0; col <= row; ++col) {
+            BOOST_CHECK_CLOSE(c1->getCovariance(row,col),c2->getCovariance(row,col),1e-9);
+            BOOST_CHECK_CLOSE(c1->getCovariance(row,col),c3->getCovariance(row,col),1e-9);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( accumulateBatchMatchesSingleVectors ) {
+    lk::CovarianceAccumulator single(size), weighted(size), unweighted(size);
+    for(int k = 0; k < nvec; ++k) single.accumulate(&vectors[k*size],weights[k]);
+    // Accumulate in two blocks of different sizes.
+    int split(61);
+    weighted.accumulateBatch(&vectors[0],split,&weights[0]);
+    weighted.accumulateBatch(&vectors[split*size],nvec-split,&weights[split]);
+    unweighted.accumulateBatch(&vectors[0],nvec);
+    BOOST_CHECK_EQUAL(weighted.count(),nvec);
+    BOOST_CHECK_EQUAL(unweighted.count(),nvec);
+    BOOST_CHECK_CLOSE(unweighted.sumOfWeights(),nvec,1e-12);
+    lk::CovarianceMatrixCPtr c1 = single.getCovariance(), c2 = weighted.getCovariance(),
+        c3 = unweighted.getCovariance();
+    for(int row = 0; row < size; ++row) {
+        for(int col = 0; col <= row; ++col) {
+            BOOST_CHECK_CLOSE(c1->getCovariance(row,col),c2->getCovariance(row,col),1e-9);
+            double mrow(0), mcol(0), cov(0);
+            for(int k = 0; k < nvec; ++k) {
+                mrow += vectors[k*size+row]/nvec;
+                mcol += vectors[k*size+col]/nvec;
+            }
+            for(int k = 0; k < nvec; ++k) {
+                cov += (vectors[k*size+row]-mrow)*(vectors[k*size+col]-mcol)/nvec;
+            }
+            BOOST_CHECK_CLOSE(c3->getCovariance(row,col),cov,1e-9);
+        }
+    }
+    std::vector<double> bad(weights);
+    bad[nvec-1] = 0;
+    BOOST_CHECK_THROW(weighted.accumulateBatch(&vectors[0],nvec,&bad[0]),lk::RuntimeError);
+    BOOST_CHECK_EQUAL(weighted.count(),nvec);
+}
+
+BOOST_AUTO_TEST_CASE( accumulateBinnedData ) {
+    lk::AbsBinningCPtr binning(new lk::UniformBinning(0.,1.,size));
+    lk::BinnedGrid grid(binning);
+    lk::CovarianceAccumulator fromData(size), fromArray(size);
+    for(int k = 0; k < nvec; ++k) {
+        lk::BinnedDataPtr data(new lk::BinnedData(grid));
+        for(int i = 0; i < size; ++i) data->setData(i,vectors[k*size+i]);
+        fromData.accumulate(data,weights[k]);
+        fromArray.accumulate(&vectors[k*size],weights[k]);
+    }
+    lk::CovarianceMatrixCPtr c1 = fromData.getCovariance(), c2 = fromArray.getCovariance();
+    for(int row = 0; row < size; ++row) {
+        for(int col = 0; col <= row; ++col) {
+            BOOST_CHECK_EQUAL(c1->getCovariance(row,col),c2->getCovariance(row,col));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( dumpHasExpectedNumberOfLines ) {
+    lk::CovarianceAccumulator accumulator(size);
+    for(int k = 0; k < nvec; ++k) accumulator.accumulate(&vectors[k*size]);
+    std::ostringstream out;
+    accumulator.dump(out);
+    std::string dumped(out.str());
+    BOOST_CHECK_EQUAL(std::count(dumped.begin(),dumped.end(),'\n'),3 + (size*(size+3))/2);
+}
+
+BOOST_AUTO_TEST_CASE( shouldThrowErrorForInvalidInputs ) {
+    lk::CovarianceAccumulator accumulator(size), other(size+1);
+    BOOST_CHECK_THROW(lk::CovarianceAccumulator(0),lk::RuntimeError);
+    BOOST_CHECK_THROW(accumulator.accumulate(&vectors[0],0),lk::RuntimeError);
+    BOOST_CHECK_THROW(accumulator.merge(other),lk::RuntimeError);
+    BOOST_CHECK_THROW(accumulator.merge(accumulator),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // CovarianceAccumulator
@@ -5,6 +5,10 @@
 #include <boost/test/unit_test.hpp>
 
 #include "likely/likely.h"
+
+#include <algorithm>
+#include <cmath>
+
 namespace lk = likely;
 
 struct CovarianceMatrixFixture
@@ -70,4 +74,251 @@ BOOST_AUTO_TEST_CASE( shouldMultiplyVectorByCovaraianceMatrix ) {
 	
 }
 
+BOOST_AUTO_TEST_CASE( shouldUpdateWithRankOneTerm ) {
+	int n(10);
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(42);
+	lk::CovarianceMatrixPtr C = lk::generateRandomCovariance(n,2,random);
+	std::vector<double> v(n);
+	for(int k = 0; k < n; ++k) v[k] = random->getNormal();
+	// Build the expected result from scratch.
+	std::vector<double> packed;
+	for(int col = 0; col < n; ++col) {
+		for(int row = 0; row <= col; ++row) {
+			packed.push_back(C->getCovariance(row,col) + 0.5*v[row]*v[col]);
+		}
+	}
+	lk::CovarianceMatrix expected(packed);
+	// Make sure the inverse is in memory so that it is also updated.
+	double original(C->getInverseCovariance(0,0)), logdet(C->getLogDeterminant());
+	C->addRankOne(v,0.5);
+	for(int col = 0; col < n; ++col) {
+		for(int row = 0; row <= col; ++row) {
+			BOOST_CHECK_CLOSE(C->getCovariance(row,col),expected.getCovariance(row,col),1e-8);
+			BOOST_CHECK_CLOSE(C->getInverseCovariance(row,col),
+				expected.getInverseCovariance(row,col),1e-6);
+		}
+	}
+	BOOST_CHECK_CLOSE(C->getLogDeterminant(),expected.getLogDeterminant(),1e-8);
+	// A downdate undoes the update.
+	C->addRankOne(v,-0.5);
+	BOOST_CHECK_CLOSE(C->getInverseCovariance(0,0),original,1e-6);
+	BOOST_CHECK_CLOSE(C->getLogDeterminant(),logdet,1e-8);
+	// A downdate that is not positive definite is rejected without changes.
+	lk::CovarianceMatrixPtr D = lk::createDiagonalCovariance(n,2);
+	std::vector<double> unit(n,0);
+	unit[3] = 1;
+	BOOST_CHECK_THROW(D->addRankOne(unit,-2),lk::RuntimeError);
+	BOOST_CHECK_EQUAL(D->getCovariance(3,3),2);
+	D->addRankOne(unit,-1.5);
+	BOOST_CHECK_CLOSE(D->getCovariance(3,3),0.5,1e-10);
+	BOOST_CHECK_CLOSE(D->getInverseCovariance(3,3),2,1e-10);
+	BOOST_CHECK_CLOSE(D->getLogDeterminant(),(n-1)*std::log(2.)+std::log(0.5),1e-8);
+	BOOST_CHECK_THROW(D->addRankOne(std::vector<double>(n+1,1)),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldGiveSameResultsWithFullStorage ) {
+	int n(40), threshold(lk::getFullStorageThreshold());
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(7);
+	lk::CovarianceMatrixPtr C = lk::generateRandomCovariance(n,2,random);
+	std::vector<double> packed;
+	for(int col = 0; col < n; ++col) {
+		for(int row = 0; row <= col; ++row) packed.push_back(C->getCovariance(row,col));
+	}
+	std::vector<double> packedResult(packed), fullResult(packed);
+	std::vector<double> packedValues, fullValues, vectors;
+	lk::setFullStorageThreshold(0);
+	BOOST_CHECK(!lk::useFullStorage(n));
+	double packedLogDet = lk::choleskyDecompose(packedResult);
+	lk::invertCholesky(packedResult);
+	lk::symmetricMatrixEigenSolve(packed,packedValues,vectors);
+	lk::setFullStorageThreshold(n);
+	BOOST_CHECK(lk::useFullStorage(n));
+	double fullLogDet = lk::choleskyDecompose(fullResult);
+	lk::invertCholesky(fullResult);
+	lk::symmetricMatrixEigenSolve(packed,fullValues,vectors);
+	lk::setFullStorageThreshold(threshold);
+	BOOST_CHECK_CLOSE(packedLogDet,fullLogDet,1e-8);
+	for(int index = 0; index < packed.size(); ++index) {
+		BOOST_CHECK_CLOSE(packedResult[index],fullResult[index],1e-6);
+	}
+	for(int k = 0; k < n; ++k) {
+		BOOST_CHECK_CLOSE(packedValues[k],fullValues[k],1e-8);
+	}
+	// Check that the eigenvectors from full storage are correct: C.v = lambda*v
+	std::vector<double> v(n), Cv;
+	for(int k = 0; k < n; ++k) v[k] = vectors[k];
+	lk::symmetricMatrixMultiply(packed,v,Cv);
+	for(int k = 0; k < n; ++k) {
+		BOOST_CHECK_SMALL(Cv[k] - fullValues[0]*v[k],1e-8);
+	}
+	BOOST_CHECK_THROW(lk::setFullStorageThreshold(-1),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldCalculatePartialEigenModes ) {
+	int n(40), threshold(lk::getFullStorageThreshold());
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(11);
+	lk::CovarianceMatrixPtr C = lk::generateRandomCovariance(n,2,random);
+	std::vector<double> values, vectors, partialValues, partialVectors;
+	C->getEigenModes(values,vectors);
+	for(int full = 0; full < 2; ++full) {
+		lk::setFullStorageThreshold(full ? n : 0);
+		for(int first = 0; first < n; first += 35) {
+			int count(first ? n-first : 3);
+			C->getEigenModes(first,count,partialValues,partialVectors);
+			BOOST_REQUIRE_EQUAL(partialValues.size(),count);
+			BOOST_REQUIRE_EQUAL(partialVectors.size(),count*n);
+			for(int k = 0; k < count; ++k) {
+				BOOST_CHECK_CLOSE(partialValues[k],values[first+k],1e-8);
+				// Eigenvectors are only defined up to a sign.
+				double dotprod(0);
+				for(int i = 0; i < n; ++i) dotprod += partialVectors[k*n+i]*vectors[(first+k)*n+i];
+				BOOST_CHECK_CLOSE(std::fabs(dotprod),1,1e-8);
+			}
+		}
+	}
+	lk::setFullStorageThreshold(threshold);
+	BOOST_CHECK_THROW(C->getEigenModes(n-2,3,partialValues,partialVectors),lk::RuntimeError);
+	BOOST_CHECK_THROW(C->getEigenModes(0,0,partialValues,partialVectors),lk::RuntimeError);
+	// Rescaling only the first few modes only changes their eigenvalues.
+	std::vector<double> scales(n,1);
+	scales[0] = 4;
+	scales[2] = 0.5;
+	C->rescaleEigenvalues(scales);
+	for(int row = 0; row < n; row += 7) {
+		for(int col = 0; col <= row; col += 3) {
+			double expected(0);
+			for(int j = 0; j < n; ++j) expected += values[j]/scales[j]*vectors[j*n+row]*vectors[j*n+col];
+			BOOST_CHECK_SMALL(C->getInverseCovariance(row,col) - expected,1e-8);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( shouldCacheEigenModes ) {
+	int n(20);
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(3);
+	lk::CovarianceMatrixPtr C = lk::generateRandomCovariance(n,1,random);
+	std::vector<double> values, vectors, partialValues, partialVectors;
+	BOOST_CHECK_EQUAL(C->getMemoryState()[8],'-');
+	C->getEigenModes(values,vectors);
+	BOOST_CHECK_EQUAL(C->getMemoryState()[8],'E');
+	// Partial modes are copied from the cached full decomposition.
+	C->getEigenModes(5,3,partialValues,partialVectors);
+	BOOST_REQUIRE_EQUAL(partialVectors.size(),3*n);
+	BOOST_CHECK_EQUAL(partialValues[1],values[6]);
+	BOOST_CHECK_EQUAL(partialVectors[n+2],vectors[6*n+2]);
+	// Scaling the matrix updates the cached eigenvalues.
+	C->applyScaleFactor(2);
+	C->getEigenModes(5,3,partialValues,partialVectors);
+	BOOST_CHECK_CLOSE(partialValues[1],values[6]/2,1e-10);
+	// Any change drops the cache.
+	C->setCovariance(0,0,C->getCovariance(0,0)+1);
+	BOOST_CHECK_EQUAL(C->getMemoryState()[8],'-');
+	C->getEigenModes(0,2,partialValues,partialVectors);
+	BOOST_CHECK(partialValues[0] < values[0]/2);
+	BOOST_CHECK_EQUAL(C->getMemoryState()[8],'E');
+	// Compression also drops the cache.
+	C->compress();
+	BOOST_CHECK_EQUAL(C->getMemoryState()[8],'-');
+	BOOST_CHECK_THROW(C->getEigenModes(0,n+1,partialValues,partialVectors),lk::RuntimeError);
+	BOOST_CHECK_THROW(lk::CovarianceMatrix(n).getEigenModes(values,vectors),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldCalculateBatchOfChiSquares ) {
+	int n(50), nvec(1000);
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(3);
+	lk::CovarianceMatrixPtr C = lk::generateRandomCovariance(n,2,random);
+	std::vector<double> deltas(n*nvec), chi2;
+	for(int index = 0; index < deltas.size(); ++index) deltas[index] = random->getNormal();
+	std::vector<double> original(deltas);
+	C->chiSquareBatch(deltas,chi2);
+	BOOST_REQUIRE_EQUAL(chi2.size(),nvec);
+	for(int k = 0; k < nvec; ++k) {
+		std::vector<double> delta(&original[k*n],&original[(k+1)*n]);
+		BOOST_CHECK_CLOSE(chi2[k],C->chiSquare(delta),1e-8);
+	}
+	deltas.resize(n+1);
+	BOOST_CHECK_THROW(C->chiSquareBatch(deltas,chi2),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldCompressBandedInverse ) {
+	int n(100);
+	lk::CovarianceMatrix C(n);
+	double band[4] = { 4, -1, 0.2, 1e-4 };
+	for(int col = 0; col < n; ++col) {
+		for(int row = std::max(0,col-3); row <= col; ++row) {
+			C.setInverseCovariance(row,col,band[col-row]);
+		}
+	}
+	std::size_t dense(C.getMemoryUsage());
+	// Lossless compression stores one run per column.
+	lk::CovarianceMatrix lossless(C), thresholded(C), rounded(C);
+	BOOST_CHECK(lossless.compress());
+	BOOST_CHECK(!lossless.compress());
+	BOOST_CHECK_EQUAL(lossless.getCompressionError(),0);
+	BOOST_CHECK(lossless.getMemoryUsage() < dense/8);
+	// Dropping the outer band and rounding to floats have bounded errors.
+	BOOST_CHECK(thresholded.compress(1e-3));
+	BOOST_CHECK_CLOSE(thresholded.getCompressionError(),1e-4/4,1e-8);
+	BOOST_CHECK(thresholded.getMemoryUsage() < lossless.getMemoryUsage());
+	BOOST_CHECK(rounded.compress(0,true));
+	BOOST_CHECK(rounded.getCompressionError() > 0);
+	BOOST_CHECK(rounded.getCompressionError() < 1e-7);
+	BOOST_CHECK(rounded.getMemoryUsage() < lossless.getMemoryUsage());
+	// Compressed matrices can be added without being uncompressed.
+	lk::CovarianceMatrix sum(n);
+	sum.addInverse(rounded,1);
+	BOOST_CHECK(rounded.isCompressed());
+	for(int col = 0; col < n; ++col) {
+		for(int row = 0; row <= col; ++row) {
+			double exact(C.getInverseCovariance(row,col));
+			BOOST_CHECK_EQUAL(lossless.getInverseCovariance(row,col),exact);
+			BOOST_CHECK(std::fabs(thresholded.getInverseCovariance(row,col)-exact)
+				<= 4*thresholded.getCompressionError());
+			BOOST_CHECK(std::fabs(sum.getInverseCovariance(row,col)-exact)
+				<= 4*rounded.getCompressionError());
+		}
+	}
+	BOOST_CHECK_THROW(C.compress(-1),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_CASE( shouldOperateOnCompressedMatrix ) {
+	int n(60);
+	lk::RandomPtr random(new lk::Random());
+	random->setSeed(5);
+	lk::CovarianceMatrix C(n);
+	for(int col = 0; col < n; ++col) {
+		C.setInverseCovariance(col,col,2+random->getUniform());
+		// Leave gaps in each column so that it has several runs.
+		for(int row = std::max(0,col-6); row < col; ++row) {
+			if(row % 3 != 1) C.setInverseCovariance(row,col,0.1*random->getNormal());
+		}
+	}
+	std::vector<double> delta(n), expected, product;
+	for(int k = 0; k < n; ++k) delta[k] = random->getNormal();
+	expected = delta;
+	C.multiplyByInverseCovariance(expected);
+	double chi2(C.chiSquare(delta));
+	for(int mode = 0; mode < 2; ++mode) {
+		lk::CovarianceMatrix compressed(C);
+		compressed.compress(0,1 == mode);
+		double tolerance(mode ? 1e-6 : 1e-12);
+		BOOST_CHECK_SMALL(compressed.chiSquare(delta) - chi2,tolerance*chi2);
+		product = delta;
+		compressed.multiplyByInverseCovariance(product);
+		for(int k = 0; k < n; ++k) BOOST_CHECK_SMALL(product[k] - expected[k],tolerance*10);
+		lk::CovarianceMatrix sum(C);
+		sum.addInverse(compressed,-0.5);
+		BOOST_CHECK(compressed.isCompressed());
+		BOOST_CHECK_SMALL(sum.chiSquare(delta) - 0.5*chi2,tolerance*chi2);
+	}
+	product.resize(n+1);
+	C.compress();
+	BOOST_CHECK_THROW(C.multiplyByInverseCovariance(product),lk::RuntimeError);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
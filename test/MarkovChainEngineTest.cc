@@ -0,0 +1,106 @@
+// MarkovChainEngine class unit tests.
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "likely/likely.h"
+
+#include "TemporaryFile.h"
+
+namespace lk = likely;
+
+namespace {
+    // A gaussian NLL with means (1,-2), errors (0.5,1) and correlation 0.5 that also
+    // depends on a fixed third parameter.
+    double gaussianNLL(lk::Parameters const &p) {
+        double dx((p[0]-1)/0.5), dy((p[1]+2)/1.), rho(0.5);
+        return (dx*dx + dy*dy - 2*rho*dx*dy)/(2*(1-rho*rho)) + p[2];
+    }
+}
+
+struct MarkovChainEngineFixture
+{
+    MarkovChainEngineFixture() : f(new lk::Function(gaussianNLL)) {
+        params.push_back(lk::FitParameter("x",0,0.1));
+        params.push_back(lk::FitParameter("y",0,0.1));
+        params.push_back(lk::FitParameter("z",0.5,0));
+    }
+    ~MarkovChainEngineFixture() { }
+    lk::FunctionPtr f;
+    lk::FitParameters params;
+};
+
+BOOST_FIXTURE_TEST_SUITE( MarkovChainEngine, MarkovChainEngineFixture )
+
+BOOST_AUTO_TEST_CASE( ensembleFindsMinimumAndCovariance ) {
+    lk::Random::instance()->setSeed(42);
+    lk::FunctionMinimumPtr fmin = lk::findMinimum(f,params,"mc::ensemble",1e-3,200000);
+    lk::Parameters values(fmin->getParameters());
+    BOOST_CHECK_SMALL(values[0]-1,0.1);
+    BOOST_CHECK_SMALL(values[1]+2,0.2);
+    BOOST_CHECK_EQUAL(values[2],0.5);
+    BOOST_CHECK(fmin->getMinValue() < 0.51);
+    BOOST_CHECK(fmin->getNEvalCount() > 0);
+    lk::Parameters errors(fmin->getErrors(true));
+    BOOST_CHECK_CLOSE(errors[0],0.5,20);
+    BOOST_CHECK_CLOSE(errors[1],1.0,20);
+}
+
+BOOST_AUTO_TEST_CASE( ensembleIsReproducible ) {
+    lk::Random::instance()->setSeed(7);
+    lk::FunctionMinimumPtr fmin1 = lk::findMinimum(f,params,"mc::ensemble",1e-3,20000);
+    lk::Random::instance()->setSeed(7);
+    lk::FunctionMinimumPtr fmin2 = lk::findMinimum(f,params,"mc::ensemble",1e-3,20000);
+    BOOST_CHECK_EQUAL(fmin1->getMinValue(),fmin2->getMinValue());
+    BOOST_CHECK_EQUAL(fmin1->getNEvalCount(),fmin2->getNEvalCount());
+    BOOST_CHECK_EQUAL(fmin1->getErrors(true)[0],fmin2->getErrors(true)[0]);
+}
+
+BOOST_AUTO_TEST_CASE( parallelEnsembleMatchesSerial ) {
+    lk::Random::instance()->setSeed(7);
+    lk::FunctionMinimumPtr serial = lk::findMinimum(f,params,"mc::ensemble",1e-3,20000);
+    lk::Random::instance()->setSeed(7);
+    lk::FunctionMinimumPtr parallel =
+        lk::findMinimum(f,params,"mc::parallel_ensemble",1e-3,20000);
+    BOOST_CHECK_EQUAL(serial->getMinValue(),parallel->getMinValue());
+    BOOST_CHECK_EQUAL(serial->getNEvalCount(),parallel->getNEvalCount());
+    BOOST_CHECK_EQUAL(serial->getErrors(true)[0],parallel->getErrors(true)[0]);
+    BOOST_CHECK_EQUAL(serial->getErrors(true)[1],parallel->getErrors(true)[1]);
+}
+
+BOOST_AUTO_TEST_CASE( chainFileRoundTrip ) {
+    lk::Random::instance()->setSeed(11);
+    lk::MarkovChainEngine engine(f,lk::GradientCalculatorPtr(),params,"saunter");
+    lk::FunctionMinimumPtr fmin = lk::findMinimum(f,params,"mc::saunter",1e-3,2000);
+    lk::test::TemporaryFile file("MarkovChainEngineTest-%%%%-%%%%.chain");
+    std::string filename(file.getName());
+    int nAccepted(0), nTrials;
+    {
+        // Use a small buffer so that the background thread is exercised.
+        lk::MarkovChainWriter writer(filename,params,7);
+        nTrials = engine.generate(fmin,100,0,writer.getCallback());
+        BOOST_CHECK_EQUAL(writer.getNRecords(),nTrials);
+        writer.close();
+    }
+    lk::MarkovChainReader reader(filename);
+    BOOST_REQUIRE_EQUAL(reader.getNSamples(),nTrials);
+    BOOST_REQUIRE_EQUAL(reader.getNParameters(),2);
+    BOOST_CHECK_EQUAL(reader.getParameterNames()[0],"x");
+    BOOST_CHECK_EQUAL(reader.getParameterNames()[1],"y");
+    for(long index = 0; index < reader.getNSamples(); ++index) {
+        double const *trial = reader.getTrial(index);
+        lk::Parameters p(3,0.5);
+        p[0] = trial[0];
+        p[1] = trial[1];
+        BOOST_CHECK_EQUAL(reader.getTrialNLL(index),gaussianNLL(p));
+        if(reader.isAccepted(index)) {
+            nAccepted++;
+            BOOST_CHECK_EQUAL(reader.getCurrent(index)[0],trial[0]);
+            BOOST_CHECK_EQUAL(reader.getCurrentNLL(index),reader.getTrialNLL(index));
+        }
+    }
+    BOOST_CHECK_EQUAL(nAccepted,100);
+    BOOST_CHECK_THROW(reader.getCurrent(nTrials),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // MarkovChainEngine
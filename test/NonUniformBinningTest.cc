@@ -5,6 +5,9 @@
 #include <boost/test/unit_test.hpp>
 
 #include "likely/likely.h"
+
+#include <cmath>
+
 namespace lk = likely;
 
 struct NonUniformBinningFixture
@@ -38,6 +41,42 @@ BOOST_AUTO_TEST_CASE( shouldReturnCorrectBinIndexOrThrowErrorForOutOfRangeIndex
 	BOOST_CHECK_THROW(axis->getBinIndex(1.1), lk::BinningError);
 }
 
+BOOST_AUTO_TEST_CASE( shouldAgreeWithLinearSearch ) {
+	// Use log-spaced bins, with a zero-width bin, and random values.
+	std::vector<double> edges;
+	for(int k = 0; k <= 50; ++k) edges.push_back(std::pow(10.,-2+k*0.08));
+	edges.insert(edges.begin()+20,edges[20]);
+	lk::NonUniformBinning binning(edges);
+	lk::Random random;
+	random.setSeed(123);
+	for(int trial = 0; trial < 10000; ++trial) {
+		double value = (trial < 51) ? edges[trial] : random.getUniform()*edges.back();
+		int expected(-1);
+		for(int bin = 1; bin < edges.size(); ++bin) {
+			if(value < edges[bin]) {
+				expected = bin-1;
+				break;
+			}
+		}
+		if(value < edges[0] || expected < 0) {
+			BOOST_CHECK_THROW(binning.getBinIndex(value),lk::BinningError);
+		}
+		else {
+			BOOST_CHECK_EQUAL(binning.getBinIndex(value),expected);
+		}
+	}
+	// The batch lookup agrees, and flags values outside our interval.
+	std::vector<double> values(edges);
+	values.push_back(-1);
+	std::vector<int> indices(values.size());
+	BOOST_CHECK_EQUAL(binning.getBinIndices(&values[0],&indices[0],values.size()),2);
+	for(int k = 0; k < edges.size()-1; ++k) BOOST_CHECK_EQUAL(indices[k],binning.getBinIndex(values[k]));
+	BOOST_CHECK_EQUAL(indices[edges.size()-1],-1);
+	BOOST_CHECK_EQUAL(indices[edges.size()],-1);
+	BOOST_CHECK_THROW(binning.getBinIndex(edges.back()),lk::BinningError);
+	BOOST_CHECK_THROW(binning.getBinIndex(std::sqrt(-1.)),lk::BinningError);
+}
+
 BOOST_AUTO_TEST_CASE( shouldReturnCorrectNumberOfBins ) {
 	BOOST_CHECK_EQUAL(axis->getNBins(), 3);
 }
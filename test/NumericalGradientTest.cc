@@ -0,0 +1,86 @@
+// NumericalGradient class unit tests.
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "likely/likely.h"
+
+#include <cmath>
+
+namespace lk = likely;
+
+namespace {
+    // A non-quadratic function of three parameters.
+    double testFunction(lk::Parameters const &p) {
+        return std::sin(p[0])*p[1] + p[1]*p[1]*p[1] + std::exp(p[2]);
+    }
+    double throwingFunction(lk::Parameters const &p) {
+        throw lk::RuntimeError("oops");
+    }
+}
+
+struct NumericalGradientFixture
+{
+    NumericalGradientFixture() : f(new lk::Function(testFunction)) {
+        params.push_back(lk::FitParameter("x",0.3,0.1));
+        params.push_back(lk::FitParameter("y",-0.7,0.2));
+        params.push_back(lk::FitParameter("z",1.5,0));
+        lk::getFitParameterValues(params,values);
+    }
+    ~NumericalGradientFixture() { }
+    lk::FunctionPtr f;
+    lk::FitParameters params;
+    lk::Parameters values;
+};
+
+BOOST_FIXTURE_TEST_SUITE( NumericalGradient, NumericalGradientFixture )
+
+BOOST_AUTO_TEST_CASE( centralDifference ) {
+    lk::NumericalGradient gc(f,params,lk::NumericalGradient::CentralDifference,1e-3,1);
+    lk::Gradient grad;
+    gc(values,grad);
+    BOOST_REQUIRE_EQUAL(grad.size(),3);
+    BOOST_CHECK_CLOSE(grad[0],std::cos(0.3)*(-0.7),1e-4);
+    BOOST_CHECK_CLOSE(grad[1],std::sin(0.3)+3*0.49,1e-4);
+    // Fixed parameters always have a zero gradient.
+    BOOST_CHECK_EQUAL(grad[2],0);
+    BOOST_CHECK_EQUAL(gc.getPointsPerGradient(),4);
+    BOOST_CHECK_EQUAL(gc.getEvalCount(),4);
+}
+
+BOOST_AUTO_TEST_CASE( richardsonIsMoreAccurate ) {
+    lk::NumericalGradient central(f,params,lk::NumericalGradient::CentralDifference,0.1,1);
+    lk::NumericalGradient richardson(f,params,lk::NumericalGradient::Richardson,0.1,1);
+    lk::Gradient grad1,grad2;
+    central(values,grad1);
+    richardson(values,grad2);
+    double exact(std::sin(0.3)+3*0.49);
+    BOOST_CHECK(std::fabs(grad2[1]-exact) < 0.01*std::fabs(grad1[1]-exact));
+    BOOST_CHECK_EQUAL(richardson.getEvalCount(),8);
+}
+
+BOOST_AUTO_TEST_CASE( threadsGiveSameResult ) {
+    lk::NumericalGradient serial(f,params,lk::NumericalGradient::Richardson,1e-3,1);
+    lk::GradientCalculatorPtr parallel =
+        lk::createNumericalGradientCalculator(f,params,lk::NumericalGradient::Richardson,1e-3,4);
+    lk::Gradient grad1,grad2;
+    for(int trial = 0; trial < 100; ++trial) {
+        values[0] = 0.01*trial;
+        serial(values,grad1);
+        (*parallel)(values,grad2);
+        BOOST_CHECK_EQUAL(grad1[0],grad2[0]);
+        BOOST_CHECK_EQUAL(grad1[1],grad2[1]);
+    }
+    BOOST_CHECK_EQUAL(parallel->target<lk::NumericalGradient>()->getEvalCount(),800);
+}
+
+BOOST_AUTO_TEST_CASE( exceptionsArePropagated ) {
+    lk::FunctionPtr bad(new lk::Function(throwingFunction));
+    lk::NumericalGradient gc(bad,params,lk::NumericalGradient::CentralDifference,1e-3,2);
+    lk::Gradient grad;
+    BOOST_CHECK_THROW(gc(values,grad),lk::RuntimeError);
+    BOOST_CHECK_THROW(lk::NumericalGradient(f,params,lk::NumericalGradient::Richardson,0),
+        lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_SUITE_END() // NumericalGradient
@@ -0,0 +1,57 @@
+// Random class unit tests.
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "likely/likely.h"
+
+namespace lk = likely;
+
+struct RandomFixture
+{
+    RandomFixture() : random(new lk::Random()) {
+        random->setSeed(1234);
+    }
+    ~RandomFixture() { }
+    lk::RandomPtr random;
+};
+
+BOOST_FIXTURE_TEST_SUITE( Random, RandomFixture )
+
+BOOST_AUTO_TEST_CASE( streamsAreReproducible ) {
+    lk::RandomPtr s1 = random->createStream(7), s2 = random->createStream(7);
+    BOOST_REQUIRE_EQUAL(s1->getSeed(),s2->getSeed());
+    for(int i = 0; i < 10; ++i) BOOST_REQUIRE_EQUAL(s1->getUniform(),s2->getUniform());
+    std::size_t n1(1000), n2(1000);
+    boost::shared_array<double> a1 = s1->fillDoubleArrayNormal(n1), a2 = s2->fillDoubleArrayNormal(n2);
+    BOOST_REQUIRE_EQUAL(n1,n2);
+    for(std::size_t i = 0; i < n1; ++i) BOOST_REQUIRE_EQUAL(a1[i],a2[i]);
+    BOOST_REQUIRE_EQUAL(s1->getFastUniform(),s2->getFastUniform());
+}
+
+BOOST_AUTO_TEST_CASE( streamsAreIndependent ) {
+    lk::RandomPtr s0 = random->createStream(0), s1 = random->createStream(1);
+    BOOST_CHECK(s0->getUniform() != s1->getUniform());
+    BOOST_CHECK(s0->getFastUniform() != s1->getFastUniform());
+    std::size_t n0(1000), n1(1000);
+    boost::shared_array<double> a0 = s0->fillDoubleArrayUniform(n0), a1 = s1->fillDoubleArrayUniform(n1);
+    int nsame(0);
+    for(std::size_t i = 0; i < n0; ++i) if(a0[i] == a1[i]) nsame++;
+    BOOST_CHECK_EQUAL(nsame,0);
+    // Using a stream does not change the sequence of the master generator.
+    lk::Random other;
+    other.setSeed(1234);
+    BOOST_CHECK_EQUAL(random->getUniform(),other.getUniform());
+}
+
+BOOST_AUTO_TEST_CASE( streamsDependOnMasterSeed ) {
+    lk::Random other;
+    other.setSeed(4321);
+    BOOST_CHECK(random->createStream(0)->getUniform() != other.createStream(0)->getUniform());
+}
+
+BOOST_AUTO_TEST_CASE( shouldThrowErrorForNegativeStreamIndex ) {
+    BOOST_CHECK_THROW(random->createStream(-1),lk::RuntimeError);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
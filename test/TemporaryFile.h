@@ -0,0 +1,31 @@
+// Provides a uniquely named file in the system temporary directory for tests.
+
+#ifndef LIKELY_TEST_TEMPORARY_FILE
+#define LIKELY_TEST_TEMPORARY_FILE
+
+#include "boost/filesystem.hpp"
+#include "boost/utility.hpp"
+
+#include <string>
+
+namespace likely {
+namespace test {
+    // Reserves a unique temporary filename and removes any file with that name when this
+    // object goes out of scope, so that tests clean up even when a check throws.
+    class TemporaryFile : public boost::noncopyable {
+    public:
+        TemporaryFile(std::string const &model = "likely-%%%%-%%%%-%%%%-%%%%")
+        : _path(boost::filesystem::temp_directory_path()/boost::filesystem::unique_path(model))
+        { }
+        ~TemporaryFile() {
+            boost::system::error_code ignored;
+            boost::filesystem::remove(_path,ignored);
+        }
+        // Returns the full name of this temporary file.
+        std::string getName() const { return _path.string(); }
+    private:
+        boost::filesystem::path _path;
+    }; // TemporaryFile
+} } // likely::test
+
+#endif // LIKELY_TEST_TEMPORARY_FILE
@@ -5,6 +5,9 @@
 #include <boost/test/unit_test.hpp>
 
 #include "likely/likely.h"
+
+#include <cmath>
+
 namespace lk = likely;
 
 struct UniformBinningFixture
@@ -36,6 +39,14 @@ BOOST_AUTO_TEST_CASE( shouldReturnCorrectBinIndexOrThrowErrorForOutOfRangeIndex
 	BOOST_CHECK_THROW(axis->getBinIndex(100.), lk::BinningError);
 }
 
+BOOST_AUTO_TEST_CASE( shouldFlagOutOfRangeValuesInBatch ) {
+	double values[6] = { 0, 4.999, 2.6, -0.1, 5, std::sqrt(-1.) };
+	int indices[6];
+	BOOST_CHECK_EQUAL(axis->getBinIndices(values,indices,6),3);
+	for(int k = 0; k < 3; ++k) BOOST_CHECK_EQUAL(indices[k],axis->getBinIndex(values[k]));
+	for(int k = 3; k < 6; ++k) BOOST_CHECK_EQUAL(indices[k],-1);
+}
+
 BOOST_AUTO_TEST_CASE( shouldReturnCorrectNumberOfBins ) {
 	BOOST_CHECK_EQUAL(axis->getNBins(), 20);
 }
@@ -43,6 +43,14 @@ BOOST_AUTO_TEST_CASE( shouldReturnCorrectBinIndexOrThrowError ) {
 	BOOST_CHECK_EQUAL(axis->getBinIndex(-0.0001), 0);
 }
 
+BOOST_AUTO_TEST_CASE( shouldFlagOutOfRangeValuesInBatch ) {
+	double values[6] = { 0, 10.0001, 5, 4.9, 11+2./3., -10./6. };
+	int indices[6];
+	BOOST_CHECK_EQUAL(axis->getBinIndices(values,indices,6),3);
+	for(int k = 0; k < 3; ++k) BOOST_CHECK_EQUAL(indices[k],axis->getBinIndex(values[k]));
+	for(int k = 3; k < 6; ++k) BOOST_CHECK_EQUAL(indices[k],-1);
+}
+
 BOOST_AUTO_TEST_CASE( shouldReturnCorrectNumberOfBins ) {
 	BOOST_CHECK_EQUAL(axis->getNBins(), 7);
 }